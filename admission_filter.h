@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/*
+    TinyLFU admission (Einziger et al.): a count-min sketch estimates how often each id was
+    requested recently, and a missed id only takes the LFU victim's row if its estimate beats
+    the victim's. ids seen once stay out of the cache instead of displacing warm rows.
+
+    4 rows of 8-bit counters saturating at 15, row width the power of two >= capacity, so the
+    sketch costs 4 bytes per cache row. after sample_factor * capacity recorded ids every
+    counter is halved, so the estimates follow the recent stream.
+*/
+class TinyLfuFilter {
+ public:
+  static const int kDepth = 4;
+  static const uint8_t kMaxCount = 15;
+
+  TinyLfuFilter(long capacity = 0, long sample_factor = 10) {
+    long width = 16;
+    while (width < capacity) {
+      width <<= 1;
+    }
+    mask_ = width - 1;
+    counters_.assign(kDepth * width, 0);
+    sample_size_ = std::max(1L, sample_factor * std::max(capacity, 1L));
+  }
+
+  void record(long key) {
+    uint64_t h1, h2;
+    hash(key, h1, h2);
+    for (int d = 0; d < kDepth; d++) {
+      auto& counter = counters_[d * (mask_ + 1) + ((h1 + d * h2) & mask_)];
+      if (counter < kMaxCount) {
+        counter++;
+      }
+    }
+    if (++recorded_num_ >= sample_size_) {
+      reset();
+    }
+  }
+
+  int estimate(long key) const {
+    uint64_t h1, h2;
+    hash(key, h1, h2);
+    int count = kMaxCount;
+    for (int d = 0; d < kDepth; d++) {
+      count = std::min<int>(count, counters_[d * (mask_ + 1) + ((h1 + d * h2) & mask_)]);
+    }
+    return count;
+  }
+
+  /* admit candidate in place of victim */
+  bool admit(long candidate, long victim) const { return estimate(candidate) > estimate(victim); }
+
+  void clear() {
+    std::fill(counters_.begin(), counters_.end(), 0);
+    recorded_num_ = 0;
+  }
+
+  long memory_bytes() const { return counters_.capacity(); }
+
+ private:
+  std::vector<uint8_t> counters_;  // kDepth rows of mask_ + 1 counters
+  uint64_t mask_;
+  long sample_size_;
+  long recorded_num_ = 0;
+
+  /* halve every counter, the periodic reset */
+  void reset() {
+    for (auto& counter : counters_) {
+      counter >>= 1;
+    }
+    recorded_num_ /= 2;
+  }
+
+  static void hash(long key, uint64_t& h1, uint64_t& h2) {  // splitmix64 finalizer
+    uint64_t z = static_cast<uint64_t>(key) + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    h1 = z ^ (z >> 31);
+    h2 = (h1 >> 32) | 1;
+  }
+};
+
+/*
+    ids rejected during one batch. open addressing over stamped slots: clear() bumps the stamp
+    instead of touching the table, so once the table has grown to the largest batch's
+    rejections a batch allocates nothing.
+*/
+class BatchIdSet {
+ public:
+  bool contains(long key) const {
+    if (keys_.empty()) {
+      return false;
+    }
+    for (long pos = home(key);; pos = (pos + 1) & mask_) {
+      if (stamps_[pos] != stamp_) {
+        return false;
+      }
+      if (keys_[pos] == key) {
+        return true;
+      }
+    }
+  }
+
+  void insert(long key) { /* key must not be in the set yet */
+    if (2 * (size_ + 1) > (long)keys_.size()) {
+      grow();
+    }
+    place(key);
+    size_++;
+  }
+
+  void clear() {
+    size_ = 0;
+    if (++stamp_ == 0) {
+      std::fill(stamps_.begin(), stamps_.end(), 0);
+      stamp_ = 1;
+    }
+  }
+
+ private:
+  std::vector<long> keys_;
+  std::vector<uint32_t> stamps_;  // a slot is live when its stamp is stamp_
+  uint32_t stamp_ = 1;
+  long size_ = 0;
+  long mask_ = 0;
+  int shift_ = 64;
+
+  long home(long key) const {  // fibonacci hashing
+    return static_cast<long>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> shift_) &
+           mask_;
+  }
+
+  void place(long key) {
+    auto pos = home(key);
+    while (stamps_[pos] == stamp_) {
+      pos = (pos + 1) & mask_;
+    }
+    keys_[pos] = key;
+    stamps_[pos] = stamp_;
+  }
+
+  void grow() {
+    std::vector<long> live_keys;
+    for (size_t pos = 0; pos < keys_.size(); pos++) {
+      if (stamps_[pos] == stamp_) {
+        live_keys.push_back(keys_[pos]);
+      }
+    }
+    long table_size = std::max<long>(16, 2 * keys_.size());
+    shift_ = 64;
+    for (long size = table_size; size > 1; size >>= 1) {
+      shift_--;
+    }
+    mask_ = table_size - 1;
+    keys_.assign(table_size, 0);
+    stamps_.assign(table_size, 0);
+    stamp_ = 1;
+    for (auto key : live_keys) {
+      place(key);
+    }
+  }
+};
@@ -0,0 +1,263 @@
+// workload-driven benchmark: prepare_ids latency percentiles, throughput and hit rate,
+// one csv / json-lines record per (manager, workload, batch size, capacity).
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "manager_factory.h"
+#include "workload.h"
+
+using namespace std;
+
+struct BenchConfig {
+  vector<string> managers = {"cim", "cim_dense", "flat", "sort_set", "sort_select"};
+  vector<string> workloads = {"uniform", "zipf", "shift"};
+  vector<long> batch_sizes = {1024, 8192};
+  vector<long> capacities = {16384, 163840};
+  long id_range = 1638400;
+  double skew = 1.0;
+  long hot_size = 8192;
+  double hot_fraction = 0.8;
+  long shift_period = 10;
+  long batch_num = 100;
+  long warmup_num = 10;
+  uint64_t seed = 7;
+  string trace_path;
+  string format = "csv";
+  string tag;
+  long aging_period = 0;  // batches between aging epochs of the cim and sort managers, 0 = off
+  int aging_shift = 1;
+};
+
+struct BenchResult {
+  double p50_us = 0.0;
+  double p99_us = 0.0;
+  double mean_us = 0.0;
+  double ids_per_s = 0.0;
+  double hit_rate = 0.0;
+  double admits_per_batch = 0.0;
+  double evicts_per_batch = 0.0;
+};
+
+/* all batches are generated up front so generation is not timed */
+vector<vector<long>> make_batches(const BenchConfig& config, const string& workload,
+                                  long batch_size) {
+  vector<vector<long>> batches(config.warmup_num + config.batch_num, vector<long>(batch_size));
+  function<void(long*, long)> next_batch;
+  if (workload == "uniform") {
+    auto gen = make_shared<UniformWorkload>(config.id_range, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (workload == "zipf") {
+    auto gen = make_shared<ZipfWorkload>(config.id_range, config.skew, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (workload == "shift") {
+    auto gen = make_shared<ShiftingHotSetWorkload>(config.id_range, config.hot_size,
+                                                   config.hot_fraction, config.shift_period,
+                                                   config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (workload == "trace") {
+    auto gen = make_shared<TraceWorkload>(config.trace_path);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else {
+    throw runtime_error("Error: unknown workload " + workload);
+  }
+  for (auto& batch : batches) {
+    next_batch(batch.data(), batch.size());
+  }
+  return batches;
+}
+
+BenchResult run_bench(PrepareFn prepare_ids, const BenchConfig& config,
+                      const vector<vector<long>>& batches) {
+  CacheInstructionBuffer out;
+  out.reserve(batches.front().size());
+  for (long t = 0; t < config.warmup_num; t++) {
+    prepare_ids(batches[t].data(), batches[t].size(), out);
+  }
+  vector<double> latency_us;
+  long id_num = 0;
+  long admit_num = 0;
+  long evict_num = 0;
+  long bypass_num = 0;  // ids served from cpu by an admission filter
+  for (long t = config.warmup_num; t < (long)batches.size(); t++) {
+    auto start = chrono::steady_clock::now();
+    auto counts = prepare_ids(batches[t].data(), batches[t].size(), out);
+    auto end = chrono::steady_clock::now();
+    latency_us.push_back(chrono::duration<double, micro>(end - start).count());
+    id_num += batches[t].size();
+    admit_num += get<0>(counts);
+    evict_num += get<1>(counts);
+    bypass_num += count(out.gpu_idx_vector.begin(), out.gpu_idx_vector.end(), -1L);
+  }
+  BenchResult result;
+  if (latency_us.empty()) {
+    return result;
+  }
+  double total_us = 0.0;
+  for (auto us : latency_us) {
+    total_us += us;
+  }
+  sort(latency_us.begin(), latency_us.end());
+  auto percentile = [&](double p) {  // nearest rank
+    long rank = static_cast<long>(p * latency_us.size() + 0.999999);
+    return latency_us[max(1L, min<long>(rank, latency_us.size())) - 1];
+  };
+  result.p50_us = percentile(0.50);
+  result.p99_us = percentile(0.99);
+  result.mean_us = total_us / latency_us.size();
+  result.ids_per_s = total_us > 0.0 ? id_num / (total_us * 1e-6) : 0.0;
+  result.hit_rate = id_num > 0 ? 1.0 - double(admit_num + bypass_num) / id_num : 0.0;
+  result.admits_per_batch = double(admit_num) / latency_us.size();
+  result.evicts_per_batch = double(evict_num) / latency_us.size();
+  return result;
+}
+
+void print_header(const BenchConfig& config) {
+  if (config.format == "csv") {
+    cout << "tag,manager,workload,skew,batch_size,capacity,id_range,batch_num,p50_us,p99_us,"
+            "mean_us,ids_per_s,hit_rate,admits_per_batch,evicts_per_batch"
+         << endl;
+  }
+}
+
+void print_result(const BenchConfig& config, const string& manager, const string& workload,
+                  long batch_size, long capacity, long id_range, const BenchResult& r) {
+  if (config.format == "csv") {
+    cout << config.tag << "," << manager << "," << workload << "," << config.skew << ","
+         << batch_size << "," << capacity << "," << id_range << "," << config.batch_num << ","
+         << r.p50_us << "," << r.p99_us << "," << r.mean_us << "," << r.ids_per_s << ","
+         << r.hit_rate << "," << r.admits_per_batch << "," << r.evicts_per_batch << endl;
+  } else {
+    cout << "{\"tag\":\"" << config.tag << "\",\"manager\":\"" << manager
+         << "\",\"workload\":\"" << workload << "\",\"skew\":" << config.skew
+         << ",\"batch_size\":" << batch_size << ",\"capacity\":" << capacity
+         << ",\"id_range\":" << id_range << ",\"batch_num\":" << config.batch_num
+         << ",\"p50_us\":" << r.p50_us << ",\"p99_us\":" << r.p99_us
+         << ",\"mean_us\":" << r.mean_us << ",\"ids_per_s\":" << r.ids_per_s
+         << ",\"hit_rate\":" << r.hit_rate << ",\"admits_per_batch\":" << r.admits_per_batch
+         << ",\"evicts_per_batch\":" << r.evicts_per_batch << "}" << endl;
+  }
+}
+
+template <typename T>
+vector<T> parse_list(const string& arg) {
+  vector<T> values;
+  stringstream ss(arg);
+  string item;
+  while (getline(ss, item, ',')) {
+    stringstream item_ss(item);
+    T value;
+    item_ss >> value;
+    values.push_back(value);
+  }
+  return values;
+}
+
+void print_usage() {
+  cerr << "usage: bench [--managers cim,cim_dense,cim_tinylfu,flat,flat_lru,flat_lfuda,flat_arc,\n"
+          "                         sort_set,sort_select,sort_select_dense]\n"
+          "             [--workloads uniform,zipf,shift,trace] [--trace FILE]\n"
+          "             [--batch-sizes 1024,8192] [--capacities 16384,163840]\n"
+          "             [--id-range N] [--skew S] [--hot-size N] [--hot-fraction F]\n"
+          "             [--shift-period BATCHES] [--batches N] [--warmup N] [--seed N]\n"
+          "             [--format csv|jsonl] [--tag LABEL] [--aging PERIOD[,SHIFT]]\n";
+}
+
+BenchConfig parse_args(int argc, char** argv) {
+  BenchConfig config;
+  for (int i = 1; i < argc; i++) {
+    string key = argv[i];
+    if (key == "--help" || key == "-h") {
+      print_usage();
+      exit(0);
+    }
+    if (i + 1 >= argc) {
+      print_usage();
+      throw runtime_error("Error: missing value for " + key);
+    }
+    string value = argv[++i];
+    if (key == "--managers") {
+      config.managers = parse_list<string>(value);
+    } else if (key == "--workloads") {
+      config.workloads = parse_list<string>(value);
+    } else if (key == "--trace") {
+      config.trace_path = value;
+    } else if (key == "--batch-sizes") {
+      config.batch_sizes = parse_list<long>(value);
+    } else if (key == "--capacities") {
+      config.capacities = parse_list<long>(value);
+    } else if (key == "--id-range") {
+      config.id_range = stol(value);
+    } else if (key == "--skew") {
+      config.skew = stod(value);
+    } else if (key == "--hot-size") {
+      config.hot_size = stol(value);
+    } else if (key == "--hot-fraction") {
+      config.hot_fraction = stod(value);
+    } else if (key == "--shift-period") {
+      config.shift_period = stol(value);
+    } else if (key == "--batches") {
+      config.batch_num = stol(value);
+    } else if (key == "--warmup") {
+      config.warmup_num = stol(value);
+    } else if (key == "--seed") {
+      config.seed = stoull(value);
+    } else if (key == "--format") {
+      config.format = value;
+    } else if (key == "--tag") {
+      config.tag = value;
+    } else if (key == "--aging") {
+      auto comma = value.find(',');
+      config.aging_period = stol(value.substr(0, comma));
+      if (comma != string::npos) {
+        config.aging_shift = stoi(value.substr(comma + 1));
+      }
+    } else {
+      print_usage();
+      throw runtime_error("Error: unknown option " + key);
+    }
+  }
+  if (config.format != "csv" && config.format != "jsonl") {
+    throw runtime_error("Error: unknown format " + config.format);
+  }
+  return config;
+}
+
+int main(int argc, char** argv) {
+  auto config = parse_args(argc, argv);
+  print_header(config);
+  for (auto const& workload : config.workloads) {
+    long id_range = config.id_range;
+    if (workload == "trace") {
+      id_range = TraceWorkload(config.trace_path).id_range();
+    }
+    for (auto batch_size : config.batch_sizes) {
+      auto batches = make_batches(config, workload, batch_size);
+      for (auto capacity : config.capacities) {
+        if (batch_size > capacity) {  // a batch must fit in the cache
+          cerr << "skip batch_size " << batch_size << " > capacity " << capacity << endl;
+          continue;
+        }
+        for (auto const& manager : config.managers) {
+          AgingFn aging;
+          auto prepare_ids = make_manager(manager, capacity, id_range, false, nullptr, nullptr,
+                                          nullptr, &aging);
+          if (config.aging_period > 0) {
+            if (!aging) {
+              throw runtime_error("Error: manager " + manager + " has no aging.");
+            }
+            aging(config.aging_period, config.aging_shift);
+          }
+          auto result = run_bench(prepare_ids, config, batches);
+          print_result(config, manager, workload, batch_size, capacity, id_range, result);
+        }
+      }
+    }
+  }
+  return 0;
+}
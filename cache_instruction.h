@@ -0,0 +1,100 @@
+#pragma once
+
+#include <tuple>
+#include <vector>
+
+/*(gpu_idx_vector,
+    admit_cpu_idx_vector,
+    admit_to_cache_idx_vector,
+    evict_cache_idx_vector,
+    evict_to_cpu_idx_vector
+)*/
+template <typename Index>
+using BasicCacheInstruction = std::tuple<std::vector<Index>, std::vector<Index>,
+                                         std::vector<Index>, std::vector<Index>,
+                                         std::vector<Index>>;
+typedef BasicCacheInstruction<long> CacheInstruction;
+
+/*
+    one contiguous copy: rows [src_start, src_start + length) -> [dst_start, dst_start + length).
+*/
+struct CopyRun {
+  long src_start;
+  long dst_start;
+  long length;
+
+  bool operator==(const CopyRun& other) const {
+    return src_start == other.src_start && dst_start == other.dst_start && length == other.length;
+  }
+};
+
+/*
+    caller-owned output of prepare_ids.
+    clear() keeps capacity, so reusing one buffer across batches makes no allocation
+    once it has grown to the batch size.
+    Index is the manager's index type: long, or int32_t for the compact managers, whose
+    index vectors take half the bytes to keep and to copy to the device.
+*/
+template <typename Index>
+struct BasicCacheInstructionBuffer {
+  typedef Index index_type;
+
+  std::vector<Index> gpu_idx_vector;
+  std::vector<Index> admit_cpu_idx_vector;
+  std::vector<Index> admit_to_cache_idx_vector;
+  std::vector<Index> evict_cache_idx_vector;
+  std::vector<Index> evict_to_cpu_idx_vector;
+  // filled only when the manager has set_transfer_plan(true). the same transfers as the
+  // index pairs above, grouped into contiguous runs: admit cpu -> cache, evict cache -> cpu
+  std::vector<CopyRun> admit_run_vector;
+  std::vector<CopyRun> evict_run_vector;
+  // filled only with an admission filter (set_admission_filter): distinct ids rejected by the
+  // filter, served from cpu. their gpu_idx_vector entries are -1
+  std::vector<Index> bypass_cpu_idx_vector;
+
+  void clear() {
+    gpu_idx_vector.clear();
+    admit_cpu_idx_vector.clear();
+    admit_to_cache_idx_vector.clear();
+    evict_cache_idx_vector.clear();
+    evict_to_cpu_idx_vector.clear();
+    admit_run_vector.clear();
+    evict_run_vector.clear();
+    bypass_cpu_idx_vector.clear();
+  }
+
+  void reserve(long batch_size) {
+    gpu_idx_vector.reserve(batch_size);
+    admit_cpu_idx_vector.reserve(batch_size);
+    admit_to_cache_idx_vector.reserve(batch_size);
+    evict_cache_idx_vector.reserve(batch_size);
+    evict_to_cpu_idx_vector.reserve(batch_size);
+  }
+
+  /* copy of other, e.g. a compact manager's output widened to longs */
+  template <typename OtherIndex>
+  void assign(const BasicCacheInstructionBuffer<OtherIndex>& other) {
+    gpu_idx_vector.assign(other.gpu_idx_vector.begin(), other.gpu_idx_vector.end());
+    admit_cpu_idx_vector.assign(other.admit_cpu_idx_vector.begin(),
+                                other.admit_cpu_idx_vector.end());
+    admit_to_cache_idx_vector.assign(other.admit_to_cache_idx_vector.begin(),
+                                     other.admit_to_cache_idx_vector.end());
+    evict_cache_idx_vector.assign(other.evict_cache_idx_vector.begin(),
+                                  other.evict_cache_idx_vector.end());
+    evict_to_cpu_idx_vector.assign(other.evict_to_cpu_idx_vector.begin(),
+                                   other.evict_to_cpu_idx_vector.end());
+    admit_run_vector = other.admit_run_vector;
+    evict_run_vector = other.evict_run_vector;
+    bypass_cpu_idx_vector.assign(other.bypass_cpu_idx_vector.begin(),
+                                 other.bypass_cpu_idx_vector.end());
+  }
+
+  BasicCacheInstruction<Index> to_instruction() && {
+    return BasicCacheInstruction<Index>(
+        std::move(gpu_idx_vector), std::move(admit_cpu_idx_vector),
+        std::move(admit_to_cache_idx_vector), std::move(evict_cache_idx_vector),
+        std::move(evict_to_cpu_idx_vector));
+  }
+};
+
+typedef BasicCacheInstructionBuffer<long> CacheInstructionBuffer;
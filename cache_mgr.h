@@ -1,105 +1,330 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <limits>
 #include <list>
 #include <map>
+#include <memory>
 #include <set>
 #include <stack>
+#include <string>
 #include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
-/*(gpu_idx_vector,
-    admit_cpu_idx_vector,
-    admit_to_cache_idx_vector,
-    evict_cache_idx_vector,
-    evict_to_cpu_idx_vector
-)*/
-typedef std::tuple<std::vector<long>, std::vector<long>, std::vector<long>, std::vector<long>,
-                   std::vector<long>>
-    CacheInstruction;
-
-struct CacheNode {
-  long cpu_idx;
-  long cache_idx;
-  long freq = 1;
+#include "admission_filter.h"
+#include "cache_instruction.h"
+#include "concurrent_index_table.h"
+#include "dense_index_map.h"
+#include "lookahead.h"
+#include "radix_sort.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "transfer_plan.h"
+#include "trace.h"
+
+template <typename Index, typename Count>
+struct BasicCacheNode {
+  Index cpu_idx;
+  Index cache_idx;
+  Count freq = 1;
   bool masked = false;
-  std::list<CacheNode*>::iterator it;
+  typename std::list<BasicCacheNode*>::iterator it;
+  Count epoch = 0;  // aging epoch freq is expressed in
 };
 
-class CacheIndicesManager {
+typedef BasicCacheNode<long, long> CacheNode;
+
+/*
+    Index is the type of cpu and cache indices, in the nodes, the index maps and the output;
+    Count the type of freqs and aging epochs. CacheIndicesManager is the long / long
+    manager, CompactCacheIndicesManager the int32_t / int32_t one: capacity, cpu_row_num and
+    ids below 2^31, freqs saturating at 2^31 - 1, nodes of 32 instead of 48 bytes and half
+    the output bytes.
+*/
+template <typename Index = long, typename Count = long>
+class BasicCacheIndicesManager {
  public:
-  CacheIndicesManager(long cache_capacity) {
+  typedef BasicCacheNode<Index, Count> CacheNode;
+  typedef typename std::list<CacheNode*>::iterator FreqIterator;
+  typedef BasicCacheInstructionBuffer<Index> InstructionBuffer;
+  typedef BasicConcurrentIndexTable<Index> LookupTable;
+
+  // prepare_ids phases timed with LFU_CACHE_PHASE_TIMERS, CacheCounters::phase_ns index
+  enum StatsPhase {
+    kMaskPhase,
+    kLookupAdmitPhase,
+    kUnmaskPhase,
+    kAgePhase,
+    kPlanPhase,
+    kPhaseNum
+  };
+  static const char* stats_phase_name(int phase) {
+    static const char* names[] = {"mask", "lookup_admit", "unmask", "age", "plan"};
+    return phase >= 0 && phase < kPhaseNum ? names[phase] : "";
+  }
+
+  /*
+      cpu_row_num bounds the cpu index space for IndexMapMode::kDense / kPaged,
+      where cpu_idx -> cache_idx becomes an array lookup. kMap ignores it.
+  */
+  BasicCacheIndicesManager(long cache_capacity, long cpu_row_num = 0,
+                           IndexMapMode index_mode = IndexMapMode::kMap)
+      : index_mode_(index_mode),
+        dense_map_(index_mode == IndexMapMode::kMap ? 0 : cpu_row_num,
+                   index_mode == IndexMapMode::kPaged) {
+    if (cache_capacity > std::numeric_limits<Index>::max() ||
+        cpu_row_num > std::numeric_limits<Index>::max()) {
+      throw std::runtime_error("Error: capacity or cpu row num exceeds the index type.");
+    }
     cache_capacity_ = cache_capacity;
+    nodes_.resize(cache_capacity_);
+    masked_node_.reserve(cache_capacity_);
     init_state();
   }
 
-  CacheInstruction prepare_ids(std::vector<long> cpu_idx_vector) {
+  BasicCacheInstruction<Index> prepare_ids(const std::vector<Index>& cpu_idx_vector) {
+    InstructionBuffer out;
+    out.reserve(cpu_idx_vector.size());
+    prepare_ids(cpu_idx_vector.data(), cpu_idx_vector.size(), out);
+    return std::move(out).to_instruction();
+  }
+
+  std::tuple<long, long> prepare_ids(const Index* cpu_idx_ptr, long n, InstructionBuffer& out) {
     /*
-        cpu_idx_vector(input)    --cache_map-->  gpu_idx_vector
+        cpu_idx_ptr[0, n)(input) --cache_map-->  gpu_idx_vector
         admit_cpu_idx_vector     ----swap--->    admit_to_cache_idx_vector
         evict_to_cpu_idx_vector  <---swap---     evict_cache_idx_vector
 
-        return (gpu_idx_vector,
-                admit_cpu_idx_vector,
-                admit_to_cache_idx_vector,
-                evict_cache_idx_vector,
-                evict_to_cpu_idx_vector
-            )
+        out is cleared and refilled. return (admit_num, evict_num)
+        ids rejected by the admission filter get gpu idx -1, see set_admission_filter.
     */
-    std::vector<long> gpu_idx_vector, admit_cpu_idx_vector, admit_to_cache_idx_vector,
-        evict_cache_idx_vector, evict_to_cpu_idx_vector;
-    /* step 1. scan over cpu_idx_vector.
+    wait_reclaim();
+    out.clear();
+    /* validate the whole batch first, a throw in step 2 would leave nodes masked */
+    if (index_mode_ != IndexMapMode::kMap) {
+      dense_map_.check_range(cpu_idx_ptr, n);
+    }
+    if (lookup_table_) {
+      lookup_table_->check_range(cpu_idx_ptr, n);
+    }
+    if (trace_writer_) {
+      trace_writer_->append(cpu_idx_ptr, n);
+    }
+    LFU_STATS(stats_.begin_batch());
+    /* step 1. scan over cpu_idx_ptr.
                 mask already-cached CacheNode.
     */
-    std::unordered_set<CacheNode*> masked_node;  // record for faster de-mask
-    for (auto cpu_idx : cpu_idx_vector) {
-      auto cache_it = cpu_cache_map_.find(cpu_idx);
-      if (cache_it != cpu_cache_map_.end()) {
-        masked_node.insert(&cache_it->second);
-        cache_it->second.masked = true;
+    for (long i = 0; i < n; i++) {
+      if (admission_filter_) {
+        tiny_lfu_.record(cpu_idx_ptr[i]);
+      }
+      auto node_ptr = find_node(cpu_idx_ptr[i]);
+      if (node_ptr != nullptr && !node_ptr->masked) {
+        masked_node_.push_back(node_ptr);
+        node_ptr->masked = true;
       }
     }
-    /* step 2. cache op for each in cpu_idx_vector.
+    LFU_STATS_PHASE(stats_, kMaskPhase);
+    /* step 2. cache op for each in cpu_idx_ptr.
                 prevent masked CacheNode from being evicted.
                 mask new admit CacheNode.
                 update swap vectors.
     */
     tail_node_it_ = freq_list_.begin();
-    for (auto cpu_idx : cpu_idx_vector) {
+    lookahead_tail_it_ = freq_list_.end();
+    for (long i = 0; i < n; i++) {
+      auto cpu_idx = cpu_idx_ptr[i];
       auto cache_idx = get_cache_idx(cpu_idx);
       if (cache_idx != -1) {
-        gpu_idx_vector.push_back(cache_idx);
+        out.gpu_idx_vector.push_back(cache_idx);
         continue;
       }
       // check available rows
       if (available_cache_idxs_.empty()) {
+        if (admission_filter_ && !admit_or_bypass(cpu_idx, out)) {
+          out.gpu_idx_vector.push_back(-1);
+          LFU_STATS(stats_.batch().bypass_num++);
+          continue;
+        }
         // evict
         auto evict_info = evict_cache();
-        evict_cache_idx_vector.push_back(std::get<0>(evict_info));
-        evict_to_cpu_idx_vector.push_back(std::get<1>(evict_info));
+        out.evict_cache_idx_vector.push_back(std::get<0>(evict_info));
+        out.evict_to_cpu_idx_vector.push_back(std::get<1>(evict_info));
       }
       // admit
       auto new_node_ptr = admit_cache(cpu_idx);
       cache_idx = new_node_ptr->cache_idx;
       new_node_ptr->masked = true;
-      masked_node.insert(new_node_ptr);
-      admit_cpu_idx_vector.push_back(cpu_idx);
-      admit_to_cache_idx_vector.push_back(cache_idx);
-      gpu_idx_vector.push_back(cache_idx);
+      masked_node_.push_back(new_node_ptr);
+      out.admit_cpu_idx_vector.push_back(cpu_idx);
+      out.admit_to_cache_idx_vector.push_back(cache_idx);
+      out.gpu_idx_vector.push_back(cache_idx);
     }
+    LFU_STATS_PHASE(stats_, kLookupAdmitPhase);
+    LFU_STATS(stats_.batch().unique_num = masked_node_.size());
     /* step 3. unmask */
-    for (auto node_ptr : masked_node) {
+    for (auto node_ptr : masked_node_) {
       node_ptr->masked = false;
     }
-    return CacheInstruction(gpu_idx_vector, admit_cpu_idx_vector, admit_to_cache_idx_vector,
-                            evict_cache_idx_vector, evict_to_cpu_idx_vector);
+    masked_node_.clear();
+    bypass_set_.clear();
+    LFU_STATS_PHASE(stats_, kUnmaskPhase);
+    /* step 4. incremental aging */
+    age_step();
+    LFU_STATS_PHASE(stats_, kAgePhase);
+    /* step 5. transfer plan */
+    if (transfer_plan_) {
+      match_admitted_slots(out);
+      transfer_planner_.plan(out);
+    }
+    LFU_STATS_PHASE(stats_, kPlanPhase);
+#if LFU_CACHE_STATS
+    auto& batch = stats_.batch();
+    batch.lookup_num = n;
+    batch.admit_num = out.admit_cpu_idx_vector.size();
+    batch.miss_num = batch.admit_num + batch.bypass_num;
+    batch.hit_num = n - batch.miss_num;
+    batch.evict_num = out.evict_cache_idx_vector.size();
+    stats_.end_batch();
+#endif
+    if (lookup_table_ && !lookup_deferred_) {
+      lookup_table_->publish(out);
+    }
+    return std::tuple<long, long>(out.admit_cpu_idx_vector.size(),
+                                  out.evict_cache_idx_vector.size());
+  }
+
+  /*
+      transfer planning. when enabled, the rows admitted by a batch are matched to its cpu
+      indices by TransferPlanner::match_slots, so consecutive ids land in consecutive rows,
+      and out.admit_run_vector / evict_run_vector group the transfers into contiguous copies.
+      off by default: it changes which row an id is admitted to, not hits or victims.
+  */
+  void set_transfer_plan(bool enabled) {
+    wait_reclaim();
+    transfer_plan_ = enabled;
+    slot_remap_.assign(enabled ? cache_capacity_ : 0, -1);
+  }
+
+  /*
+      TinyLFU admission (admission_filter.h). once the cache is full, a missed id is admitted
+      only if its recent frequency estimate beats the LFU victim's; otherwise it keeps no
+      row, gets gpu idx -1 and is listed once in out.bypass_cpu_idx_vector to be served from
+      cpu. the sketch records every input id and halves its counters every
+      sample_factor * capacity ids. off by default.
+  */
+  void set_admission_filter(bool enabled, long sample_factor = 10) {
+    wait_reclaim();
+    admission_filter_ = enabled;
+    tiny_lfu_ = TinyLfuFilter(enabled ? cache_capacity_ : 0, sample_factor);
+  }
+
+  /*
+      freq aging: every period_batches batches all freqs are shifted right by shift.
+      fully aged nodes reach freq 0 and are evicted before new nodes.
+      the pass walks the list from the front, ceil(capacity / period_batches) nodes per
+      prepare_ids call, so no call pays O(capacity). nodes missed by a pass are shifted by every
+      epoch they missed once reached. an aged node moves back to the end of the group of its new
+      freq; if that group doesn't exist it keeps at least its predecessor's freq, so the list
+      stays sorted without searching for a position.
+      period_batches <= 0 disables aging.
+  */
+  void set_aging(long period_batches, int shift = 1) {
+    wait_reclaim();
+    aging_period_ = period_batches;
+    aging_shift_ = std::max(shift, 1);
+    aging_batch_count_ = 0;
+  }
+
+  /*
+      register upcoming batches. while a row is referenced by the window it is skipped by
+      eviction, and only evicted (in LFU order) when nothing else is left.
+      typical step t: pop_lookahead() (batch t is now current), push_lookahead(batch t + k),
+      prepare_ids(batch t).
+  */
+  void push_lookahead(const Index* cpu_idx_ptr, long n) {
+    wait_reclaim();
+    lookahead_.push(cpu_idx_ptr, n);
+  }
+  void push_lookahead(const std::vector<Index>& cpu_idx_vector) {
+    push_lookahead(cpu_idx_vector.data(), cpu_idx_vector.size());
+  }
+  void pop_lookahead() {
+    wait_reclaim();
+    lookahead_.pop();
+  }
+  void clear_lookahead() {
+    wait_reclaim();
+    lookahead_.clear();
+  }
+  long lookahead_size() const { return lookahead_.size(); }
+
+  /*
+      record every prepare_ids input to writer (not owned), nullptr stops recording.
+      replay the trace with TraceReader.
+  */
+  void set_trace_writer(TraceWriter* writer) {
+    wait_reclaim();
+    trace_writer_ = writer;
+  }
+
+  /*
+      lock-free cpu_idx -> cache_idx lookups for other threads, ids in [0, cpu_row_num); see
+      ConcurrentIndexTable. the table gets every batch of prepare_ids and resize, and is
+      rebuilt by init_state, warm_up and load_state, so readers see the mapping before or after
+      each of them. with deferred, prepare_ids and resize leave publishing to
+      publish_lookup(out), e.g. once the data plane has applied out. ids passed to prepare_ids
+      must then lie in [0, cpu_row_num). cpu_row_num <= 0 disables it.
+  */
+  void enable_concurrent_lookup(long cpu_row_num, bool deferred = false) {
+    wait_reclaim();
+    lookup_table_ =
+        cpu_row_num > 0 ? std::make_unique<LookupTable>(cpu_row_num) : nullptr;
+    lookup_deferred_ = deferred;
+    republish_lookup();
+  }
+
+  /* the table for reader threads, nullptr unless enabled */
+  const LookupTable* concurrent_lookup() const { return lookup_table_.get(); }
+
+  /* deferred mode: publish the batch out came from */
+  void publish_lookup(const InstructionBuffer& out) {
+    wait_reclaim();
+    if (lookup_table_) {
+      lookup_table_->publish(out);
+    }
+  }
+
+  /*
+      cumulative and last-batch counters plus the current freq histogram. safe to poll from any
+      thread: the manager publishes a consistent copy at the end of each prepare_ids.
+      returns zeros when built with LFU_CACHE_STATS=0.
+  */
+  CacheStats stats() const {
+#if LFU_CACHE_STATS
+    return stats_.snapshot();
+#else
+    return CacheStats();
+#endif
+  }
+
+  /* restart the cumulative counters. the histogram reflects state and is kept */
+  void reset_stats() {
+#if LFU_CACHE_STATS
+    stats_.reset();
+#endif
   }
 
   void init_state() {
+    wait_reclaim();
     cpu_cache_map_.clear();
+    dense_map_.clear();
     freq_list_.clear();
     freq_entry_.clear();
     while (!available_cache_idxs_.empty()) {
@@ -109,37 +334,488 @@ class CacheIndicesManager {
       available_cache_idxs_.push(i);
     }
     tail_node_it_ = freq_list_.end();
+    lookahead_tail_it_ = freq_list_.end();
+    aging_cursor_it_ = freq_list_.end();
+    aging_batch_count_ = 0;
+    tiny_lfu_.clear();
+    LFU_STATS(stats_.clear_rows());
+    LFU_STATS(stats_.publish());
+    republish_lookup();
+  }
+
+  /*
+      change the capacity between batches, keeping every row's freq and position in the list.
+      growing adds the new rows to the free-row stack. shrinking drops rows
+      [new_capacity, capacity): the rows cached there move to free rows below new_capacity,
+      hottest first, and the rest are evicted. out gets the moves as evict + admit pairs
+      (cache row -> cpu -> new cache row) and the evictions as evict pairs, so a data plane
+      applies it like a batch; gpu_idx_vector stays empty. return (moved_num, evicted_num).
+      the work is proportional to the rows added or dropped plus the free rows; node storage
+      grows geometrically, and relinking the list on reallocation amortizes the same way.
+  */
+  std::tuple<long, long> resize(long new_capacity, InstructionBuffer& out) {
+    if (new_capacity <= 0 || new_capacity > std::numeric_limits<Index>::max()) {
+      throw std::runtime_error("Error: invalid cache capacity.");
+    }
+    wait_reclaim();
+    if (new_capacity < reclaim_high_) {
+      throw std::runtime_error("Error: reclaim watermark exceeds the new capacity.");
+    }
+    out.clear();
+    auto old_capacity = cache_capacity_;
+    if (new_capacity >= old_capacity) {
+      if (new_capacity > (long)nodes_.capacity()) {
+        // the reallocation moves every node, repoint the list at the new storage
+        std::vector<long> list_rows;
+        list_rows.reserve(freq_list_.size());
+        for (auto node_ptr : freq_list_) {
+          list_rows.push_back(node_ptr->cache_idx);
+        }
+        nodes_.reserve(std::max(new_capacity, 2 * (long)nodes_.capacity()));
+        auto row_it = list_rows.begin();
+        for (auto& node_ptr : freq_list_) {
+          node_ptr = &nodes_[*row_it++];
+        }
+      }
+      nodes_.resize(new_capacity);
+      for (long i = new_capacity - 1; i >= old_capacity; i--) {
+        available_cache_idxs_.push(i);
+      }
+    } else {
+      /* step 1. keep the free rows below new_capacity, mark the dropped free rows */
+      std::vector<long> kept_free, dropped_free(old_capacity - new_capacity, 0);
+      for (; !available_cache_idxs_.empty(); available_cache_idxs_.pop()) {
+        auto cache_idx = available_cache_idxs_.top();
+        if (cache_idx < new_capacity) {
+          kept_free.push_back(cache_idx);
+        } else {
+          dropped_free[cache_idx - new_capacity] = 1;
+        }
+      }
+      /* step 2. cached rows being dropped, hottest first */
+      std::vector<CacheNode*> dropped_nodes;
+      for (long i = new_capacity; i < old_capacity; i++) {
+        if (!dropped_free[i - new_capacity]) {
+          dropped_nodes.push_back(&nodes_[i]);
+        }
+      }
+      std::stable_sort(dropped_nodes.begin(), dropped_nodes.end(),
+                       [](const CacheNode* a, const CacheNode* b) { return a->freq > b->freq; });
+      /* step 3. move them into the kept free rows in stack order, evict the ones left over */
+      size_t free_it = 0;
+      for (auto node_ptr : dropped_nodes) {
+        out.evict_cache_idx_vector.push_back(node_ptr->cache_idx);
+        out.evict_to_cpu_idx_vector.push_back(node_ptr->cpu_idx);
+        if (free_it == kept_free.size()) {
+          erase_node(node_ptr->it);
+          continue;
+        }
+        auto cache_idx = kept_free[free_it++];
+        nodes_[cache_idx] = *node_ptr;
+        nodes_[cache_idx].cache_idx = cache_idx;
+        *nodes_[cache_idx].it = &nodes_[cache_idx];
+        map_insert(node_ptr->cpu_idx, cache_idx);
+        out.admit_cpu_idx_vector.push_back(node_ptr->cpu_idx);
+        out.admit_to_cache_idx_vector.push_back(cache_idx);
+      }
+      for (auto i = kept_free.size(); i > free_it; i--) {
+        available_cache_idxs_.push(kept_free[i - 1]);
+      }
+      nodes_.resize(new_capacity);
+    }
+    cache_capacity_ = new_capacity;
+    if (transfer_plan_) {
+      slot_remap_.assign(cache_capacity_, -1);
+      transfer_planner_.plan(out);
+    }
+    LFU_STATS(stats_.publish());
+    if (lookup_table_ && !lookup_deferred_) {
+      lookup_table_->publish(out);
+    }
+    return std::tuple<long, long>(out.admit_cpu_idx_vector.size(),
+                                  out.evict_cache_idx_vector.size() -
+                                      out.admit_cpu_idx_vector.size());
+  }
+
+  long capacity() const { return cache_capacity_; }
+
+  /*
+      proactive eviction. with a watermark set, reclaim(out) evicts LFU rows between batches
+      when fewer than low rows are free, until high rows are free, so the next prepare_ids
+      admits into free rows instead of walking the list for victims. rows the lookahead
+      window needs are not reclaimed. out gets the write backs as evict pairs
+      (gpu_idx_vector stays empty); apply them before the admits of the next batch, which
+      may reuse the rows. return (0, evicted_num). an admitted id takes a free row without
+      the admission filter's test. high = 0 disables it.
+      resize below high throws, lower the watermark first.
+      reclaim_async(out) runs the same on a background thread, to overlap it with device
+      compute; wait_reclaim() joins it and returns its result. until then out and the
+      manager belong to that thread: every other call that reads or changes the cache
+      state waits for it first, stats() and concurrent lookups keep working.
+  */
+  void set_reclaim_watermark(long low, long high) {
+    if (low < 0 || high < low || high > cache_capacity_) {
+      throw std::runtime_error("Error: invalid reclaim watermark.");
+    }
+    wait_reclaim();
+    reclaim_low_ = low;
+    reclaim_high_ = high;
+  }
+
+  std::tuple<long, long> reclaim(InstructionBuffer& out) {
+    wait_reclaim();
+    return run_reclaim(out);
+  }
+
+  void reclaim_async(InstructionBuffer& out) {
+    wait_reclaim();
+    pending_reclaim_ = std::async(std::launch::async, [this, &out] { return run_reclaim(out); });
+  }
+
+  std::tuple<long, long> wait_reclaim() const {
+    if (!pending_reclaim_.valid()) {
+      return std::tuple<long, long>(0, 0);
+    }
+    return pending_reclaim_.get();
+  }
+
+  /*
+      bulk warm-up from historical access counts: reset the state, then cache the capacity ids
+      with the highest counts, each with freq = its count, as if it had been requested that
+      many times. ids with count <= 0 are skipped, ids must be distinct.
+      the ids are selected in linear time and radix sorted by count, so the freq list and its
+      entries are built by appends in one pass. out gets the admits (cpu -> cache) for the
+      data plane to prefill, gpu_idx_vector stays empty. return (admit_num, 0).
+  */
+  std::tuple<long, long> warm_up(const Index* cpu_idx_ptr, const long* count_ptr, long n,
+                                 InstructionBuffer& out) {
+    wait_reclaim();
+    out.clear();
+    init_state();
+    radix_sorter_.select_top(count_ptr, cpu_idx_ptr, n, cache_capacity_, warm_pair_vector_);
+    long warm_num = warm_pair_vector_.size();
+    if (index_mode_ == IndexMapMode::kMap) {
+      cpu_cache_map_.reserve(warm_num);
+    }
+    out.admit_cpu_idx_vector.reserve(warm_num);
+    out.admit_to_cache_idx_vector.reserve(warm_num);
+    for (long i = 0; i < warm_num; i++) {
+      auto freq = saturate(warm_pair_vector_[i].first);
+      auto cpu_idx = static_cast<Index>(warm_pair_vector_[i].second);
+      if (index_mode_ != IndexMapMode::kMap && i + kWarmUpPrefetch < warm_num) {
+        dense_map_.prefetch(warm_pair_vector_[i + kWarmUpPrefetch].second);
+      }
+      if (find_node(cpu_idx) != nullptr) {
+        init_state();
+        throw std::runtime_error("Error: duplicate cpu idx in warm up.");
+      }
+      if (index_mode_ != IndexMapMode::kMap && !dense_map_.in_range(cpu_idx)) {
+        init_state();
+        throw std::runtime_error("Error: cpu idx out of cpu row num.");
+      }
+      auto cache_idx = available_cache_idxs_.top();
+      available_cache_idxs_.pop();
+      map_insert(cpu_idx, cache_idx);
+      auto freq_it = freq_list_.insert(freq_list_.end(), &nodes_[cache_idx]);
+      nodes_[cache_idx] = {cpu_idx, static_cast<Index>(cache_idx), freq, false, freq_it,
+                           static_cast<Count>(aging_epoch_)};
+      if (i + 1 == warm_num || saturate(warm_pair_vector_[i + 1].first) != freq) {
+        freq_entry_[freq] = freq_it;
+      }
+      LFU_STATS(stats_.add_row(freq, 1));
+      out.admit_cpu_idx_vector.push_back(cpu_idx);
+      out.admit_to_cache_idx_vector.push_back(cache_idx);
+    }
+    if (transfer_plan_) {
+      transfer_planner_.plan(out);
+    }
+    LFU_STATS(stats_.publish());
+    republish_lookup();
+    return std::tuple<long, long>(out.admit_cpu_idx_vector.size(), 0);
+  }
+
+  /*
+      snapshot sections, in list (freq) order: cache_idx, cpu_idx, freq, epoch of each cached
+      row; then the free-slot stack from bottom to top.
+      the lookahead window and aging config are not part of the state.
+  */
+  void save_state(const std::string& path) const {
+    wait_reclaim();
+    auto header = snapshot_format::make_header(snapshot_format::kCacheIndicesManager);
+    long row_num = freq_list_.size();
+    std::vector<long> sections(4 * row_num);
+    long row = 0;
+    header.aging_cursor = row_num;
+    for (auto freq_it = freq_list_.begin(); freq_it != freq_list_.end(); freq_it++, row++) {
+      if (freq_it == aging_cursor_it_) {
+        header.aging_cursor = row;
+      }
+      sections[row] = (*freq_it)->cache_idx;
+      sections[row_num + row] = (*freq_it)->cpu_idx;
+      sections[2 * row_num + row] = (*freq_it)->freq;
+      sections[3 * row_num + row] = (*freq_it)->epoch;
+    }
+    std::vector<long> free_stack;
+    for (auto stack_copy = available_cache_idxs_; !stack_copy.empty(); stack_copy.pop()) {
+      free_stack.push_back(stack_copy.top());
+    }
+    std::reverse(free_stack.begin(), free_stack.end());
+    header.capacity = cache_capacity_;
+    header.row_num = row_num;
+    header.free_num = free_stack.size();
+    header.aging_epoch = aging_epoch_;
+    header.aging_pass_epoch = aging_pass_epoch_;
+    header.aging_batch_count = aging_batch_count_;
+    SnapshotWriter writer(path);
+    writer.write_header(header);
+    writer.write_section(sections.data(), sections.size());
+    writer.write_section(free_stack.data(), free_stack.size());
+    writer.close();
+  }
+
+  /*
+      restore a save_state snapshot in O(capacity): the list is rebuilt in saved order, so
+      freq groups and their entries fall out of one pass. capacity must match, the index mode
+      may differ. every section is checked before the state changes, so a corrupt snapshot
+      throws and leaves the manager as it was.
+  */
+  void load_state(const std::string& path) {
+    wait_reclaim();
+    SnapshotReader reader(path, snapshot_format::kCacheIndicesManager);
+    auto const& header = reader.header();
+    if (header.capacity != cache_capacity_ || header.row_num < 0 || header.free_num < 0 ||
+        header.row_num + header.free_num != cache_capacity_) {
+      throw std::runtime_error("Error: snapshot capacity mismatch.");
+    }
+    auto cache_idx_ptr = reader.section(header.row_num);
+    auto cpu_idx_ptr = reader.section(header.row_num);
+    auto freq_ptr = reader.section(header.row_num);
+    auto epoch_ptr = reader.section(header.row_num);
+    auto free_ptr = reader.section(header.free_num);
+    check_state(header.row_num, cache_idx_ptr, cpu_idx_ptr, freq_ptr, epoch_ptr, free_ptr);
+    init_state();
+    if (index_mode_ == IndexMapMode::kMap) {
+      cpu_cache_map_.reserve(header.row_num);
+    }
+    for (long row = 0; row < header.row_num; row++) {
+      auto cache_idx = cache_idx_ptr[row];
+      auto freq_it = freq_list_.insert(freq_list_.end(), &nodes_[cache_idx]);
+      nodes_[cache_idx] = {static_cast<Index>(cpu_idx_ptr[row]), static_cast<Index>(cache_idx),
+                           static_cast<Count>(freq_ptr[row]), false, freq_it,
+                           static_cast<Count>(epoch_ptr[row])};
+      map_insert(cpu_idx_ptr[row], cache_idx);
+      LFU_STATS(stats_.add_row(freq_ptr[row], 1));
+      if (row + 1 == header.row_num || freq_ptr[row + 1] != freq_ptr[row]) {
+        freq_entry_[freq_ptr[row]] = freq_it;
+      }
+      if (row == header.aging_cursor) {
+        aging_cursor_it_ = freq_it;
+      }
+    }
+    available_cache_idxs_ =
+        std::stack<Index>(std::deque<Index>(free_ptr, free_ptr + header.free_num));
+    aging_epoch_ = header.aging_epoch;
+    aging_pass_epoch_ = header.aging_pass_epoch;
+    aging_batch_count_ = header.aging_batch_count;
+    LFU_STATS(stats_.publish());
+    republish_lookup();
   }
 
  private:
   long cache_capacity_ = 0;
-  // cpu_idx -> CacheNode
-  std::unordered_map<long, CacheNode> /*                 */ cpu_cache_map_;
+  IndexMapMode index_mode_;
+  // cache_idx -> CacheNode
+  std::vector<CacheNode> /*                              */ nodes_;
+  // cpu_idx -> cache_idx, kMap
+  std::unordered_map<Index, Index> /*                    */ cpu_cache_map_;
+  // cpu_idx -> cache_idx, kDense / kPaged
+  BasicDenseIndexMap<Index> /*                           */ dense_map_;
   // FreqNodes sorted by freq
   std::list<CacheNode*> /*                               */ freq_list_;
   // freq -> the last freq_list_ iterator holding that freq
-  std::unordered_map<long, std::list<CacheNode*>::iterator> freq_entry_;
+  std::unordered_map<Count, FreqIterator> /*             */ freq_entry_;
   //
-  std::stack<long> /*                                    */ available_cache_idxs_;
+  std::stack<Index> /*                                   */ available_cache_idxs_;
   // unmasked LFU node
-  std::list<CacheNode*>::iterator /*                     */ tail_node_it_;
+  FreqIterator /*                                        */ tail_node_it_;
+  // masked nodes of the running batch, kept for faster de-mask
+  std::vector<CacheNode*> /*                             */ masked_node_;
+  // upcoming batches, protected from eviction
+  LookaheadWindow /*                                     */ lookahead_;
+  // prepare_ids input recorder, not owned
+  TraceWriter* /*                                        */ trace_writer_ = nullptr;
+  // unmasked LFU node among those protected by lookahead_, used once tail_node_it_ runs out
+  FreqIterator /*                                        */ lookahead_tail_it_;
+  // aging config and the next node of the running aging pass
+  long aging_period_ = 0;
+  int aging_shift_ = 1;
+  long aging_batch_count_ = 0;
+  long aging_epoch_ = 0;
+  long aging_pass_epoch_ = 0;
+  FreqIterator /*                                        */ aging_cursor_it_;
+#if LFU_CACHE_STATS
+  CacheStatsRecorder /*                                  */ stats_;
+#endif
+  // transfer planning, see set_transfer_plan
+  bool /*                                                */ transfer_plan_ = false;
+  TransferPlanner /*                                     */ transfer_planner_;
+  std::vector<Index> /*                                  */ slot_remap_;  // old -> new row
+  std::vector<std::pair<Index, Index>> /*                */ admit_pair_vector_;
+  std::vector<CacheNode> /*                              */ admit_node_vector_;
+  // admission filter, see set_admission_filter
+  bool /*                                                */ admission_filter_ = false;
+  TinyLfuFilter /*                                       */ tiny_lfu_;
+  BatchIdSet /*                                          */ bypass_set_;  // rejected this batch
+  // warm_up scratch, (count, cpu_idx)
+  static const long kWarmUpPrefetch = 16;  // ids ahead whose index entry is prefetched
+  RadixSorter /*                                         */ radix_sorter_;
+  std::vector<RadixSorter::Pair> /*                      */ warm_pair_vector_;
+  // reader-side mapping, see enable_concurrent_lookup
+  std::unique_ptr<LookupTable> /*                        */ lookup_table_;
+  bool /*                                                */ lookup_deferred_ = false;
+  std::vector<Index> /*                                  */ lookup_cpu_idx_vector_;
+  std::vector<Index> /*                                  */ lookup_cache_idx_vector_;
+  // free-row watermark, see set_reclaim_watermark
+  long reclaim_low_ = 0;
+  long reclaim_high_ = 0;
+  // running reclaim_async. declared last: destroying it joins the thread first
+  mutable std::future<std::tuple<long, long>> /*         */ pending_reclaim_;
+
+  std::tuple<long, long> run_reclaim(InstructionBuffer& out) {
+    out.clear();
+    if (reclaim_high_ <= 0 || (long)available_cache_idxs_.size() >= reclaim_low_) {
+      return std::tuple<long, long>(0, 0);
+    }
+    /* no row is masked between batches, the walk only passes over lookahead rows */
+    auto freq_it = freq_list_.begin();
+    while (freq_it != freq_list_.end() && (long)available_cache_idxs_.size() < reclaim_high_) {
+      if (lookahead_.contains((*freq_it)->cpu_idx)) {
+        freq_it++;
+        continue;
+      }
+      auto evict_info = erase_node(freq_it++);
+      available_cache_idxs_.push(std::get<0>(evict_info));
+      out.evict_cache_idx_vector.push_back(std::get<0>(evict_info));
+      out.evict_to_cpu_idx_vector.push_back(std::get<1>(evict_info));
+    }
+    if (transfer_plan_) {
+      transfer_planner_.plan(out);
+    }
+    LFU_STATS(stats_.add_reclaim(out.evict_cache_idx_vector.size()));
+    if (lookup_table_ && !lookup_deferred_) {
+      lookup_table_->publish(out);
+    }
+    return std::tuple<long, long>(0, out.evict_cache_idx_vector.size());
+  }
+
+  /*
+      load_state's checks: the cached rows and the free stack together hold every cache row
+      once, cpu indices are distinct and fit the index, freqs ascend and fit Count.
+  */
+  void check_state(long row_num, const long* cache_idx_ptr, const long* cpu_idx_ptr,
+                   const long* freq_ptr, const long* epoch_ptr, const long* free_ptr) const {
+    std::vector<char> row_seen(cache_capacity_, 0);
+    auto take_row = [&](long cache_idx) {
+      if (cache_idx < 0 || cache_idx >= cache_capacity_ || row_seen[cache_idx]) {
+        throw std::runtime_error("Error: corrupt snapshot.");
+      }
+      row_seen[cache_idx] = 1;
+    };
+    for (long row = 0; row < row_num; row++) {
+      take_row(cache_idx_ptr[row]);
+      auto cpu_idx = cpu_idx_ptr[row];
+      if (cpu_idx < std::numeric_limits<Index>::min() ||
+          cpu_idx > std::numeric_limits<Index>::max() ||
+          (index_mode_ != IndexMapMode::kMap && !dense_map_.in_range(cpu_idx)) ||
+          freq_ptr[row] < 0 || freq_ptr[row] > std::numeric_limits<Count>::max() ||
+          (row > 0 && freq_ptr[row] < freq_ptr[row - 1]) || epoch_ptr[row] < 0 ||
+          epoch_ptr[row] > std::numeric_limits<Count>::max()) {
+        throw std::runtime_error("Error: corrupt snapshot.");
+      }
+    }
+    for (long i = 0; i < cache_capacity_ - row_num; i++) {
+      take_row(free_ptr[i]);
+    }
+    std::vector<long> cpu_idx_vector(cpu_idx_ptr, cpu_idx_ptr + row_num);
+    std::sort(cpu_idx_vector.begin(), cpu_idx_vector.end());
+    if (std::adjacent_find(cpu_idx_vector.begin(), cpu_idx_vector.end()) != cpu_idx_vector.end()) {
+      throw std::runtime_error("Error: corrupt snapshot.");
+    }
+  }
+
+  /* warm-up counts saturate at the largest Count, as touch_cache does */
+  static Count saturate(long count) {
+    return static_cast<Count>(std::min<long>(count, std::numeric_limits<Count>::max()));
+  }
+
+  /* rebuild the reader table from the cached nodes */
+  void republish_lookup() {
+    if (!lookup_table_) {
+      return;
+    }
+    lookup_cpu_idx_vector_.clear();
+    lookup_cache_idx_vector_.clear();
+    for (auto node_ptr : freq_list_) {
+      lookup_cpu_idx_vector_.push_back(node_ptr->cpu_idx);
+      lookup_cache_idx_vector_.push_back(node_ptr->cache_idx);
+    }
+    lookup_table_->assign(lookup_cpu_idx_vector_.data(), lookup_cache_idx_vector_.data(),
+                          lookup_cpu_idx_vector_.size());
+  }
 
   long get_cache_idx(long cpu_idx) {
     /*
     get cache idx from a cpu idx request.
     if cache idx is not ready, return -1.
     */
-    auto cache_node_it = cpu_cache_map_.find(cpu_idx);
-    if (cache_node_it == cpu_cache_map_.cend()) {
+    auto node_ptr = find_node(cpu_idx);
+    if (node_ptr == nullptr) {
       return -1;
     }
-    touch_cache(cache_node_it->second);
-    return cache_node_it->second.cache_idx;
+    touch_cache(*node_ptr);
+    return node_ptr->cache_idx;
+  }
+
+  CacheNode* find_node(long cpu_idx) {
+    long cache_idx;
+    if (index_mode_ == IndexMapMode::kMap) {
+      auto cache_it = cpu_cache_map_.find(cpu_idx);
+      if (cache_it == cpu_cache_map_.end()) {
+        return nullptr;
+      }
+      cache_idx = cache_it->second;
+    } else {
+      cache_idx = dense_map_.find(cpu_idx);
+      if (cache_idx == -1) {
+        return nullptr;
+      }
+    }
+    return &nodes_[cache_idx];
+  }
+
+  void map_insert(long cpu_idx, long cache_idx) {
+    if (index_mode_ == IndexMapMode::kMap) {
+      cpu_cache_map_[cpu_idx] = cache_idx;
+    } else {
+      dense_map_.insert(cpu_idx, cache_idx);
+    }
+  }
+
+  void map_erase(long cpu_idx) {
+    if (index_mode_ == IndexMapMode::kMap) {
+      cpu_cache_map_.erase(cpu_idx);
+    } else {
+      dense_map_.erase(cpu_idx);
+    }
   }
 
   void touch_cache(CacheNode& cache_node) {
+    if (cache_node.freq == std::numeric_limits<Count>::max()) {
+      return;  // saturated
+    }
     auto old_freq = cache_node.freq;
     auto new_freq = ++cache_node.freq;
+    LFU_STATS(stats_.move_row(old_freq, new_freq));
     auto freq_it = cache_node.it;
     if (freq_entry_.find(new_freq) == freq_entry_.end()) {
       // add new freq entry
@@ -159,6 +835,12 @@ class CacheIndicesManager {
       auto const& freq_it2 = std::next(freq_entry_[(*std::next(freq_it))->freq]);
       if (freq_it == tail_node_it_){
         tail_node_it_ = std::next(freq_it);
+      }
+      if (freq_it == lookahead_tail_it_) {
+        lookahead_tail_it_ = std::next(freq_it);
+      }
+      if (freq_it == aging_cursor_it_) {
+        aging_cursor_it_ = std::next(freq_it);
       }
         // swap trick
         freq_list_.splice(freq_it2, freq_list_, freq_it);
@@ -167,45 +849,218 @@ class CacheIndicesManager {
 
   CacheNode* admit_cache(long cpu_idx) { /* add cpu_idx to cache new_node. return new_node_ptr */
     auto cache_idx = available_cache_idxs_.top();
+    map_insert(cpu_idx, cache_idx);
     available_cache_idxs_.pop();
-    freq_list_.push_front(NULL);
-    cpu_cache_map_[cpu_idx] = {cpu_idx, cache_idx, 1, false, freq_list_.begin()};
-    auto const& new_node_ptr = &cpu_cache_map_[cpu_idx];
-    *(freq_list_.begin()) = new_node_ptr;
+    auto new_it = freq_list_.begin();
+    if (aging_epoch_ > 0) {
+      // fully aged nodes hold freq 0 and stay in front of new nodes
+      auto zero_entry = freq_entry_.find(0);
+      if (zero_entry != freq_entry_.end()) {
+        new_it = std::next(zero_entry->second);
+      }
+    }
+    new_it = freq_list_.insert(new_it, NULL);
+    nodes_[cache_idx] = {static_cast<Index>(cpu_idx), cache_idx, 1, false, new_it,
+                         static_cast<Count>(aging_epoch_)};
+    auto const& new_node_ptr = &nodes_[cache_idx];
+    *new_it = new_node_ptr;
     if (freq_entry_.find(1) == freq_entry_.end()) {
-      freq_entry_[1] = freq_list_.begin();
+      freq_entry_[1] = new_it;
     }
+    LFU_STATS(stats_.add_row(1, 1));
     return new_node_ptr;
   }
 
   std::tuple<long, long> evict_cache() {
     /* evict tail node. return (evict_gpu_idx, evict_to_cpu_idx) */
     update_tail_node_upward();
-    if (tail_node_it_ == freq_list_.end()) {
-      throw std::runtime_error("Error: no enough cache row num.");
-    }
-    auto to_delete_freq_it = tail_node_it_++;
-    auto evict_gpu_idx = (*to_delete_freq_it)->cache_idx;
-    auto evict_to_cpu_idx = (*to_delete_freq_it)->cpu_idx;
-    auto freq = (*to_delete_freq_it)->freq;
-    cpu_cache_map_.erase(evict_to_cpu_idx);
-    if (freq_entry_[freq] == to_delete_freq_it) {
+    FreqIterator to_delete_freq_it;
+    if (tail_node_it_ != freq_list_.end()) {
+      to_delete_freq_it = tail_node_it_++;
+    } else {
+      // only rows needed by upcoming batches are left. rank them last, evict in LFU order
+      if (lookahead_tail_it_ == freq_list_.end()) {
+        lookahead_tail_it_ = freq_list_.begin();
+      }
+      while (lookahead_tail_it_ != freq_list_.end() && (*lookahead_tail_it_)->masked) {
+        LFU_STATS(stats_.batch().masked_skip_num++);
+        lookahead_tail_it_++;
+      }
+      if (lookahead_tail_it_ == freq_list_.end()) {
+        throw std::runtime_error("Error: no enough cache row num.");
+      }
+      to_delete_freq_it = lookahead_tail_it_++;
+    }
+    auto evict_info = erase_node(to_delete_freq_it);
+    available_cache_idxs_.push(std::get<0>(evict_info));
+    return evict_info;
+  }
+
+  std::tuple<long, long> erase_node(FreqIterator freq_it) {
+    /* drop a node from the list and the map, its row is not freed. return (gpu, cpu) idx */
+    if (freq_it == aging_cursor_it_) {
+      aging_cursor_it_++;
+    }
+    auto evict_gpu_idx = (*freq_it)->cache_idx;
+    auto evict_to_cpu_idx = (*freq_it)->cpu_idx;
+    auto freq = (*freq_it)->freq;
+    map_erase(evict_to_cpu_idx);
+    LFU_STATS(stats_.add_row(freq, -1));
+    if (freq_entry_[freq] == freq_it) {
       // redirect or delete entry
-      if (to_delete_freq_it != freq_list_.begin() &&
-          (*std::prev(to_delete_freq_it))->freq == freq) {
-        freq_entry_[freq] = std::prev(to_delete_freq_it);
+      if (freq_it != freq_list_.begin() && (*std::prev(freq_it))->freq == freq) {
+        freq_entry_[freq] = std::prev(freq_it);
       } else {
         freq_entry_.erase(freq);
       }
     }
-    freq_list_.erase(to_delete_freq_it);
-    available_cache_idxs_.push(evict_gpu_idx);
+    freq_list_.erase(freq_it);
     return std::tuple<long, long>(evict_gpu_idx, evict_to_cpu_idx);
   }
 
+  void age_step() {
+    if (aging_period_ <= 0) {
+      return;
+    }
+    if (++aging_batch_count_ % aging_period_ == 0) {
+      aging_epoch_++;
+    }
+    auto budget = (cache_capacity_ + aging_period_ - 1) / aging_period_;
+    for (; budget > 0; budget--) {
+      if (aging_cursor_it_ == freq_list_.end()) {
+        // a pass ends at the list end, start the next one if an epoch is pending
+        if (aging_pass_epoch_ == aging_epoch_) {
+          break;
+        }
+        aging_pass_epoch_ = aging_epoch_;
+        aging_cursor_it_ = freq_list_.begin();
+      }
+      age_node(aging_cursor_it_++);
+    }
+  }
+
+  void age_node(FreqIterator freq_it) {
+    auto node = *freq_it;
+    if (node->epoch == aging_epoch_) {
+      return;
+    }
+    auto shift = std::min<long>(sizeof(Count) * 8 - 1, aging_shift_ * (aging_epoch_ - node->epoch));
+    node->epoch = aging_epoch_;
+    auto old_freq = node->freq;
+    auto new_freq = old_freq >> shift;
+    if (new_freq == old_freq) {
+      return;
+    }
+    auto new_freq_entry = freq_entry_.find(new_freq);
+    if (new_freq_entry == freq_entry_.end() && new_freq != 0) {
+      /*
+          no group to join. lower freq in place as far as the predecessor allows.
+          then predecessor freq < old_freq, so node is the first of its freq group, and nodes
+          after it hold freqs >= old_freq > new_freq, so it becomes the last of new_freq.
+      */
+      if (freq_it != freq_list_.begin()) {
+        new_freq = std::max(new_freq, (*std::prev(freq_it))->freq);
+      }
+      if (new_freq == old_freq) {
+        return;
+      }
+      if (freq_entry_[old_freq] == freq_it) {
+        freq_entry_.erase(old_freq);
+      }
+      node->freq = new_freq;
+      freq_entry_[new_freq] = freq_it;
+      LFU_STATS(stats_.move_row(old_freq, new_freq));
+      return;
+    }
+    // move node to the end of new_freq group, or to the list front for a new freq 0 group
+    auto dest_it = new_freq_entry != freq_entry_.end() ? std::next(new_freq_entry->second)
+                                                        : freq_list_.begin();
+    if (freq_entry_[old_freq] == freq_it) {
+      // redirect or delete entry
+      if (freq_it != freq_list_.begin() && (*std::prev(freq_it))->freq == old_freq) {
+        freq_entry_[old_freq] = std::prev(freq_it);
+      } else {
+        freq_entry_.erase(old_freq);
+      }
+    }
+    freq_list_.splice(dest_it, freq_list_, freq_it);
+    node->freq = new_freq;
+    freq_entry_[new_freq] = freq_it;
+    LFU_STATS(stats_.move_row(old_freq, new_freq));
+  }
+
+  void match_admitted_slots(InstructionBuffer& out) {
+    /* move the batch's admitted nodes to the rows TransferPlanner::match_slots picks */
+    auto& admit_cpu_idx_vector = out.admit_cpu_idx_vector;
+    auto& admit_to_cache_idx_vector = out.admit_to_cache_idx_vector;
+    long admit_num = admit_cpu_idx_vector.size();
+    if (admit_num < 2) {
+      return;
+    }
+    admit_pair_vector_.clear();
+    for (long i = 0; i < admit_num; i++) {
+      admit_pair_vector_.emplace_back(admit_cpu_idx_vector[i], admit_to_cache_idx_vector[i]);
+    }
+    std::sort(admit_pair_vector_.begin(), admit_pair_vector_.end());
+    for (long i = 0; i < admit_num; i++) {
+      admit_cpu_idx_vector[i] = admit_pair_vector_[i].first;
+    }
+    auto const& slots =
+        transfer_planner_.match_slots(admit_cpu_idx_vector, admit_to_cache_idx_vector);
+    // copy first, the new rows of some nodes are the old rows of others
+    admit_node_vector_.clear();
+    for (auto const& admit_pair : admit_pair_vector_) {
+      admit_node_vector_.push_back(nodes_[admit_pair.second]);
+    }
+    for (long k = 0; k < admit_num; k++) {
+      auto cache_idx = slots[k];
+      slot_remap_[admit_pair_vector_[k].second] = cache_idx;
+      nodes_[cache_idx] = admit_node_vector_[k];
+      nodes_[cache_idx].cache_idx = cache_idx;
+      *nodes_[cache_idx].it = &nodes_[cache_idx];
+      map_insert(admit_pair_vector_[k].first, cache_idx);
+      admit_to_cache_idx_vector[k] = cache_idx;
+    }
+    for (auto& gpu_idx : out.gpu_idx_vector) {
+      if (gpu_idx != -1 && slot_remap_[gpu_idx] != -1) {
+        gpu_idx = slot_remap_[gpu_idx];
+      }
+    }
+    for (auto const& admit_pair : admit_pair_vector_) {
+      slot_remap_[admit_pair.second] = -1;
+    }
+  }
+
+  /*
+      the admission test against the LFU victim. a rejected id is added to the bypass output
+      once and stays rejected for the rest of the batch. with only lookahead-protected rows
+      left there is no plain victim to compare with, the id is admitted.
+  */
+  bool admit_or_bypass(long cpu_idx, InstructionBuffer& out) {
+    if (bypass_set_.contains(cpu_idx)) {
+      return false;
+    }
+    update_tail_node_upward();
+    if (tail_node_it_ == freq_list_.end() || tiny_lfu_.admit(cpu_idx, (*tail_node_it_)->cpu_idx)) {
+      return true;
+    }
+    bypass_set_.insert(cpu_idx);
+    out.bypass_cpu_idx_vector.push_back(cpu_idx);
+    return false;
+  }
+
   void update_tail_node_upward() {
-    while (tail_node_it_ != freq_list_.end() && (*tail_node_it_)->masked) {
-      tail_node_it_++;
+    for (; tail_node_it_ != freq_list_.end(); tail_node_it_++) {
+      if ((*tail_node_it_)->masked) {
+        LFU_STATS(stats_.batch().masked_skip_num++);
+      } else if (lookahead_.contains((*tail_node_it_)->cpu_idx)) {
+        LFU_STATS(stats_.batch().lookahead_skip_num++);
+      } else {
+        break;
+      }
     }
   }
-};
\ No newline at end of file
+};
+
+typedef BasicCacheIndicesManager<> CacheIndicesManager;
+typedef BasicCacheIndicesManager<int32_t, int32_t> CompactCacheIndicesManager;
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "cache_instruction.h"
+
+/*
+    cpu_idx -> cache_idx for reader threads, ids in [0, cpu_row_num), -1 when not cached.
+    one writer, the thread calling prepare_ids, applies each batch's evicts and admits under a
+    seqlock with relaxed atomics, the way CacheStatsRecorder publishes its counters. find and
+    find_batch take no lock and no atomic read-modify-write: they load the sequence, the
+    slots, then the sequence again, and retry when a publish overlapped. so a reader sees
+    the mapping before or after a whole batch, never a mix, and never slows the writer.
+    a slot is an Index, the manager's cache index type, so the int32_t managers keep 4 bytes
+    per cpu row; readers get long either way.
+*/
+template <typename Index = long>
+class BasicConcurrentIndexTable {
+ public:
+  explicit BasicConcurrentIndexTable(long cpu_row_num)
+      : cpu_row_num_(cpu_row_num), table_(new std::atomic<Index>[cpu_row_num]) {
+    if (cpu_row_num <= 0) {
+      throw std::runtime_error("Error: invalid cpu row num.");
+    }
+    for (long i = 0; i < cpu_row_num_; i++) {
+      table_[i].store(-1, std::memory_order_relaxed);
+    }
+  }
+
+  BasicConcurrentIndexTable(const BasicConcurrentIndexTable&) = delete;
+  BasicConcurrentIndexTable& operator=(const BasicConcurrentIndexTable&) = delete;
+
+  long cpu_row_num() const { return cpu_row_num_; }
+
+  /* writer. throws before touching the table if an id is out of range */
+  template <typename Id>
+  void check_range(const Id* cpu_idx_ptr, long n) const {
+    for (long i = 0; i < n; i++) {
+      if (cpu_idx_ptr[i] < 0 || cpu_idx_ptr[i] >= cpu_row_num_) {
+        throw std::runtime_error("Error: cpu idx out of cpu row num.");
+      }
+    }
+  }
+
+  /* writer: one batch, evicts before admits, so a moved row (evict + admit) stays mapped */
+  void publish(const BasicCacheInstructionBuffer<Index>& out) {
+    begin_write();
+    for (auto cpu_idx : out.evict_to_cpu_idx_vector) {
+      table_[cpu_idx].store(-1, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < out.admit_cpu_idx_vector.size(); i++) {
+      table_[out.admit_cpu_idx_vector[i]].store(out.admit_to_cache_idx_vector[i],
+                                                std::memory_order_relaxed);
+    }
+    end_write();
+  }
+
+  /* writer: replace the whole mapping by n (cpu_idx, cache_idx) pairs, O(cpu_row_num) */
+  void assign(const Index* cpu_idx_ptr, const Index* cache_idx_ptr, long n) {
+    check_range(cpu_idx_ptr, n);
+    begin_write();
+    for (long i = 0; i < cpu_row_num_; i++) {
+      table_[i].store(-1, std::memory_order_relaxed);
+    }
+    for (long i = 0; i < n; i++) {
+      table_[cpu_idx_ptr[i]].store(cache_idx_ptr[i], std::memory_order_relaxed);
+    }
+    end_write();
+  }
+
+  /* any thread. ids out of range read as -1 */
+  long find(long cpu_idx) const {
+    long cache_idx;
+    find_batch(&cpu_idx, 1, &cache_idx);
+    return cache_idx;
+  }
+
+  /* any thread: cache_idx_ptr[0, n) from one published mapping. return its version */
+  long find_batch(const long* cpu_idx_ptr, long n, long* cache_idx_ptr) const {
+    while (true) {
+      auto seq = seq_.load(std::memory_order_acquire);
+      if (seq & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      for (long i = 0; i < n; i++) {
+        auto cpu_idx = cpu_idx_ptr[i];
+        cache_idx_ptr[i] = cpu_idx >= 0 && cpu_idx < cpu_row_num_
+                               ? table_[cpu_idx].load(std::memory_order_relaxed)
+                               : -1;
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == seq) {
+        return seq / 2;
+      }
+    }
+  }
+
+  /* mappings published so far (publish and assign calls), any thread */
+  long version() const { return seq_.load(std::memory_order_acquire) / 2; }
+
+ private:
+  long cpu_row_num_;
+  std::unique_ptr<std::atomic<Index>[]> table_;
+  std::atomic<long> seq_{0};
+
+  void begin_write() {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void end_write() {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+};
+
+typedef BasicConcurrentIndexTable<> ConcurrentIndexTable;
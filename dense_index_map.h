@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+/*
+    how a manager maps cpu_idx -> cache_idx.
+    kMap:   the manager's node-based container, any non-negative cpu_idx.
+    kDense: DenseIndexMap with one flat array of cpu_row_num entries.
+    kPaged: DenseIndexMap with pages allocated on first use, for sparse or huge ranges.
+*/
+enum class IndexMapMode { kMap, kDense, kPaged };
+
+/*
+    cpu_idx -> cache_idx over a bounded cpu index space [0, cpu_row_num).
+    every lookup is one (flat) or two (paged) indexed loads. -1 marks an absent entry.
+    pages are kept once allocated, so steady state makes no allocation.
+    entries are stored as Value, int32_t in the compact managers.
+*/
+template <typename Value>
+class BasicDenseIndexMap {
+ public:
+  static const long kPageBits = 12;
+  static const long kPageSize = 1L << kPageBits;
+
+  BasicDenseIndexMap(long cpu_row_num = 0, bool paged = false) : cpu_row_num_(cpu_row_num) {
+    if (paged) {
+      pages_.resize((cpu_row_num + kPageSize - 1) >> kPageBits);
+    } else {
+      flat_.assign(cpu_row_num, -1);
+    }
+    paged_ = paged;
+  }
+
+  long find(long cpu_idx) const {
+    if (cpu_idx < 0 || cpu_idx >= cpu_row_num_) {
+      return -1;
+    }
+    if (!paged_) {
+      return flat_[cpu_idx];
+    }
+    auto const& page = pages_[cpu_idx >> kPageBits];
+    return page ? page[cpu_idx & (kPageSize - 1)] : -1;
+  }
+
+  bool in_range(long cpu_idx) const { return cpu_idx >= 0 && cpu_idx < cpu_row_num_; }
+
+  /* throw if any of cpu_idx_ptr[0, n) is outside [0, cpu_row_num), before a batch changes state */
+  template <typename Index>
+  void check_range(const Index* cpu_idx_ptr, long n) const {
+    for (long i = 0; i < n; i++) {
+      if (!in_range(cpu_idx_ptr[i])) {
+        throw std::runtime_error("Error: cpu idx out of cpu row num.");
+      }
+    }
+  }
+
+  /* hint a coming find / insert of cpu_idx, for loops over many random ids */
+  void prefetch(long cpu_idx) const {
+    if (cpu_idx < 0 || cpu_idx >= cpu_row_num_) {
+      return;
+    }
+    if (!paged_) {
+      __builtin_prefetch(flat_.data() + cpu_idx, 1);
+    } else if (auto const& page = pages_[cpu_idx >> kPageBits]) {
+      __builtin_prefetch(page.get() + (cpu_idx & (kPageSize - 1)), 1);
+    }
+  }
+
+  void insert(long cpu_idx, long cache_idx) {
+    if (cpu_idx < 0 || cpu_idx >= cpu_row_num_) {
+      throw std::runtime_error("Error: cpu idx out of cpu row num.");
+    }
+    if (!paged_) {
+      flat_[cpu_idx] = cache_idx;
+      return;
+    }
+    auto& page = pages_[cpu_idx >> kPageBits];
+    if (!page) {
+      page.reset(new Value[kPageSize]);
+      std::fill(page.get(), page.get() + kPageSize, -1);
+    }
+    page[cpu_idx & (kPageSize - 1)] = cache_idx;
+  }
+
+  void erase(long cpu_idx) {
+    if (cpu_idx < 0 || cpu_idx >= cpu_row_num_) {
+      return;
+    }
+    if (!paged_) {
+      flat_[cpu_idx] = -1;
+      return;
+    }
+    auto& page = pages_[cpu_idx >> kPageBits];
+    if (page) {
+      page[cpu_idx & (kPageSize - 1)] = -1;
+    }
+  }
+
+  void clear() {
+    std::fill(flat_.begin(), flat_.end(), -1);
+    for (auto& page : pages_) {
+      if (page) {
+        std::fill(page.get(), page.get() + kPageSize, -1);
+      }
+    }
+  }
+
+  long memory_bytes() const {
+    long bytes = flat_.capacity() * sizeof(Value) + pages_.capacity() * sizeof(pages_[0]);
+    for (auto const& page : pages_) {
+      bytes += page ? kPageSize * sizeof(Value) : 0;
+    }
+    return bytes;
+  }
+
+ private:
+  long cpu_row_num_;
+  bool paged_;
+  std::vector<Value> flat_;
+  std::vector<std::unique_ptr<Value[]>> pages_;
+};
+
+typedef BasicDenseIndexMap<long> DenseIndexMap;
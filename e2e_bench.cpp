@@ -0,0 +1,294 @@
+// end-to-end step: prepare_ids, then RowMover applies the instruction to real float rows and
+// gathers the batch. reports rows/s for the whole step and, with --verify 1, checks every
+// gathered row against an oracle of what the id's row must hold.
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "manager_factory.h"
+#include "row_mover.h"
+#include "workload.h"
+
+using namespace std;
+
+struct E2EConfig {
+  vector<string> managers = {"cim", "flat", "sort_select"};
+  string workload = "zipf";
+  long batch_num = 100;
+  long batch_size = 8192;
+  long capacity = 65536;
+  long id_range = 262144;
+  long row_width = 32;
+  long thread_num = 1;
+  bool transfer_plan = false;
+  bool verify = false;
+  long resize_period = 0;  // batches between capacity / 2 <-> capacity resizes, 0 = off
+  bool warm_up = false;    // warm up from the id counts of the whole run before batch 0
+  long reclaim_low = 0;    // free-row watermark reclaimed after every batch, 0 = off
+  long reclaim_high = 0;
+  bool reclaim_async = false;
+  long aging_period = 0;  // batches between aging epochs, 0 = off
+  int aging_shift = 1;  // reclaim on a background thread while the batch "computes"
+  double skew = 1.0;
+  uint64_t seed = 7;
+};
+
+void print_usage() {
+  cerr << "usage: e2e_bench [--managers cim,flat,...] [--workload uniform|zipf|shift]\n"
+          "                 [--batches N] [--batch-size N] [--capacity N] [--id-range N]\n"
+          "                 [--width FLOATS] [--threads N] [--plan 0|1] [--verify 0|1]\n"
+          "                 [--skew S] [--seed N] [--resize BATCHES] [--warm-up 0|1]\n"
+          "                 [--reclaim LOW,HIGH] [--reclaim-async 0|1] [--aging PERIOD[,SHIFT]]\n";
+}
+
+E2EConfig parse_args(int argc, char** argv) {
+  E2EConfig config;
+  for (int i = 1; i < argc; i++) {
+    string key = argv[i];
+    if (key == "--help" || key == "-h") {
+      print_usage();
+      exit(0);
+    }
+    if (i + 1 >= argc) {
+      print_usage();
+      throw runtime_error("Error: missing value for " + key);
+    }
+    string value = argv[++i];
+    if (key == "--managers") {
+      config.managers.clear();
+      stringstream ss(value);
+      string item;
+      while (getline(ss, item, ',')) {
+        config.managers.push_back(item);
+      }
+    } else if (key == "--workload") {
+      config.workload = value;
+    } else if (key == "--batches") {
+      config.batch_num = stol(value);
+    } else if (key == "--batch-size") {
+      config.batch_size = stol(value);
+    } else if (key == "--capacity") {
+      config.capacity = stol(value);
+    } else if (key == "--id-range") {
+      config.id_range = stol(value);
+    } else if (key == "--width") {
+      config.row_width = stol(value);
+    } else if (key == "--threads") {
+      config.thread_num = stol(value);
+    } else if (key == "--plan") {
+      config.transfer_plan = stol(value) != 0;
+    } else if (key == "--verify") {
+      config.verify = stol(value) != 0;
+    } else if (key == "--skew") {
+      config.skew = stod(value);
+    } else if (key == "--seed") {
+      config.seed = stoull(value);
+    } else if (key == "--resize") {
+      config.resize_period = stol(value);
+    } else if (key == "--warm-up") {
+      config.warm_up = stol(value) != 0;
+    } else if (key == "--reclaim") {
+      auto comma = value.find(',');
+      if (comma == string::npos) {
+        throw runtime_error("Error: --reclaim takes LOW,HIGH");
+      }
+      config.reclaim_low = stol(value.substr(0, comma));
+      config.reclaim_high = stol(value.substr(comma + 1));
+    } else if (key == "--reclaim-async") {
+      config.reclaim_async = stol(value) != 0;
+    } else if (key == "--aging") {
+      auto comma = value.find(',');
+      config.aging_period = stol(value.substr(0, comma));
+      if (comma != string::npos) {
+        config.aging_shift = stoi(value.substr(comma + 1));
+      }
+    } else {
+      print_usage();
+      throw runtime_error("Error: unknown option " + key);
+    }
+  }
+  // the oracle stores ids and counts in floats
+  if (config.verify && (config.id_range > (1L << 24) || config.batch_num * config.batch_size +
+                                                                config.row_width >
+                                                            (1L << 24))) {
+    throw runtime_error("Error: --verify needs ids and update counts below 2^24.");
+  }
+  return config;
+}
+
+vector<vector<long>> make_batches(const E2EConfig& config) {
+  function<void(long*, long)> next_batch;
+  if (config.workload == "uniform") {
+    auto gen = make_shared<UniformWorkload>(config.id_range, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "zipf") {
+    auto gen = make_shared<ZipfWorkload>(config.id_range, config.skew, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "shift") {
+    auto gen = make_shared<ShiftingHotSetWorkload>(config.id_range, 8192, 0.8, 10, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else {
+    throw runtime_error("Error: unknown workload " + config.workload);
+  }
+  vector<vector<long>> batches(config.batch_num, vector<long>(config.batch_size));
+  for (auto& batch : batches) {
+    next_batch(batch.data(), batch.size());
+  }
+  return batches;
+}
+
+/*
+    oracle: backing row id starts as (id, 1, 2, ..., width - 1). after each gather the
+    "training" step adds 1 to columns 1.. of every gathered row, so row id must read
+    (id, 1 + k, ..., width - 1 + k) when id was gathered k times before. a wrong load, a
+    missing write back or a stale row all break it. bypassed ids are trained in place on
+    their backing row.
+*/
+long verify_batch(RowMover& mover, const vector<long>& batch, const CacheInstructionBuffer& out,
+                  const vector<float>& batch_rows, vector<long>& update_count) {
+  long error_num = 0;
+  long width = mover.row_width();
+  for (size_t i = 0; i < batch.size(); i++) {
+    auto row = batch_rows.data() + i * width;
+    bool ok = row[0] == float(batch[i]);
+    for (long c = 1; c < width && ok; c++) {
+      ok = row[c] == float(c + update_count[batch[i]]);
+    }
+    error_num += !ok;
+  }
+  for (size_t i = 0; i < batch.size(); i++) {
+    auto gpu_idx = out.gpu_idx_vector[i];
+    auto row = gpu_idx != -1 ? mover.cache_row(gpu_idx) : mover.backing_row(batch[i]);
+    for (long c = 1; c < width; c++) {
+      row[c] += 1.0f;
+    }
+    update_count[batch[i]]++;
+  }
+  return error_num;
+}
+
+int main(int argc, char** argv) {
+  auto config = parse_args(argc, argv);
+  auto batches = make_batches(config);
+  cout << "manager,width,threads,plan,batch_num,id_num,prepare_s,apply_s,gather_s,rows_moved,"
+          "ids_per_s,move_gb_per_s,hit_rate,errors"
+       << endl;
+  long total_error_num = 0;
+  for (auto const& name : config.managers) {
+    // with --resize the manager starts at half the capacity, the first resize grows it
+    long capacity = config.resize_period > 0 ? config.capacity / 2 : config.capacity;
+    ResizeFn resize;
+    WarmUpFn warm_up;
+    ReclaimFn reclaim;
+    AgingFn aging;
+    auto prepare_ids = make_manager(name, capacity, config.id_range, config.transfer_plan,
+                                    &resize, &warm_up, &reclaim, &aging);
+    if (config.resize_period > 0 && !resize) {
+      throw runtime_error("Error: manager " + name + " cannot resize.");
+    }
+    if (config.warm_up && !warm_up) {
+      throw runtime_error("Error: manager " + name + " cannot warm up.");
+    }
+    if (config.reclaim_high > 0 && !reclaim) {
+      throw runtime_error("Error: manager " + name + " cannot reclaim.");
+    }
+    if (config.aging_period > 0) {
+      if (!aging) {
+        throw runtime_error("Error: manager " + name + " has no aging.");
+      }
+      aging(config.aging_period, config.aging_shift);
+    }
+    RowMover mover(config.id_range, config.capacity, config.row_width, config.thread_num);
+    for (long id = 0; id < config.id_range; id++) {
+      auto row = mover.backing_row(id);
+      row[0] = float(id);
+      for (long c = 1; c < config.row_width; c++) {
+        row[c] = float(c);
+      }
+    }
+    vector<long> update_count(config.verify ? config.id_range : 0);
+    vector<float> batch_rows(config.batch_size * config.row_width);
+    CacheInstructionBuffer out, reclaim_out;
+    out.reserve(config.batch_size);
+    if (config.reclaim_high > 0) {
+      reclaim.set_watermark(config.reclaim_low, config.reclaim_high);
+    }
+    double prepare_s = 0.0, apply_s = 0.0, gather_s = 0.0;
+    long id_num = 0, miss_num = 0, row_num = 0, error_num = 0;
+    if (config.warm_up) {
+      // "yesterday's" counts: the counts of this run, the admits prefill the cache rows
+      vector<long> id_vector(config.id_range), count_vector(config.id_range);
+      for (long id = 0; id < config.id_range; id++) {
+        id_vector[id] = id;
+      }
+      for (auto const& batch : batches) {
+        for (auto id : batch) {
+          count_vector[id]++;
+        }
+      }
+      warm_up(id_vector.data(), count_vector.data(), config.id_range, out);
+      row_num += mover.apply(out);
+    }
+    for (size_t b = 0; b < batches.size(); b++) {
+      auto const& batch = batches[b];
+      auto start = chrono::steady_clock::now();
+      if (config.reclaim_async && config.reclaim_high > 0) {
+        // the write backs of the previous batch's reclaim land before this batch's admits
+        reclaim.wait_reclaim();
+        row_num += mover.apply(reclaim_out);
+      }
+      if (config.resize_period > 0 && b > 0 && b % config.resize_period == 0) {
+        // the mover keeps config.capacity cache rows, enough for either size
+        capacity = capacity == config.capacity ? config.capacity / 2 : config.capacity;
+        resize(capacity, out);
+        row_num += mover.apply(out);
+      }
+      miss_num += get<0>(prepare_ids(batch.data(), batch.size(), out));
+      auto prepared = chrono::steady_clock::now();
+      row_num += mover.apply(out);
+      auto applied = chrono::steady_clock::now();
+      mover.gather(out.gpu_idx_vector, batch_rows.data(), batch.data());
+      auto gathered = chrono::steady_clock::now();
+      prepare_s += chrono::duration<double>(prepared - start).count();
+      apply_s += chrono::duration<double>(applied - prepared).count();
+      gather_s += chrono::duration<double>(gathered - applied).count();
+      id_num += batch.size();
+      // ids bypassed by an admission filter
+      miss_num += count(out.gpu_idx_vector.begin(), out.gpu_idx_vector.end(), -1L);
+      if (config.verify) {
+        error_num += verify_batch(mover, batch, out, batch_rows, update_count);
+      }
+      if (config.reclaim_high > 0) {
+        // between batches, where a device would be computing. timed as prepare work
+        auto reclaim_start = chrono::steady_clock::now();
+        if (config.reclaim_async) {
+          reclaim.reclaim_async(reclaim_out);
+        } else {
+          reclaim.reclaim(reclaim_out);
+          row_num += mover.apply(reclaim_out);
+        }
+        prepare_s += chrono::duration<double>(chrono::steady_clock::now() - reclaim_start).count();
+      }
+    }
+    if (config.reclaim_async && config.reclaim_high > 0) {
+      reclaim.wait_reclaim();
+      row_num += mover.apply(reclaim_out);
+    }
+    double step_s = prepare_s + apply_s + gather_s;
+    double moved_bytes = double(row_num + id_num) * config.row_width * sizeof(float);
+    cout << name << "," << config.row_width << "," << mover.thread_num() << ","
+         << config.transfer_plan << "," << batches.size() << "," << id_num << "," << prepare_s
+         << "," << apply_s << "," << gather_s << "," << row_num << ","
+         << (step_s > 0.0 ? id_num / step_s : 0.0) << ","
+         << (apply_s + gather_s > 0.0 ? moved_bytes / (apply_s + gather_s) * 1e-9 : 0.0) << ","
+         << (id_num > 0 ? 1.0 - double(miss_num) / id_num : 0.0) << ","
+         << (config.verify ? to_string(error_num) : string("-")) << endl;
+    total_error_num += error_num;
+  }
+  return total_error_num > 0 ? 1 : 0;
+}
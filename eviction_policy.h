@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "flat_cache_mgr.h"
+
+/*
+    policies for PolicyCacheIndicesManager besides LfuPolicy (flat_cache_mgr.h):
+        PolicyCacheIndicesManager<LruPolicy>    least recently used
+        PolicyCacheIndicesManager<LfuDaPolicy>  LFU with dynamic aging
+        PolicyCacheIndicesManager<ArcPolicy>    adaptive replacement cache
+    a batch's masked slots are never victims; a policy walks past them with a per-batch
+    cursor, so a batch pays for each masked slot once.
+*/
+
+/*
+    intrusive doubly linked lists over slots [0, capacity), front = least recent.
+    list_num disjoint lists share the per-slot arrays. each list has a cursor for victim
+    walks: erase() moves it past the erased slot.
+*/
+class SlotList {
+ public:
+  SlotList(long capacity = 0, long list_num = 1) {
+    prev_.assign(capacity, -1);
+    next_.assign(capacity, -1);
+    list_.assign(capacity, -1);
+    front_.resize(list_num);
+    back_.resize(list_num);
+    cursor_.resize(list_num);
+    size_.resize(list_num);
+    clear();
+  }
+
+  void clear() {
+    std::fill(list_.begin(), list_.end(), -1);
+    std::fill(front_.begin(), front_.end(), -1);
+    std::fill(back_.begin(), back_.end(), -1);
+    std::fill(cursor_.begin(), cursor_.end(), -1);
+    std::fill(size_.begin(), size_.end(), 0);
+  }
+
+  int front(int list = 0) const { return front_[list]; }
+  int next(int slot) const { return next_[slot]; }
+  int list_of(int slot) const { return list_[slot]; }  // -1 if in no list
+  long size(int list = 0) const { return size_[list]; }
+
+  int cursor(int list = 0) const { return cursor_[list]; }
+  void set_cursor(int slot, int list = 0) { cursor_[list] = slot; }
+
+  void push_back(int slot, int list = 0) {
+    list_[slot] = list;
+    prev_[slot] = back_[list];
+    next_[slot] = -1;
+    if (back_[list] != -1) {
+      next_[back_[list]] = slot;
+    } else {
+      front_[list] = slot;
+    }
+    back_[list] = slot;
+    size_[list]++;
+  }
+
+  void erase(int slot) {
+    auto list = list_[slot];
+    if (cursor_[list] == slot) {
+      cursor_[list] = next_[slot];
+    }
+    if (prev_[slot] != -1) {
+      next_[prev_[slot]] = next_[slot];
+    } else {
+      front_[list] = next_[slot];
+    }
+    if (next_[slot] != -1) {
+      prev_[next_[slot]] = prev_[slot];
+    } else {
+      back_[list] = prev_[slot];
+    }
+    prev_[slot] = next_[slot] = list_[slot] = -1;
+    size_[list]--;
+  }
+
+  /* first unmasked slot from the cursor, the cursor stays on it. -1 if none */
+  int first_unmasked(const uint8_t* masked, int list = 0) {
+    auto slot = cursor_[list];
+    while (slot != -1 && masked[slot]) {
+      slot = next_[slot];
+    }
+    cursor_[list] = slot;
+    return slot;
+  }
+
+  long memory_bytes() const {
+    return (prev_.capacity() + next_.capacity() + list_.capacity() + front_.capacity() +
+            back_.capacity() + cursor_.capacity()) *
+               sizeof(int) +
+           size_.capacity() * sizeof(long);
+  }
+
+ private:
+  std::vector<int> prev_;
+  std::vector<int> next_;
+  std::vector<int> list_;
+  std::vector<int> front_;
+  std::vector<int> back_;
+  std::vector<int> cursor_;
+  std::vector<long> size_;
+};
+
+class LruPolicy {
+ public:
+  LruPolicy(long capacity) : list_(capacity) {}
+
+  void clear() { list_.clear(); }
+  void begin_batch() { list_.set_cursor(list_.front()); }
+  void on_admit(int slot, long) { list_.push_back(slot); }
+  void on_evict(int slot, long) { list_.erase(slot); }
+
+  void on_hit(int slot) {
+    list_.erase(slot);
+    list_.push_back(slot);
+  }
+
+  int victim(long, const uint8_t* masked) { return list_.first_unmasked(masked); }
+
+  long memory_bytes() const { return list_.memory_bytes(); }
+
+ private:
+  SlotList list_;
+};
+
+/*
+    LFU with dynamic aging (Arlitt et al.): a slot's key is its hit count plus the key of the
+    last victim at the time it was admitted or hit, so rows that were hot long ago lose to
+    newer ones without a periodic aging pass. equal keys evict the least recently keyed first.
+*/
+class LfuDaPolicy {
+ public:
+  LfuDaPolicy(long capacity) : key_(capacity), freq_(capacity, 0) {}
+
+  void clear() {
+    order_.clear();
+    age_ = 0;
+    stamp_ = 0;
+    cursor_ = order_.end();
+  }
+
+  void begin_batch() { cursor_ = order_.begin(); }
+
+  void on_admit(int slot, long) {
+    freq_[slot] = 1;
+    insert(slot);
+  }
+
+  void on_hit(int slot) {
+    erase(slot);
+    freq_[slot]++;
+    insert(slot);
+  }
+
+  void on_evict(int slot, long) {
+    age_ = std::get<0>(key_[slot]);
+    erase(slot);
+  }
+
+  int victim(long, const uint8_t* masked) {
+    // entries before cursor_ are masked: a batch only inserts masked slots
+    while (cursor_ != order_.end() && masked[std::get<2>(*cursor_)]) {
+      cursor_++;
+    }
+    return cursor_ != order_.end() ? std::get<2>(*cursor_) : -1;
+  }
+
+  long memory_bytes() const {
+    return key_.capacity() * sizeof(Key) + freq_.capacity() * sizeof(long) +
+           order_.size() * (sizeof(Key) + 4 * sizeof(void*));
+  }
+
+ private:
+  typedef std::tuple<long, long, int> Key;  // (freq + age, stamp, slot)
+
+  std::vector<Key> key_;  // slot -> its entry in order_
+  std::vector<long> freq_;
+  std::set<Key> order_;
+  std::set<Key>::iterator cursor_ = order_.end();
+  long age_ = 0;  // key of the last victim
+  long stamp_ = 0;
+
+  void insert(int slot) {
+    key_[slot] = Key(freq_[slot] + age_, stamp_++, slot);
+    order_.insert(key_[slot]);
+  }
+
+  void erase(int slot) {
+    if (cursor_ != order_.end() && std::get<2>(*cursor_) == slot) {
+      cursor_++;
+    }
+    order_.erase(key_[slot]);
+  }
+};
+
+/*
+    ARC (Megiddo and Modha): resident slots sit in T1 (seen once) or T2 (seen again), each in
+    LRU order, and the ids of recent victims in ghost lists B1 / B2. a miss found in B1 grows
+    the target size p of T1, one found in B2 shrinks it; the victim comes from T1 when T1
+    exceeds p, else from T2. if the chosen list holds only masked slots, the other is used.
+    ghosts are trimmed to |T1| + |B1| <= c and |T1| + |T2| + |B1| + |B2| <= 2c.
+*/
+class ArcPolicy {
+ public:
+  ArcPolicy(long capacity) : capacity_(capacity), lists_(capacity, 2) {}
+
+  void clear() {
+    lists_.clear();
+    ghost_[0].clear();
+    ghost_[1].clear();
+    ghost_index_.clear();
+    target_ = 0;
+    adapted_cpu_idx_ = -1;
+  }
+
+  void begin_batch() {
+    lists_.set_cursor(lists_.front(kT1), kT1);
+    lists_.set_cursor(lists_.front(kT2), kT2);
+  }
+
+  void on_hit(int slot) {
+    lists_.erase(slot);
+    lists_.push_back(slot, kT2);
+  }
+
+  int victim(long cpu_idx, const uint8_t* masked) {
+    auto ghost = adapt(cpu_idx);
+    adapted_cpu_idx_ = cpu_idx;
+    long t1_size = lists_.size(kT1);
+    bool from_t1 = t1_size > 0 && (t1_size > target_ || (ghost == kB2 && t1_size == target_));
+    auto slot = lists_.first_unmasked(masked, from_t1 ? kT1 : kT2);
+    if (slot == -1) {
+      slot = lists_.first_unmasked(masked, from_t1 ? kT2 : kT1);
+    }
+    return slot;
+  }
+
+  void on_evict(int slot, long cpu_idx) {
+    auto ghost = lists_.list_of(slot) == kT1 ? kB1 : kB2;
+    lists_.erase(slot);
+    ghost_[ghost].push_back(cpu_idx);
+    ghost_index_[cpu_idx] = std::make_pair(ghost, std::prev(ghost_[ghost].end()));
+  }
+
+  void on_admit(int slot, long cpu_idx) {
+    auto ghost = adapted_cpu_idx_ == cpu_idx ? find_ghost(cpu_idx) : adapt(cpu_idx);
+    adapted_cpu_idx_ = -1;
+    if (ghost != -1) {
+      auto it = ghost_index_.find(cpu_idx);
+      ghost_[ghost].erase(it->second.second);
+      ghost_index_.erase(it);
+      lists_.push_back(slot, kT2);
+    } else {
+      lists_.push_back(slot, kT1);
+    }
+    while (!ghost_[kB1].empty() && lists_.size(kT1) + (long)ghost_[kB1].size() > capacity_) {
+      pop_ghost(kB1);
+    }
+    while (!ghost_[kB2].empty() && lists_.size(kT1) + lists_.size(kT2) +
+                                           (long)(ghost_[kB1].size() + ghost_[kB2].size()) >
+                                       2 * capacity_) {
+      pop_ghost(kB2);
+    }
+  }
+
+  long target() const { return target_; }  // p, the adaptive target size of T1
+
+  long memory_bytes() const {
+    return lists_.memory_bytes() +
+           (ghost_[0].size() + ghost_[1].size()) * (sizeof(long) + 2 * sizeof(void*)) +
+           ghost_index_.size() * (sizeof(long) + sizeof(GhostEntry) + 2 * sizeof(void*));
+  }
+
+ private:
+  static const int kT1 = 0;  // resident lists, in lists_
+  static const int kT2 = 1;
+  static const int kB1 = 0;  // ghost lists, in ghost_
+  static const int kB2 = 1;
+  typedef std::pair<int, std::list<long>::iterator> GhostEntry;
+
+  long capacity_;
+  SlotList lists_;
+  std::list<long> ghost_[2];  // front = least recent
+  std::unordered_map<long, GhostEntry> ghost_index_;
+  long target_ = 0;
+  long adapted_cpu_idx_ = -1;  // victim() already adapted target_ for this id
+
+  int find_ghost(long cpu_idx) const {
+    auto it = ghost_index_.find(cpu_idx);
+    return it != ghost_index_.end() ? it->second.first : -1;
+  }
+
+  /* move target_ on a ghost hit. return the ghost list holding cpu_idx, -1 if none */
+  int adapt(long cpu_idx) {
+    auto ghost = find_ghost(cpu_idx);
+    long b1_size = ghost_[kB1].size();
+    long b2_size = ghost_[kB2].size();
+    if (ghost == kB1) {
+      target_ = std::min(capacity_, target_ + std::max(b2_size / b1_size, 1L));
+    } else if (ghost == kB2) {
+      target_ = std::max(0L, target_ - std::max(b1_size / b2_size, 1L));
+    }
+    return ghost;
+  }
+
+  void pop_ghost(int ghost) {
+    ghost_index_.erase(ghost_[ghost].front());
+    ghost_[ghost].pop_front();
+  }
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cache_instruction.h"
+#include "thread_pool.h"
+
+/*
+    file-backed row table, the cold tier of TieredCacheIndicesManager. row r holds row_width
+    floats at byte offset r * row_width * 4; a new file is sized with ftruncate, so unwritten
+    rows read as zeros.
+    read_runs / write_runs move CopyRuns between the file and a row table in memory whose rows
+    are row_stride floats apart. runs whose file ranges touch are merged into one preadv /
+    pwritev of up to kMaxIovecs rows, so a batch's sorted runs go out as a few large
+    sequential requests. requests are spread over a ThreadPool, which keeps thread_num of them
+    in flight at once.
+*/
+class FileRowStore {
+ public:
+  static const long kMaxIovecs = 1024;  // IOV_MAX on Linux
+
+  FileRowStore(const std::string& path, long row_num, long row_width, long thread_num = 1)
+      : row_num_(row_num), row_width_(row_width), pool_(thread_num) {
+    if (row_num <= 0 || row_width <= 0) {
+      throw std::runtime_error("Error: invalid file tier shape.");
+    }
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      throw std::runtime_error("Error: cannot open file tier " + path);
+    }
+    if (ftruncate(fd_, row_num * row_bytes()) != 0) {
+      close(fd_);
+      throw std::runtime_error("Error: cannot size file tier " + path);
+    }
+  }
+
+  ~FileRowStore() { close(fd_); }
+
+  FileRowStore(const FileRowStore&) = delete;
+  FileRowStore& operator=(const FileRowStore&) = delete;
+
+  long row_num() const { return row_num_; }
+  long row_width() const { return row_width_; }
+  long row_bytes() const { return row_width_ * sizeof(float); }
+
+  /* run: file rows -> table rows. returns the I/O requests issued */
+  long read_runs(const std::vector<CopyRun>& runs, float* table, long row_stride) {
+    return run_io(runs, true, table, row_stride);
+  }
+
+  /* run: table rows -> file rows, runs ordered by file row. returns the I/O requests issued */
+  long write_runs(const std::vector<CopyRun>& runs, const float* table, long row_stride) {
+    return run_io(runs, false, const_cast<float*>(table), row_stride);
+  }
+
+  /* row_num densely packed rows from file row first_row on */
+  void read_rows(long first_row, long row_num, float* rows) {
+    std::vector<CopyRun> runs = {{first_row, 0, row_num}};
+    read_runs(runs, rows, row_width_);
+  }
+
+  void write_rows(long first_row, long row_num, const float* rows) {
+    std::vector<CopyRun> runs = {{0, first_row, row_num}};
+    write_runs(runs, rows, row_width_);
+  }
+
+ private:
+  /* one preadv / pwritev: iovecs [iov_begin, iov_end) at file row file_row */
+  struct IoRequest {
+    long file_row;
+    long iov_begin;
+    long iov_end;
+    long bytes;
+  };
+
+  int fd_ = -1;
+  long row_num_;
+  long row_width_;
+  ThreadPool pool_;
+  std::vector<iovec> iov_vector_;
+  std::vector<IoRequest> request_vector_;
+
+  long run_io(const std::vector<CopyRun>& runs, bool read, float* table, long row_stride) {
+    build_requests(runs, read, table, row_stride);
+    pool_.parallel_for(request_vector_.size(), [&](long r) {
+      auto const& request = request_vector_[r];
+      auto iov = iov_vector_.data() + request.iov_begin;
+      int iov_num = request.iov_end - request.iov_begin;
+      off_t offset = request.file_row * row_bytes();
+      auto done = read ? preadv(fd_, iov, iov_num, offset) : pwritev(fd_, iov, iov_num, offset);
+      if (done != request.bytes) {
+        throw std::runtime_error(read ? "Error: short file tier read."
+                                      : "Error: short file tier write.");
+      }
+    });
+    return request_vector_.size();
+  }
+
+  /* a packed table (row_stride == row_width) takes one iovec per run, else one per row */
+  void build_requests(const std::vector<CopyRun>& runs, bool read, float* table,
+                      long row_stride) {
+    iov_vector_.clear();
+    request_vector_.clear();
+    long end_row = -1;  // file row after the open request
+    for (auto const& run : runs) {
+      auto file_start = read ? run.src_start : run.dst_start;
+      auto table_start = read ? run.dst_start : run.src_start;
+      if (file_start < 0 || file_start + run.length > row_num_) {
+        throw std::runtime_error("Error: row index out of range.");
+      }
+      for (long offset = 0; offset < run.length;) {
+        auto length = row_stride == row_width_ ? run.length - offset : 1;
+        if (request_vector_.empty() || file_start + offset != end_row ||
+            request_vector_.back().iov_end - request_vector_.back().iov_begin >= kMaxIovecs) {
+          long iov_num = iov_vector_.size();
+          request_vector_.push_back({file_start + offset, iov_num, iov_num, 0});
+        }
+        auto& request = request_vector_.back();
+        iov_vector_.push_back({table + (table_start + offset) * row_stride,
+                               static_cast<size_t>(length * row_bytes())});
+        request.iov_end++;
+        request.bytes += length * row_bytes();
+        offset += length;
+        end_row = file_start + offset;
+      }
+    }
+  }
+};
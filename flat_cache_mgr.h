@@ -0,0 +1,414 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "cache_instruction.h"
+#include "trace.h"
+
+/*
+    open addressing (linear probing) map: cpu_idx -> slot.
+    any long is a key. values are slots, so value -1 marks an empty bucket.
+    table size is a power of two >= 2 * capacity, so load factor stays <= 0.5.
+*/
+class FlatHashIndex {
+ public:
+  FlatHashIndex(long capacity = 0) {
+    long table_size = 2;
+    shift_ = 63;
+    while (table_size < 2 * capacity) {
+      table_size <<= 1;
+      shift_--;
+    }
+    mask_ = table_size - 1;
+    keys_.assign(table_size, -1);
+    values_.assign(table_size, -1);
+  }
+
+  int find(long key) const {
+    for (long pos = home(key);; pos = (pos + 1) & mask_) {
+      if (values_[pos] == -1 || keys_[pos] == key) {
+        return values_[pos];
+      }
+    }
+  }
+
+  void insert(long key, int value) { /* key must not exist yet, value >= 0 */
+    auto pos = home(key);
+    while (values_[pos] != -1) {
+      pos = (pos + 1) & mask_;
+    }
+    keys_[pos] = key;
+    values_[pos] = value;
+  }
+
+  void erase(long key) {
+    auto pos = home(key);
+    while (values_[pos] != -1 && keys_[pos] != key) {
+      pos = (pos + 1) & mask_;
+    }
+    if (values_[pos] == -1) {
+      return;
+    }
+    // backward shift deletion, no tombstones
+    auto hole = pos;
+    for (pos = (pos + 1) & mask_; values_[pos] != -1; pos = (pos + 1) & mask_) {
+      auto key_home = home(keys_[pos]);
+      if (((pos - key_home) & mask_) >= ((pos - hole) & mask_)) {
+        keys_[hole] = keys_[pos];
+        values_[hole] = values_[pos];
+        hole = pos;
+      }
+    }
+    values_[hole] = -1;
+  }
+
+  void clear() { std::fill(values_.begin(), values_.end(), -1); }
+
+  long memory_bytes() const {
+    return keys_.capacity() * sizeof(long) + values_.capacity() * sizeof(int);
+  }
+
+ private:
+  std::vector<long> keys_;
+  std::vector<int> values_;
+  long mask_;
+  int shift_;
+
+  long home(long key) const {  // fibonacci hashing
+    return static_cast<long>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> shift_) &
+           mask_;
+  }
+};
+
+/*
+    freq-ordered intrusive list over slots [0, capacity).
+    same order as CacheIndicesManager::freq_list_: ascending freq, a node joining a freq group
+    is placed at the front of that group.
+    each freq group is a bucket holding its last node (the freq_entry_ equivalent) and size.
+    list_num > 1 keeps that many disjoint lists over the same slots, e.g. one per table of a
+    shared pool. a slot joins a list in push_front and belongs to it until erase.
+*/
+class FlatFreqList {
+ public:
+  FlatFreqList(long capacity = 0, long list_num = 1) {
+    prev_.assign(capacity, -1);
+    next_.assign(capacity, -1);
+    freq_.assign(capacity, 0);
+    bucket_.assign(capacity, -1);
+    bucket_last_.assign(capacity + 1, -1);
+    bucket_size_.assign(capacity + 1, 0);
+    free_buckets_.reserve(capacity + 1);
+    head_.resize(list_num);
+    tail_.resize(list_num);
+    if (list_num > 1) {
+      list_.assign(capacity, 0);
+    }
+    clear();
+  }
+
+  void clear() {
+    std::fill(head_.begin(), head_.end(), -1);
+    std::fill(tail_.begin(), tail_.end(), -1);
+    free_buckets_.clear();
+    for (long b = static_cast<long>(bucket_last_.size()) - 1; b >= 0; b--) {
+      free_buckets_.push_back(b);
+    }
+  }
+
+  int head(int list = 0) const { return head_[list]; }
+  int next(int slot) const { return next_[slot]; }
+  long freq(int slot) const { return freq_[slot]; }
+
+  // per-batch eviction cursor
+  int tail(int list = 0) const { return tail_[list]; }
+  void set_tail(int slot, int list = 0) { tail_[list] = slot; }
+
+  void push_front(int slot, int list = 0) { /* new node with freq 1 */
+    auto& head = head_[list];
+    if (!list_.empty()) {
+      list_[slot] = list;
+    }
+    freq_[slot] = 1;
+    prev_[slot] = -1;
+    next_[slot] = head;
+    if (head != -1) {
+      prev_[head] = slot;
+    }
+    if (head != -1 && freq_[head] == 1) {
+      bucket_[slot] = bucket_[head];
+      bucket_size_[bucket_[slot]]++;
+    } else {
+      bucket_[slot] = new_bucket(slot);
+    }
+    head = slot;
+  }
+
+  void touch(int slot) {
+    auto bucket = bucket_[slot];
+    auto last = bucket_last_[bucket];
+    if (last != slot) {
+      // move slot to the end of its freq group
+      auto& tail = tail_[list_of(slot)];
+      if (slot == tail) {
+        tail = next_[slot];
+      }
+      unlink(slot);
+      link_after(last, slot);
+    }
+    leave_bucket(slot);
+    auto new_freq = ++freq_[slot];
+    auto next_slot = next_[slot];
+    if (next_slot != -1 && freq_[next_slot] == new_freq) {
+      bucket_[slot] = bucket_[next_slot];
+      bucket_size_[bucket_[slot]]++;
+    } else {
+      bucket_[slot] = new_bucket(slot);
+    }
+  }
+
+  void erase(int slot) {
+    leave_bucket(slot);
+    unlink(slot);
+  }
+
+  long memory_bytes() const {
+    return (prev_.capacity() + next_.capacity() + bucket_.capacity() + bucket_last_.capacity() +
+            bucket_size_.capacity() + free_buckets_.capacity() + list_.capacity() +
+            head_.capacity() + tail_.capacity()) *
+               sizeof(int) +
+           freq_.capacity() * sizeof(long);
+  }
+
+ private:
+  std::vector<int> prev_;
+  std::vector<int> next_;
+  std::vector<long> freq_;
+  std::vector<int> bucket_;       // slot -> freq group
+  std::vector<int> bucket_last_;  // freq group -> last slot holding that freq
+  std::vector<int> bucket_size_;
+  std::vector<int> free_buckets_;
+  std::vector<int> list_;  // slot -> list, empty for a single list
+  std::vector<int> head_;  // list -> first slot
+  std::vector<int> tail_;  // list -> eviction cursor
+
+  int list_of(int slot) const { return list_.empty() ? 0 : list_[slot]; }
+
+  int new_bucket(int last) {
+    auto bucket = free_buckets_.back();
+    free_buckets_.pop_back();
+    bucket_last_[bucket] = last;
+    bucket_size_[bucket] = 1;
+    return bucket;
+  }
+
+  void leave_bucket(int slot) { /* redirect or delete freq group */
+    auto bucket = bucket_[slot];
+    if (--bucket_size_[bucket] == 0) {
+      free_buckets_.push_back(bucket);
+    } else if (bucket_last_[bucket] == slot) {
+      bucket_last_[bucket] = prev_[slot];
+    }
+    bucket_[slot] = -1;
+  }
+
+  void unlink(int slot) {
+    if (prev_[slot] != -1) {
+      next_[prev_[slot]] = next_[slot];
+    } else {
+      head_[list_of(slot)] = next_[slot];
+    }
+    if (next_[slot] != -1) {
+      prev_[next_[slot]] = prev_[slot];
+    }
+    prev_[slot] = next_[slot] = -1;
+  }
+
+  void link_after(int pos, int slot) {
+    prev_[slot] = pos;
+    next_[slot] = next_[pos];
+    if (next_[pos] != -1) {
+      prev_[next_[pos]] = slot;
+    }
+    next_[pos] = slot;
+  }
+};
+
+/*
+    eviction policy of PolicyCacheIndicesManager. a policy orders the cached slots and picks
+    victims, the manager does the masking, the cpu_idx -> slot map and the instructions.
+    every call is resolved at compile time:
+        Policy(capacity), clear(), memory_bytes()
+        begin_batch()                 before the first lookup of a batch
+        on_hit(slot)                  slot served an id
+        victim(cpu_idx, masked)       an unmasked slot to evict so cpu_idx can be admitted,
+                                      -1 if every slot is masked
+        on_evict(slot, cpu_idx)       after victim(), slot held cpu_idx
+        on_admit(slot, cpu_idx)       slot now holds cpu_idx
+    more policies in eviction_policy.h.
+*/
+
+/* LFU with CacheIndicesManager's order: among equal freqs the latest admitted goes first */
+class LfuPolicy {
+ public:
+  LfuPolicy(long capacity) : freq_list_(capacity) {}
+
+  void clear() { freq_list_.clear(); }
+  void begin_batch() { freq_list_.set_tail(freq_list_.head()); }
+  void on_hit(int slot) { freq_list_.touch(slot); }
+  void on_admit(int slot, long) { freq_list_.push_front(slot); }
+  void on_evict(int slot, long) { freq_list_.erase(slot); }
+
+  int victim(long, const uint8_t* masked) { /* first unmasked node from the batch cursor */
+    auto slot = freq_list_.tail();
+    while (slot != -1 && masked[slot]) {
+      slot = freq_list_.next(slot);
+    }
+    if (slot != -1) {
+      freq_list_.set_tail(freq_list_.next(slot));
+    }
+    return slot;
+  }
+
+  long memory_bytes() const { return freq_list_.memory_bytes(); }
+
+ private:
+  FlatFreqList freq_list_;  // slots sorted by freq
+};
+
+/*
+    same prepare_ids semantics as CacheIndicesManager, but every structure is a preallocated
+    flat array indexed by slot(cache_idx). no heap allocation per batch once the
+    CacheInstructionBuffer passed to prepare_ids has grown to the batch size
+    (with LfuPolicy and LruPolicy; LfuDaPolicy and ArcPolicy allocate tree / ghost nodes).
+    the eviction order comes from Policy, see LfuPolicy.
+*/
+template <typename Policy>
+class PolicyCacheIndicesManager {
+ public:
+  PolicyCacheIndicesManager(long cache_capacity)
+      : cache_capacity_(cache_capacity), index_(cache_capacity), policy_(cache_capacity) {
+    cache_cpu_match_.assign(cache_capacity_, -1);
+    masked_.assign(cache_capacity_, 0);
+    masked_slots_.reserve(cache_capacity_);
+    available_cache_idxs_.reserve(cache_capacity_);
+    init_state();
+  }
+
+  CacheInstruction prepare_ids(const std::vector<long>& cpu_idx_vector) {
+    CacheInstructionBuffer out;
+    out.reserve(cpu_idx_vector.size());
+    prepare_ids(cpu_idx_vector.data(), cpu_idx_vector.size(), out);
+    return std::move(out).to_instruction();
+  }
+
+  std::tuple<long, long> prepare_ids(const long* cpu_idx_ptr, long n, CacheInstructionBuffer& out) {
+    /* out is cleared and refilled. return (admit_num, evict_num) */
+    out.clear();
+    if (trace_writer_) {
+      trace_writer_->append(cpu_idx_ptr, n);
+    }
+    /* step 1. mask already-cached slots */
+    for (long i = 0; i < n; i++) {
+      auto slot = index_.find(cpu_idx_ptr[i]);
+      if (slot != -1 && !masked_[slot]) {
+        masked_[slot] = 1;
+        masked_slots_.push_back(slot);
+      }
+    }
+    /* step 2. cache op for each in cpu_idx_ptr */
+    policy_.begin_batch();
+    for (long i = 0; i < n; i++) {
+      auto cpu_idx = cpu_idx_ptr[i];
+      auto slot = index_.find(cpu_idx);
+      if (slot != -1) {
+        policy_.on_hit(slot);
+        out.gpu_idx_vector.push_back(slot);
+        continue;
+      }
+      if (available_cache_idxs_.empty()) {
+        auto evict_slot = evict_cache(cpu_idx);
+        out.evict_cache_idx_vector.push_back(evict_slot);
+        out.evict_to_cpu_idx_vector.push_back(cache_cpu_match_[evict_slot]);
+        cache_cpu_match_[evict_slot] = -1;
+      }
+      slot = admit_cache(cpu_idx);
+      masked_[slot] = 1;
+      masked_slots_.push_back(slot);
+      out.admit_cpu_idx_vector.push_back(cpu_idx);
+      out.admit_to_cache_idx_vector.push_back(slot);
+      out.gpu_idx_vector.push_back(slot);
+    }
+    /* step 3. unmask */
+    for (auto slot : masked_slots_) {
+      masked_[slot] = 0;
+    }
+    masked_slots_.clear();
+    return std::tuple<long, long>(out.admit_cpu_idx_vector.size(),
+                                  out.evict_cache_idx_vector.size());
+  }
+
+  void init_state() {
+    index_.clear();
+    policy_.clear();
+    std::fill(cache_cpu_match_.begin(), cache_cpu_match_.end(), -1);
+    available_cache_idxs_.clear();
+    for (long i = cache_capacity_ - 1; i >= 0; i--) {
+      available_cache_idxs_.push_back(i);
+    }
+  }
+
+  long memory_bytes() const {
+    return index_.memory_bytes() + policy_.memory_bytes() +
+           cache_cpu_match_.capacity() * sizeof(long) + masked_.capacity() * sizeof(uint8_t) +
+           (masked_slots_.capacity() + available_cache_idxs_.capacity()) * sizeof(int);
+  }
+
+  long row_num() const { return cache_capacity_ - (long)available_cache_idxs_.size(); }
+
+  /* footprint per resident row, so a partly filled cache reports its real cost. 0 if empty */
+  double memory_bytes_per_row() const {
+    return row_num() > 0 ? double(memory_bytes()) / row_num() : 0.0;
+  }
+
+  /*
+      record every prepare_ids input to writer (not owned), nullptr stops recording.
+      replay the trace with TraceReader.
+  */
+  void set_trace_writer(TraceWriter* writer) { trace_writer_ = writer; }
+
+ private:
+  long cache_capacity_ = 0;
+  FlatHashIndex index_;                // cpu_idx -> slot
+  Policy policy_;                      // eviction order
+  std::vector<long> cache_cpu_match_;  // slot -> cpu_idx
+  std::vector<uint8_t> masked_;
+  std::vector<int> masked_slots_;  // record for faster de-mask
+  std::vector<int> available_cache_idxs_;
+  TraceWriter* trace_writer_ = nullptr;  // prepare_ids input recorder, not owned
+
+  int admit_cache(long cpu_idx) {
+    auto slot = available_cache_idxs_.back();
+    available_cache_idxs_.pop_back();
+    cache_cpu_match_[slot] = cpu_idx;
+    index_.insert(cpu_idx, slot);
+    policy_.on_admit(slot, cpu_idx);
+    return slot;
+  }
+
+  int evict_cache(long incoming_cpu_idx) { /* evict the policy's victim. return its slot */
+    auto slot = policy_.victim(incoming_cpu_idx, masked_.data());
+    if (slot == -1) {
+      throw std::runtime_error("Error: no enough cache row num.");
+    }
+    policy_.on_evict(slot, cache_cpu_match_[slot]);
+    index_.erase(cache_cpu_match_[slot]);
+    available_cache_idxs_.push_back(slot);
+    return slot;
+  }
+};
+
+typedef PolicyCacheIndicesManager<LfuPolicy> FlatCacheIndicesManager;
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+/*
+    window of upcoming batches.
+    a cpu idx referenced by any batch in the window should not be evicted, or be evicted last,
+    which approximates Belady's policy for the next few steps.
+    ref counts are per batch, duplicates inside one batch count once.
+*/
+class LookaheadWindow {
+ public:
+  template <typename Index>
+  void push(const Index* cpu_idx_ptr, long n) {
+    batches_.emplace_back(cpu_idx_ptr, cpu_idx_ptr + n);
+    auto& batch = batches_.back();
+    std::sort(batch.begin(), batch.end());
+    batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+    for (auto cpu_idx : batch) {
+      ref_count_[cpu_idx]++;
+    }
+  }
+
+  void pop() {
+    if (batches_.empty()) {
+      return;
+    }
+    for (auto cpu_idx : batches_.front()) {
+      auto it = ref_count_.find(cpu_idx);
+      if (--it->second == 0) {
+        ref_count_.erase(it);
+      }
+    }
+    batches_.pop_front();
+  }
+
+  void clear() {
+    batches_.clear();
+    ref_count_.clear();
+  }
+
+  long size() const { return batches_.size(); }
+  bool empty() const { return ref_count_.empty(); }
+  bool contains(long cpu_idx) const {
+    return !ref_count_.empty() && ref_count_.find(cpu_idx) != ref_count_.end();
+  }
+
+ private:
+  std::deque<std::vector<long>> batches_;   // unique cpu indices of each upcoming batch
+  std::unordered_map<long, long> ref_count_;  // cpu idx -> number of batches referencing it
+};
@@ -0,0 +1,53 @@
+// transfer volume with and without lookahead eviction on a zipf workload
+#include <iostream>
+#include <vector>
+
+#include "cache_mgr.h"
+#include "sort_cache_mgr.h"
+#include "workload.h"
+
+#define CacheRowNum 16384
+#define RandRange 1638400
+#define BatchSize 8192
+#define BatchNum 100
+
+using namespace std;
+
+template <typename Manager>
+long transfer_rows(Manager& mgr, const vector<vector<long>>& batches, long window) {
+  CacheInstructionBuffer out;
+  long rows = 0;
+  for (long k = 1; k <= window && k < (long)batches.size(); k++) {
+    mgr.push_lookahead(batches[k]);
+  }
+  for (size_t t = 0; t < batches.size(); t++) {
+    if (window > 0 && t > 0) {
+      mgr.pop_lookahead();
+      if (t + window < batches.size()) {
+        mgr.push_lookahead(batches[t + window]);
+      }
+    }
+    auto counts = mgr.prepare_ids(batches[t].data(), batches[t].size(), out);
+    rows += std::get<0>(counts) + std::get<1>(counts);
+  }
+  return rows;
+}
+
+int main() {
+  for (double skew : {0.8, 1.0, 1.2}) {
+    ZipfWorkload workload(RandRange, skew, 7);
+    vector<vector<long>> batches(BatchNum, vector<long>(BatchSize));
+    for (auto& batch : batches) {
+      workload.next_batch(batch.data(), batch.size());
+    }
+    cout << "zipf skew " << skew << endl;
+    for (long window : {0, 1, 2, 4, 8}) {
+      CacheIndicesManager mgr(CacheRowNum);
+      SortCacheIndicesManager sort_mgr(CacheRowNum);
+      cout << "  window " << window << "  CacheIndicesManager transfer rows "
+           << transfer_rows(mgr, batches, window) << "  SortCacheIndicesManager transfer rows "
+           << transfer_rows(sort_mgr, batches, window) << endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,255 @@
+// concurrent lookups: one writer thread runs prepare_ids while reader threads translate ids
+// through the manager's ConcurrentIndexTable. reports reader lookups/s and writer batch time.
+// with --verify 1 every reader scans the whole id range in one find_batch and checks it
+// against a checksum of the mapping the writer published under that version, so a torn
+// read (part pre-batch, part post-batch) is counted as an error.
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache_mgr.h"
+#include "sort_cache_mgr.h"
+#include "workload.h"
+
+using namespace std;
+
+struct LookupConfig {
+  vector<string> managers = {"cim", "cim_dense", "sort_select_dense"};
+  string workload = "zipf";
+  long batch_num = 200;
+  long batch_size = 8192;
+  long capacity = 65536;
+  long id_range = 262144;
+  long reader_num = 2;
+  long read_batch = 256;
+  bool verify = false;
+  double skew = 1.0;
+  uint64_t seed = 7;
+};
+
+void print_usage() {
+  cerr << "usage: lookup_bench [--managers cim,cim_dense,sort_set,sort_select,...,cim32,\n"
+          "                               sort_select_dense32]\n"
+          "                    [--workload uniform|zipf|shift] [--batches N] [--batch-size N]\n"
+          "                    [--capacity N] [--id-range N] [--readers N] [--read-batch N]\n"
+          "                    [--verify 0|1] [--skew S] [--seed N]\n";
+}
+
+LookupConfig parse_args(int argc, char** argv) {
+  LookupConfig config;
+  for (int i = 1; i < argc; i++) {
+    string key = argv[i];
+    if (key == "--help" || key == "-h") {
+      print_usage();
+      exit(0);
+    }
+    if (i + 1 >= argc) {
+      print_usage();
+      throw runtime_error("Error: missing value for " + key);
+    }
+    string value = argv[++i];
+    if (key == "--managers") {
+      config.managers.clear();
+      stringstream ss(value);
+      string item;
+      while (getline(ss, item, ',')) {
+        config.managers.push_back(item);
+      }
+    } else if (key == "--workload") {
+      config.workload = value;
+    } else if (key == "--batches") {
+      config.batch_num = stol(value);
+    } else if (key == "--batch-size") {
+      config.batch_size = stol(value);
+    } else if (key == "--capacity") {
+      config.capacity = stol(value);
+    } else if (key == "--id-range") {
+      config.id_range = stol(value);
+    } else if (key == "--readers") {
+      config.reader_num = stol(value);
+    } else if (key == "--read-batch") {
+      config.read_batch = stol(value);
+    } else if (key == "--verify") {
+      config.verify = stol(value) != 0;
+    } else if (key == "--skew") {
+      config.skew = stod(value);
+    } else if (key == "--seed") {
+      config.seed = stoull(value);
+    } else {
+      print_usage();
+      throw runtime_error("Error: unknown option " + key);
+    }
+  }
+  return config;
+}
+
+vector<vector<long>> make_batches(const LookupConfig& config) {
+  function<void(long*, long)> next_batch;
+  if (config.workload == "uniform") {
+    auto gen = make_shared<UniformWorkload>(config.id_range, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "zipf") {
+    auto gen = make_shared<ZipfWorkload>(config.id_range, config.skew, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "shift") {
+    auto gen = make_shared<ShiftingHotSetWorkload>(config.id_range, 8192, 0.8, 10, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else {
+    throw runtime_error("Error: unknown workload " + config.workload);
+  }
+  vector<vector<long>> batches(config.batch_num, vector<long>(config.batch_size));
+  for (auto& batch : batches) {
+    next_batch(batch.data(), batch.size());
+  }
+  return batches;
+}
+
+/* order-free checksum of a mapping: the sum of one mixed word per (cpu_idx, cache_idx) */
+uint64_t pair_hash(long cpu_idx, long cache_idx) {
+  uint64_t x = uint64_t(cpu_idx) * 0x9e3779b97f4a7c15ULL + uint64_t(cache_idx);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+struct LookupResult {
+  double writer_s = 0.0;
+  double elapsed_s = 0.0;
+  long lookup_num = 0;
+  long error_num = 0;
+};
+
+/*
+    the manager publishes in deferred mode: the writer stores the checksum of the next
+    mapping under its version first, then publishes, so a reader that sees version v finds
+    its checksum already there.
+*/
+template <typename Manager>
+LookupResult run(Manager& mgr, const LookupConfig& config, const vector<vector<long>>& batches) {
+  mgr.enable_concurrent_lookup(config.id_range, true);
+  auto table = mgr.concurrent_lookup();
+  auto base_version = table->version();
+  vector<atomic<uint64_t>> checksum(batches.size() + 1);
+  checksum[0].store(0, memory_order_relaxed);  // empty mapping
+  atomic<bool> done{false};
+  vector<long> lookup_num(config.reader_num, 0), error_num(config.reader_num, 0);
+  vector<thread> readers;
+  auto start = chrono::steady_clock::now();
+  for (long r = 0; r < config.reader_num; r++) {
+    readers.emplace_back([&, r] {
+      mt19937_64 rng(config.seed + r + 1);
+      uniform_int_distribution<long> dist(0, config.id_range - 1);
+      long batch = config.verify ? config.id_range : config.read_batch;
+      vector<long> ids(batch), rows(batch);
+      if (config.verify) {
+        for (long id = 0; id < batch; id++) {
+          ids[id] = id;
+        }
+      }
+      while (!done.load(memory_order_relaxed)) {
+        if (!config.verify) {
+          for (auto& id : ids) {
+            id = dist(rng);
+          }
+        }
+        auto version = table->find_batch(ids.data(), batch, rows.data());
+        lookup_num[r] += batch;
+        if (config.verify) {
+          uint64_t sum = 0;
+          for (long id = 0; id < batch; id++) {
+            sum += rows[id] != -1 ? pair_hash(id, rows[id]) : 0;
+          }
+          error_num[r] += sum != checksum[version - base_version].load(memory_order_relaxed);
+        }
+      }
+    });
+  }
+  LookupResult result;
+  typename Manager::InstructionBuffer out;
+  vector<typename decltype(out.gpu_idx_vector)::value_type> batch_ids;  // the manager's Index
+  uint64_t sum = 0;
+  for (size_t b = 0; b < batches.size(); b++) {
+    batch_ids.assign(batches[b].begin(), batches[b].end());
+    auto batch_start = chrono::steady_clock::now();
+    mgr.prepare_ids(batch_ids.data(), batch_ids.size(), out);
+    for (size_t i = 0; i < out.evict_cache_idx_vector.size(); i++) {
+      sum -= pair_hash(out.evict_to_cpu_idx_vector[i], out.evict_cache_idx_vector[i]);
+    }
+    for (size_t i = 0; i < out.admit_cpu_idx_vector.size(); i++) {
+      sum += pair_hash(out.admit_cpu_idx_vector[i], out.admit_to_cache_idx_vector[i]);
+    }
+    checksum[b + 1].store(sum, memory_order_relaxed);
+    mgr.publish_lookup(out);
+    result.writer_s += chrono::duration<double>(chrono::steady_clock::now() - batch_start).count();
+  }
+  done.store(true, memory_order_relaxed);
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  result.elapsed_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  for (long r = 0; r < config.reader_num; r++) {
+    result.lookup_num += lookup_num[r];
+    result.error_num += error_num[r];
+  }
+  return result;
+}
+
+LookupResult run_manager(const string& name, const LookupConfig& config,
+                         const vector<vector<long>>& batches) {
+  if (name == "cim") {
+    CacheIndicesManager mgr(config.capacity);
+    return run(mgr, config, batches);
+  }
+  if (name == "cim_dense") {
+    CacheIndicesManager mgr(config.capacity, config.id_range, IndexMapMode::kDense);
+    return run(mgr, config, batches);
+  }
+  if (name == "sort_set") {
+    SortCacheIndicesManager mgr(config.capacity, config.id_range);
+    return run(mgr, config, batches);
+  }
+  if (name == "sort_select") {
+    SortCacheIndicesManager mgr(config.capacity, config.id_range, SortEvictEngine::kSelect);
+    return run(mgr, config, batches);
+  }
+  if (name == "sort_select_dense") {
+    SortCacheIndicesManager mgr(config.capacity, config.id_range, SortEvictEngine::kSelect,
+                                IndexMapMode::kDense);
+    return run(mgr, config, batches);
+  }
+  if (name == "cim32") {
+    CompactCacheIndicesManager mgr(config.capacity);
+    return run(mgr, config, batches);
+  }
+  if (name == "sort_select_dense32") {
+    CompactSortCacheIndicesManager mgr(config.capacity, config.id_range, SortEvictEngine::kSelect,
+                                       IndexMapMode::kDense);
+    return run(mgr, config, batches);
+  }
+  throw runtime_error("Error: unknown manager " + name);
+}
+
+int main(int argc, char** argv) {
+  auto config = parse_args(argc, argv);
+  auto batches = make_batches(config);
+  cout << "manager,readers,read_batch,batch_num,writer_s,elapsed_s,lookups,lookups_per_s,errors"
+       << endl;
+  long total_error_num = 0;
+  for (auto const& name : config.managers) {
+    auto result = run_manager(name, config, batches);
+    cout << name << "," << config.reader_num << ","
+         << (config.verify ? config.id_range : config.read_batch) << "," << batches.size() << ","
+         << result.writer_s << "," << result.elapsed_s << "," << result.lookup_num << ","
+         << (result.elapsed_s > 0.0 ? result.lookup_num / result.elapsed_s : 0.0) << ","
+         << (config.verify ? to_string(result.error_num) : string("-")) << endl;
+    total_error_num += result.error_num;
+  }
+  return total_error_num > 0 ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "cache_mgr.h"
+#include "eviction_policy.h"
+#include "flat_cache_mgr.h"
+#include "sort_cache_mgr.h"
+
+/*
+    managers by name, for the benchmark and replay tools:
+    cim, cim_dense, cim_tinylfu, flat, flat_lru, flat_lfuda, flat_arc, sort_set, sort_select,
+    sort_select_dense, and the int32_t managers cim32, cim_dense32, sort_select32,
+    sort_select_dense32.
+    id_range is the cpu_row_num of the dense / sort variants.
+    transfer_plan calls set_transfer_plan(true) on the cim and sort variants, flat has none.
+    a PrepareFn runs one batch and returns (admit_num, evict_num).
+    a ResizeFn changes the capacity and returns (moved_num, evicted_num), see
+    CacheIndicesManager::resize. a WarmUpFn loads (cpu_idx, count) arrays, see
+    CacheIndicesManager::warm_up. a ReclaimFn sets the free-row watermark (low, high) and
+    runs reclaim in place or on a background thread, see
+    CacheIndicesManager::set_reclaim_watermark. an AgingFn sets the aging period and shift, see
+    CacheIndicesManager::set_aging. make_manager sets *resize_fn, *warm_up_fn, *reclaim_fn
+    and *aging_fn for the cim and sort variants and leaves them empty for the others.
+    the 32-bit variants narrow the ids on the way in and widen the output on the way out, so
+    the copies are part of what a benchmark measures for them.
+*/
+typedef std::function<std::tuple<long, long>(const long*, long, CacheInstructionBuffer&)> PrepareFn;
+typedef std::function<std::tuple<long, long>(long, CacheInstructionBuffer&)> ResizeFn;
+typedef std::function<std::tuple<long, long>(const long*, const long*, long,
+                                             CacheInstructionBuffer&)>
+    WarmUpFn;
+typedef std::function<void(long, int)> AgingFn;
+
+struct ReclaimFn {
+  std::function<void(long, long)> set_watermark;
+  std::function<std::tuple<long, long>(CacheInstructionBuffer&)> reclaim;
+  /* out is filled by the time wait_reclaim returns */
+  std::function<void(CacheInstructionBuffer&)> reclaim_async;
+  std::function<std::tuple<long, long>()> wait_reclaim;
+
+  explicit operator bool() const { return bool(reclaim); }
+};
+
+template <typename Manager>
+PrepareFn make_prepare_fn(std::shared_ptr<Manager> mgr) {
+  return [mgr](const long* cpu_idx_ptr, long n, CacheInstructionBuffer& out) {
+    return mgr->prepare_ids(cpu_idx_ptr, n, out);
+  };
+}
+
+template <typename Manager>
+PrepareFn make_planned_prepare_fn(std::shared_ptr<Manager> mgr, bool transfer_plan,
+                                  ResizeFn* resize_fn = nullptr, WarmUpFn* warm_up_fn = nullptr,
+                                  ReclaimFn* reclaim_fn = nullptr, AgingFn* aging_fn = nullptr) {
+  mgr->set_transfer_plan(transfer_plan);
+  if (resize_fn) {
+    *resize_fn = [mgr](long capacity, CacheInstructionBuffer& out) {
+      return mgr->resize(capacity, out);
+    };
+  }
+  if (warm_up_fn) {
+    *warm_up_fn = [mgr](const long* cpu_idx_ptr, const long* count_ptr, long n,
+                        CacheInstructionBuffer& out) {
+      return mgr->warm_up(cpu_idx_ptr, count_ptr, n, out);
+    };
+  }
+  if (reclaim_fn) {
+    reclaim_fn->set_watermark = [mgr](long low, long high) {
+      mgr->set_reclaim_watermark(low, high);
+    };
+    reclaim_fn->reclaim = [mgr](CacheInstructionBuffer& out) { return mgr->reclaim(out); };
+    reclaim_fn->reclaim_async = [mgr](CacheInstructionBuffer& out) { mgr->reclaim_async(out); };
+    reclaim_fn->wait_reclaim = [mgr] { return mgr->wait_reclaim(); };
+  }
+  if (aging_fn) {
+    *aging_fn = [mgr](long period_batches, int shift) { mgr->set_aging(period_batches, shift); };
+  }
+  return make_prepare_fn(mgr);
+}
+
+/*
+    PrepareFn / ResizeFn / WarmUpFn / ReclaimFn over a compact manager. ids that do not fit
+    the manager's Index throw before the manager sees the batch. an async reclaim fills its
+    own buffer, which every later call widens into the caller's out before it runs.
+*/
+template <typename Manager>
+PrepareFn make_compact_prepare_fn(std::shared_ptr<Manager> mgr, bool transfer_plan,
+                                  ResizeFn* resize_fn = nullptr, WarmUpFn* warm_up_fn = nullptr,
+                                  ReclaimFn* reclaim_fn = nullptr, AgingFn* aging_fn = nullptr) {
+  typedef typename Manager::InstructionBuffer::index_type Index;
+  struct Scratch {
+    std::vector<Index> cpu_idx_vector;
+    typename Manager::InstructionBuffer out;
+    typename Manager::InstructionBuffer reclaim_out;
+    CacheInstructionBuffer* reclaim_target = nullptr;
+
+    std::tuple<long, long> finish_reclaim(Manager& mgr) {
+      auto result = mgr.wait_reclaim();
+      if (reclaim_target) {
+        reclaim_target->assign(reclaim_out);
+        reclaim_target = nullptr;
+      }
+      return result;
+    }
+
+    const Index* narrow(const long* cpu_idx_ptr, long n) {
+      cpu_idx_vector.resize(n);
+      for (long i = 0; i < n; i++) {
+        if (cpu_idx_ptr[i] < std::numeric_limits<Index>::min() ||
+            cpu_idx_ptr[i] > std::numeric_limits<Index>::max()) {
+          throw std::runtime_error("Error: cpu idx exceeds the index type.");
+        }
+        cpu_idx_vector[i] = cpu_idx_ptr[i];
+      }
+      return cpu_idx_vector.data();
+    }
+  };
+  auto scratch = std::make_shared<Scratch>();
+  mgr->set_transfer_plan(transfer_plan);
+  if (resize_fn) {
+    *resize_fn = [mgr, scratch](long capacity, CacheInstructionBuffer& out) {
+      scratch->finish_reclaim(*mgr);
+      auto result = mgr->resize(capacity, scratch->out);
+      out.assign(scratch->out);
+      return result;
+    };
+  }
+  if (warm_up_fn) {
+    *warm_up_fn = [mgr, scratch](const long* cpu_idx_ptr, const long* count_ptr, long n,
+                                 CacheInstructionBuffer& out) {
+      scratch->finish_reclaim(*mgr);
+      auto result = mgr->warm_up(scratch->narrow(cpu_idx_ptr, n), count_ptr, n, scratch->out);
+      out.assign(scratch->out);
+      return result;
+    };
+  }
+  if (reclaim_fn) {
+    reclaim_fn->set_watermark = [mgr, scratch](long low, long high) {
+      scratch->finish_reclaim(*mgr);
+      mgr->set_reclaim_watermark(low, high);
+    };
+    reclaim_fn->reclaim = [mgr, scratch](CacheInstructionBuffer& out) {
+      scratch->finish_reclaim(*mgr);
+      auto result = mgr->reclaim(scratch->reclaim_out);
+      out.assign(scratch->reclaim_out);
+      return result;
+    };
+    reclaim_fn->reclaim_async = [mgr, scratch](CacheInstructionBuffer& out) {
+      scratch->finish_reclaim(*mgr);
+      scratch->reclaim_target = &out;
+      mgr->reclaim_async(scratch->reclaim_out);
+    };
+    reclaim_fn->wait_reclaim = [mgr, scratch] { return scratch->finish_reclaim(*mgr); };
+  }
+  if (aging_fn) {
+    *aging_fn = [mgr, scratch](long period_batches, int shift) {
+      scratch->finish_reclaim(*mgr);
+      mgr->set_aging(period_batches, shift);
+    };
+  }
+  return [mgr, scratch](const long* cpu_idx_ptr, long n, CacheInstructionBuffer& out) {
+    scratch->finish_reclaim(*mgr);
+    auto result = mgr->prepare_ids(scratch->narrow(cpu_idx_ptr, n), n, scratch->out);
+    out.assign(scratch->out);
+    return result;
+  };
+}
+
+inline PrepareFn make_manager(const std::string& name, long capacity, long id_range,
+                              bool transfer_plan = false, ResizeFn* resize_fn = nullptr,
+                              WarmUpFn* warm_up_fn = nullptr, ReclaimFn* reclaim_fn = nullptr,
+                              AgingFn* aging_fn = nullptr) {
+  if (resize_fn) {
+    *resize_fn = nullptr;
+  }
+  if (warm_up_fn) {
+    *warm_up_fn = nullptr;
+  }
+  if (reclaim_fn) {
+    *reclaim_fn = ReclaimFn();
+  }
+  if (aging_fn) {
+    *aging_fn = nullptr;
+  }
+  if (name == "cim") {
+    return make_planned_prepare_fn(std::make_shared<CacheIndicesManager>(capacity),
+                                   transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  if (name == "cim_dense") {
+    return make_planned_prepare_fn(
+        std::make_shared<CacheIndicesManager>(capacity, id_range, IndexMapMode::kDense),
+        transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  if (name == "cim_tinylfu") {
+    auto mgr = std::make_shared<CacheIndicesManager>(capacity);
+    mgr->set_admission_filter(true);
+    return make_planned_prepare_fn(mgr, transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  if (name == "flat") {
+    return make_prepare_fn(std::make_shared<FlatCacheIndicesManager>(capacity));
+  }
+  if (name == "flat_lru") {
+    return make_prepare_fn(std::make_shared<PolicyCacheIndicesManager<LruPolicy>>(capacity));
+  }
+  if (name == "flat_lfuda") {
+    return make_prepare_fn(std::make_shared<PolicyCacheIndicesManager<LfuDaPolicy>>(capacity));
+  }
+  if (name == "flat_arc") {
+    return make_prepare_fn(std::make_shared<PolicyCacheIndicesManager<ArcPolicy>>(capacity));
+  }
+  if (name == "sort_set") {
+    return make_planned_prepare_fn(std::make_shared<SortCacheIndicesManager>(capacity, id_range),
+                                   transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  if (name == "sort_select") {
+    return make_planned_prepare_fn(
+        std::make_shared<SortCacheIndicesManager>(capacity, id_range, SortEvictEngine::kSelect),
+        transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  if (name == "sort_select_dense") {
+    return make_planned_prepare_fn(
+        std::make_shared<SortCacheIndicesManager>(capacity, id_range, SortEvictEngine::kSelect,
+                                                  IndexMapMode::kDense),
+        transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  if (name == "cim32") {
+    return make_compact_prepare_fn(std::make_shared<CompactCacheIndicesManager>(capacity),
+                                   transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  if (name == "cim_dense32") {
+    return make_compact_prepare_fn(
+        std::make_shared<CompactCacheIndicesManager>(capacity, id_range, IndexMapMode::kDense),
+        transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  if (name == "sort_select32") {
+    return make_compact_prepare_fn(std::make_shared<CompactSortCacheIndicesManager>(
+                                       capacity, id_range, SortEvictEngine::kSelect),
+                                   transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  if (name == "sort_select_dense32") {
+    return make_compact_prepare_fn(
+        std::make_shared<CompactSortCacheIndicesManager>(
+            capacity, id_range, SortEvictEngine::kSelect, IndexMapMode::kDense),
+        transfer_plan, resize_fn, warm_up_fn, reclaim_fn, aging_fn);
+  }
+  throw std::runtime_error("Error: unknown manager " + name);
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "manager_factory.h"
+
+/*
+    hit rate vs capacity of a manager in one pass over an index stream, by spatially sampled
+    miniature simulations (SHARDS): an id is sampled when hash(id) mod 2^16 < rate * 2^16, so
+    every access of a sampled id is kept and the sampled stream keeps the reuse pattern of the
+    full one at rate times the ids. for each capacity C one manager of capacity round(rate * C)
+    replays the sampled batches; its hit rate estimates the full-size one.
+    LFU has no stack property, so every capacity is its own miniature. memory is the sum of the
+    scaled capacities, independent of the stream length.
+    sample_num independent hash salts run sample_num miniatures per capacity. the estimate is
+    their pooled hit rate, sum of hits / sum of sampled accesses, so a salt that happened to
+    sample more accesses weighs more, as it would in one larger sample; a mean of per-salt
+    ratios is biased by the salts' different sizes. its standard error is the delete-one
+    jackknife over the salts. a capacity whose miniature cannot hold one sampled batch (the
+    full-size manager would throw as well) is reported as infeasible.
+*/
+class MissRatioCurve {
+ public:
+  typedef std::function<PrepareFn(long)> MakeManagerFn;  // capacity -> manager
+
+  struct Point {
+    long capacity;
+    long scaled_capacity;
+    double hit_rate;   // pooled over the samples
+    double std_error;  // jackknife standard error of hit_rate, 0 with one sample
+    bool feasible;
+  };
+
+  MissRatioCurve(const std::vector<long>& capacities, double rate, long sample_num,
+                 const MakeManagerFn& make_manager)
+      : capacities_(capacities), sample_num_(sample_num) {
+    if (rate <= 0.0 || rate > 1.0 || sample_num <= 0 || capacities.empty()) {
+      throw std::runtime_error("Error: invalid miss ratio curve config.");
+    }
+    threshold_ = std::max(1L, std::lround(rate * kHashRange));
+    rate_ = double(threshold_) / kHashRange;
+    for (auto capacity : capacities_) {
+      scaled_capacities_.push_back(std::max(1L, std::lround(rate_ * capacity)));
+    }
+    minis_.resize(sample_num_ * capacities_.size());
+    for (long s = 0; s < sample_num_; s++) {
+      for (size_t c = 0; c < capacities_.size(); c++) {
+        auto& mini = minis_[s * capacities_.size() + c];
+        mini.prepare_ids = make_manager(scaled_capacities_[c]);
+      }
+    }
+    sampled_vectors_.resize(sample_num_);
+    sampled_num_.assign(sample_num_, 0);
+  }
+
+  /* one batch of the stream */
+  void feed(const long* cpu_idx_ptr, long n) {
+    for (auto& sampled : sampled_vectors_) {
+      sampled.clear();
+    }
+    /* step 1. sample. each 64-bit hash serves kSamplesPerHash salts, 16 bits each */
+    for (long i = 0; i < n; i++) {
+      auto cpu_idx = cpu_idx_ptr[i];
+      for (long s = 0; s < sample_num_; s += kSamplesPerHash) {
+        auto hash = mix(static_cast<uint64_t>(cpu_idx) + (s + 1) * 0x9e3779b97f4a7c15ULL);
+        for (long k = s; k < std::min(sample_num_, s + kSamplesPerHash); k++) {
+          if (static_cast<long>(hash & (kHashRange - 1)) < threshold_) {
+            sampled_vectors_[k].push_back(cpu_idx);
+          }
+          hash >>= 16;
+        }
+      }
+    }
+    access_num_ += n;
+    /* step 2. miniatures */
+    for (long s = 0; s < sample_num_; s++) {
+      auto const& sampled = sampled_vectors_[s];
+      if (sampled.empty()) {
+        continue;
+      }
+      sampled_num_[s] += sampled.size();
+      for (size_t c = 0; c < capacities_.size(); c++) {
+        auto& mini = minis_[s * capacities_.size() + c];
+        if (!mini.feasible) {
+          continue;
+        }
+        try {
+          mini.prepare_ids(sampled.data(), sampled.size(), out_);
+        } catch (const std::runtime_error&) {
+          mini.feasible = false;
+          mini.prepare_ids = nullptr;  // frees the miniature
+          continue;
+        }
+        // admitted and bypassed ids are misses
+        long miss_num = out_.admit_cpu_idx_vector.size() +
+                        std::count(out_.gpu_idx_vector.begin(), out_.gpu_idx_vector.end(), -1L);
+        mini.hit_num += sampled.size() - miss_num;
+      }
+    }
+  }
+
+  std::vector<Point> curve() const {
+    std::vector<Point> points;
+    for (size_t c = 0; c < capacities_.size(); c++) {
+      Point point = {capacities_[c], scaled_capacities_[c], 0.0, 0.0, true};
+      // (hits, sampled accesses) of each salt that sampled any access
+      std::vector<std::pair<double, double>> counts;
+      double hit_sum = 0.0, sampled_sum = 0.0;
+      for (long s = 0; s < sample_num_; s++) {
+        auto const& mini = minis_[s * capacities_.size() + c];
+        point.feasible = point.feasible && mini.feasible;
+        if (sampled_num_[s] > 0) {
+          counts.emplace_back(mini.hit_num, sampled_num_[s]);
+          hit_sum += mini.hit_num;
+          sampled_sum += sampled_num_[s];
+        }
+      }
+      if (point.feasible && !counts.empty()) {
+        point.hit_rate = hit_sum / sampled_sum;
+        long k = counts.size();
+        if (k > 1) {
+          std::vector<double> loo_rates;  // pooled rate without salt i
+          double loo_mean = 0.0;
+          for (auto const& count : counts) {
+            loo_rates.push_back((hit_sum - count.first) / (sampled_sum - count.second));
+            loo_mean += loo_rates.back() / k;
+          }
+          double sum_sq = 0.0;
+          for (auto rate : loo_rates) {
+            sum_sq += (rate - loo_mean) * (rate - loo_mean);
+          }
+          point.std_error = std::sqrt(sum_sq * (k - 1) / k);
+        }
+      }
+      points.push_back(point);
+    }
+    return points;
+  }
+
+  /* the sampling rate in effect, rate rounded to a multiple of 2^-16 */
+  double rate() const { return rate_; }
+  long access_num() const { return access_num_; }
+
+  /* sampled accesses, mean over the samples */
+  double sampled_num() const {
+    double sum = 0.0;
+    for (auto num : sampled_num_) {
+      sum += num;
+    }
+    return sum / sample_num_;
+  }
+
+ private:
+  static const long kHashRange = 1L << 16;
+  static const long kSamplesPerHash = 4;
+
+  struct Mini {
+    PrepareFn prepare_ids;
+    long hit_num = 0;
+    bool feasible = true;
+  };
+
+  std::vector<long> capacities_;
+  std::vector<long> scaled_capacities_;
+  long sample_num_;
+  long threshold_;
+  double rate_;
+  std::vector<Mini> minis_;  // sample-major
+  std::vector<std::vector<long>> sampled_vectors_;
+  std::vector<long> sampled_num_;
+  long access_num_ = 0;
+  CacheInstructionBuffer out_;
+
+  static uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+};
@@ -0,0 +1,209 @@
+// hit rate vs capacity in one pass: MissRatioCurve replays a trace (or a synthetic workload)
+// through spatially sampled miniature managers, one per capacity and sample. with --exact 1
+// full-size managers run alongside, to check the estimate on streams small enough for that;
+// --tolerance T then fails the run if an estimate is off by more than T.
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "manager_factory.h"
+#include "miss_ratio_curve.h"
+#include "trace.h"
+#include "workload.h"
+
+using namespace std;
+
+struct MrcConfig {
+  string manager = "cim";
+  string trace_path;
+  string workload = "zipf";
+  long batch_num = 100;
+  long batch_size = 8192;
+  long id_range = 1638400;
+  double skew = 1.0;
+  uint64_t seed = 7;
+  vector<long> capacities;
+  long min_capacity = 16384;
+  long max_capacity = 1048576;
+  long point_num = 8;
+  double rate = 0.01;
+  long sample_num = 4;
+  bool exact = false;
+  double tolerance = 0.0;  // max |estimate - exact| with --exact, 0 = report only
+};
+
+void print_usage() {
+  cerr << "usage: mrc [--manager NAME] [--trace PATH | --workload uniform|zipf|shift\n"
+          "            --batches N --batch-size N --skew S --seed N] [--id-range N]\n"
+          "           [--capacities a,b,... | --min-capacity N --max-capacity N --points N]\n"
+          "           [--rate R] [--samples N] [--exact 0|1] [--tolerance T]\n";
+}
+
+vector<long> parse_list(const string& value) {
+  vector<long> items;
+  stringstream ss(value);
+  string item;
+  while (getline(ss, item, ',')) {
+    items.push_back(stol(item));
+  }
+  return items;
+}
+
+MrcConfig parse_args(int argc, char** argv) {
+  MrcConfig config;
+  for (int i = 1; i < argc; i++) {
+    string key = argv[i];
+    if (key == "--help" || key == "-h") {
+      print_usage();
+      exit(0);
+    }
+    if (i + 1 >= argc) {
+      print_usage();
+      throw runtime_error("Error: missing value for " + key);
+    }
+    string value = argv[++i];
+    if (key == "--manager") {
+      config.manager = value;
+    } else if (key == "--trace") {
+      config.trace_path = value;
+    } else if (key == "--workload") {
+      config.workload = value;
+    } else if (key == "--batches") {
+      config.batch_num = stol(value);
+    } else if (key == "--batch-size") {
+      config.batch_size = stol(value);
+    } else if (key == "--id-range") {
+      config.id_range = stol(value);
+    } else if (key == "--skew") {
+      config.skew = stod(value);
+    } else if (key == "--seed") {
+      config.seed = stoull(value);
+    } else if (key == "--capacities") {
+      config.capacities = parse_list(value);
+    } else if (key == "--min-capacity") {
+      config.min_capacity = stol(value);
+    } else if (key == "--max-capacity") {
+      config.max_capacity = stol(value);
+    } else if (key == "--points") {
+      config.point_num = stol(value);
+    } else if (key == "--rate") {
+      config.rate = stod(value);
+    } else if (key == "--samples") {
+      config.sample_num = stol(value);
+    } else if (key == "--exact") {
+      config.exact = stol(value) != 0;
+    } else if (key == "--tolerance") {
+      config.tolerance = stod(value);
+    } else {
+      print_usage();
+      throw runtime_error("Error: unknown option " + key);
+    }
+  }
+  // log-spaced from min to max capacity
+  if (config.capacities.empty()) {
+    for (long p = 0; p < config.point_num; p++) {
+      double t = config.point_num > 1 ? double(p) / (config.point_num - 1) : 0.0;
+      config.capacities.push_back(
+          lround(config.min_capacity * pow(double(config.max_capacity) / config.min_capacity, t)));
+    }
+  }
+  return config;
+}
+
+/* calls fn(batch) for every batch of the trace or the synthetic workload */
+void for_each_batch(const MrcConfig& config, const function<void(const vector<long>&)>& fn) {
+  vector<long> batch;
+  if (!config.trace_path.empty()) {
+    TraceReader reader(config.trace_path);
+    while (reader.next_batch(batch)) {
+      fn(batch);
+    }
+    return;
+  }
+  function<void(long*, long)> next_batch;
+  if (config.workload == "uniform") {
+    auto gen = make_shared<UniformWorkload>(config.id_range, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "zipf") {
+    auto gen = make_shared<ZipfWorkload>(config.id_range, config.skew, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "shift") {
+    auto gen = make_shared<ShiftingHotSetWorkload>(config.id_range, 8192, 0.8, 10, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else {
+    throw runtime_error("Error: unknown workload " + config.workload);
+  }
+  batch.resize(config.batch_size);
+  for (long b = 0; b < config.batch_num; b++) {
+    next_batch(batch.data(), batch.size());
+    fn(batch);
+  }
+}
+
+int main(int argc, char** argv) {
+  auto config = parse_args(argc, argv);
+  auto make = [&config](long capacity) {
+    return make_manager(config.manager, capacity, config.id_range);
+  };
+  MissRatioCurve curve(config.capacities, config.rate, config.sample_num, make);
+  // full-size managers for --exact, hit counts, -1 once infeasible
+  vector<PrepareFn> exact_managers;
+  vector<long> exact_hit_num(config.capacities.size(), 0);
+  if (config.exact) {
+    for (auto capacity : config.capacities) {
+      exact_managers.push_back(make(capacity));
+    }
+  }
+  CacheInstructionBuffer out;
+  double sample_s = 0.0;
+  for_each_batch(config, [&](const vector<long>& batch) {
+    auto start = chrono::steady_clock::now();
+    curve.feed(batch.data(), batch.size());
+    sample_s += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for (size_t c = 0; c < exact_managers.size(); c++) {
+      if (exact_hit_num[c] < 0) {
+        continue;
+      }
+      try {
+        exact_managers[c](batch.data(), batch.size(), out);
+        exact_hit_num[c] += batch.size() - out.admit_cpu_idx_vector.size() -
+                            count(out.gpu_idx_vector.begin(), out.gpu_idx_vector.end(), -1L);
+      } catch (const runtime_error&) {
+        exact_hit_num[c] = -1;
+      }
+    }
+  });
+  cout << "manager,capacity,scaled_capacity,rate,samples,hit_rate,std_error,exact_hit_rate,"
+          "accesses,sampled,mrc_s,accesses_per_s"
+       << endl;
+  auto points = curve.curve();
+  long off_num = 0;
+  for (size_t c = 0; c < points.size(); c++) {
+    auto const& point = points[c];
+    string exact = "-";
+    if (config.exact) {
+      bool feasible = exact_hit_num[c] >= 0 && curve.access_num() > 0;
+      double exact_hit_rate = feasible ? double(exact_hit_num[c]) / curve.access_num() : 0.0;
+      exact = feasible ? to_string(exact_hit_rate) : string("infeasible");
+      if (config.tolerance > 0.0 && feasible && point.feasible &&
+          fabs(point.hit_rate - exact_hit_rate) > config.tolerance) {
+        cerr << "capacity " << point.capacity << ": estimate " << point.hit_rate
+             << " is off the exact " << exact_hit_rate << " by more than " << config.tolerance
+             << endl;
+        off_num++;
+      }
+    }
+    cout << config.manager << "," << point.capacity << "," << point.scaled_capacity << ","
+         << curve.rate() << "," << config.sample_num << ","
+         << (point.feasible ? to_string(point.hit_rate) : string("infeasible")) << ","
+         << point.std_error << "," << exact << "," << curve.access_num() << ","
+         << curve.sampled_num() << "," << sample_s << ","
+         << (sample_s > 0.0 ? curve.access_num() / sample_s : 0.0) << endl;
+  }
+  return off_num > 0 ? 1 : 0;
+}
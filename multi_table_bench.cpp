@@ -0,0 +1,146 @@
+// many tables, one step: a static split (one FlatCacheIndicesManager per table, capacity
+// divided evenly, one prepare_ids call per table) against one MultiTableCacheIndicesManager
+// over the whole pool (one call per step). table t draws zipf ids with a batch share that
+// falls off with t, so a few tables are hot and most are cold.
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "multi_table_cache_mgr.h"
+#include "workload.h"
+
+using namespace std;
+
+struct MultiTableConfig {
+  long table_num = 32;
+  long batch_num = 100;
+  long batch_size = 8192;  // ids per step over all tables
+  long capacity = 65536;   // rows over all tables
+  long id_range = 262144;  // per table
+  double skew = 1.0;
+  long min_rows = 0;  // quota applied to every table of the shared pool
+  uint64_t seed = 7;
+};
+
+void print_usage() {
+  cerr << "usage: multi_table_bench [--tables N] [--batches N] [--batch-size N] [--capacity N]\n"
+          "                         [--id-range N] [--skew S] [--min-rows N] [--seed N]\n";
+}
+
+MultiTableConfig parse_args(int argc, char** argv) {
+  MultiTableConfig config;
+  for (int i = 1; i < argc; i++) {
+    string key = argv[i];
+    if (key == "--help" || key == "-h") {
+      print_usage();
+      exit(0);
+    }
+    if (i + 1 >= argc) {
+      print_usage();
+      throw runtime_error("Error: missing value for " + key);
+    }
+    string value = argv[++i];
+    if (key == "--tables") {
+      config.table_num = stol(value);
+    } else if (key == "--batches") {
+      config.batch_num = stol(value);
+    } else if (key == "--batch-size") {
+      config.batch_size = stol(value);
+    } else if (key == "--capacity") {
+      config.capacity = stol(value);
+    } else if (key == "--id-range") {
+      config.id_range = stol(value);
+    } else if (key == "--skew") {
+      config.skew = stod(value);
+    } else if (key == "--min-rows") {
+      config.min_rows = stol(value);
+    } else if (key == "--seed") {
+      config.seed = stoull(value);
+    } else {
+      print_usage();
+      throw runtime_error("Error: unknown option " + key);
+    }
+  }
+  return config;
+}
+
+/* CSR batches: offsets[b] has table_num + 1 entries into ids[b] */
+void make_batches(const MultiTableConfig& config, vector<vector<long>>& offsets,
+                  vector<vector<long>>& ids) {
+  vector<unique_ptr<ZipfWorkload>> gens;
+  vector<long> share(config.table_num);
+  double weight_sum = 0.0;
+  for (long t = 0; t < config.table_num; t++) {
+    gens.emplace_back(new ZipfWorkload(config.id_range, config.skew, config.seed + t));
+    weight_sum += 1.0 / (t + 1);
+  }
+  for (long t = 0; t < config.table_num; t++) {
+    share[t] = max(1L, static_cast<long>(config.batch_size / (t + 1) / weight_sum));
+  }
+  offsets.assign(config.batch_num, vector<long>(config.table_num + 1, 0));
+  ids.assign(config.batch_num, vector<long>());
+  for (long b = 0; b < config.batch_num; b++) {
+    for (long t = 0; t < config.table_num; t++) {
+      offsets[b][t + 1] = offsets[b][t] + share[t];
+    }
+    ids[b].resize(offsets[b][config.table_num]);
+    for (long t = 0; t < config.table_num; t++) {
+      gens[t]->next_batch(ids[b].data() + offsets[b][t], share[t]);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  auto config = parse_args(argc, argv);
+  vector<vector<long>> offsets, ids;
+  make_batches(config, offsets, ids);
+  cout << "layout,tables,capacity,batch_num,id_num,calls,prepare_s,ids_per_s,hit_rate" << endl;
+  auto report = [&](const string& layout, long calls, double prepare_s, long admit_num) {
+    long id_num = 0;
+    for (auto const& batch : ids) {
+      id_num += batch.size();
+    }
+    cout << layout << "," << config.table_num << "," << config.capacity << ","
+         << config.batch_num << "," << id_num << "," << calls << "," << prepare_s << ","
+         << (prepare_s > 0.0 ? id_num / prepare_s : 0.0) << ","
+         << (id_num > 0 ? 1.0 - double(admit_num) / id_num : 0.0) << endl;
+  };
+  {
+    vector<unique_ptr<FlatCacheIndicesManager>> mgrs;
+    for (long t = 0; t < config.table_num; t++) {
+      mgrs.emplace_back(new FlatCacheIndicesManager(config.capacity / config.table_num));
+    }
+    CacheInstructionBuffer out;
+    long calls = 0, admit_num = 0;
+    double prepare_s = 0.0;
+    for (long b = 0; b < config.batch_num; b++) {
+      auto start = chrono::steady_clock::now();
+      for (long t = 0; t < config.table_num; t++) {
+        auto begin = offsets[b][t];
+        admit_num += get<0>(mgrs[t]->prepare_ids(ids[b].data() + begin,
+                                                   offsets[b][t + 1] - begin, out));
+        calls++;
+      }
+      prepare_s += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    report("static_split", calls, prepare_s, admit_num);
+  }
+  {
+    MultiTableCacheIndicesManager mgr(config.capacity, config.table_num);
+    for (long t = 0; t < config.table_num; t++) {
+      mgr.set_quota(t, config.min_rows, config.capacity);
+    }
+    MultiTableInstructionBuffer out;
+    long admit_num = 0;
+    double prepare_s = 0.0;
+    for (long b = 0; b < config.batch_num; b++) {
+      auto start = chrono::steady_clock::now();
+      admit_num += get<0>(mgr.prepare_ids(offsets[b].data(), ids[b].data(), out));
+      prepare_s += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    report("shared_pool", config.batch_num, prepare_s, admit_num);
+  }
+  return 0;
+}
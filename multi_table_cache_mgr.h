@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "admission_filter.h"
+#include "cache_instruction.h"
+#include "flat_cache_mgr.h"
+
+/*
+    instructions of one MultiTableCacheIndicesManager batch.
+    instruction.gpu_idx_vector keeps the input order. admit and evict pairs are grouped by
+    table: table t admitted instruction.admit_*[admit_offsets[t], admit_offsets[t + 1]) and
+    lost instruction.evict_*[evict_offsets[t], evict_offsets[t + 1]). cpu indices are the
+    table's own ids, cache indices are rows of the shared pool.
+*/
+struct MultiTableInstructionBuffer {
+  CacheInstructionBuffer instruction;
+  std::vector<long> admit_offsets;
+  std::vector<long> evict_offsets;
+};
+
+/*
+    one cache pool shared by table_num embedding tables, one prepare_ids call per step.
+    each table keeps its own freq list (FlatFreqList with one list per table) over the pool
+    rows it holds. a miss takes a free row, or else evicts the least frequent unmasked row of
+    any table, so rows flow from cold tables to hot ones.
+    quotas (set_quota) bound that flow per table:
+        min_rows: the table never loses rows to other tables below this size,
+        max_rows: at this size the table evicts its own LFU row to admit.
+    when every unmasked row is protected by a min quota, a miss recycles its own table's LFU
+    row. a batch is checked before it changes anything (ids, max quotas, and that the pool
+    can hold its distinct ids next to the rows min quotas protect), so a rejected batch
+    leaves the manager as it was.
+    the tables' LFU candidates sit in a lazy min-heap keyed by freq, so a global victim costs
+    O(log table_num): candidate freqs only grow during a batch, a popped entry whose table
+    moved on is re-pushed with its current freq. ties go to the candidate that waited longest.
+    cpu indices must lie in [0, 2^kTableShift).
+*/
+class MultiTableCacheIndicesManager {
+ public:
+  static const int kTableShift = 40;
+
+  MultiTableCacheIndicesManager(long cache_capacity, long table_num)
+      : cache_capacity_(cache_capacity),
+        table_num_(table_num),
+        index_(cache_capacity),
+        freq_list_(cache_capacity, table_num) {
+    if (table_num <= 0 || table_num >= (1L << (63 - kTableShift))) {
+      throw std::runtime_error("Error: invalid table num.");
+    }
+    cache_cpu_match_.assign(cache_capacity_, -1);
+    slot_table_.assign(cache_capacity_, -1);
+    masked_.assign(cache_capacity_, 0);
+    masked_slots_.reserve(cache_capacity_);
+    available_cache_idxs_.reserve(cache_capacity_);
+    min_rows_.assign(table_num_, 0);
+    max_rows_.assign(table_num_, cache_capacity_);
+    row_num_.assign(table_num_, 0);
+    in_heap_.assign(table_num_, 0);
+    init_state();
+  }
+
+  /*
+      CSR input: table t's ids are cpu_idx_ptr[table_offsets[t], table_offsets[t + 1]).
+      table_offsets holds table_num + 1 entries, table_offsets[0] == 0.
+  */
+  std::tuple<long, long> prepare_ids(const long* table_offsets, const long* cpu_idx_ptr,
+                                     MultiTableInstructionBuffer& out) {
+    if (table_offsets[0] != 0) {
+      throw std::runtime_error("Error: table offsets must start at 0.");
+    }
+    for (long t = 0; t < table_num_; t++) {
+      if (table_offsets[t] > table_offsets[t + 1]) {
+        throw std::runtime_error("Error: table offsets must not decrease.");
+      }
+    }
+    long n = table_offsets[table_num_];
+    table_idx_vector_.resize(n);
+    for (long t = 0; t < table_num_; t++) {
+      std::fill(table_idx_vector_.begin() + table_offsets[t],
+                table_idx_vector_.begin() + table_offsets[t + 1], t);
+    }
+    return prepare_tagged_ids(table_idx_vector_.data(), cpu_idx_ptr, n, out);
+  }
+
+  /* tagged input: cpu_idx_ptr[i] is an id of table table_idx_ptr[i] */
+  std::tuple<long, long> prepare_tagged_ids(const long* table_idx_ptr, const long* cpu_idx_ptr,
+                                            long n, MultiTableInstructionBuffer& out) {
+    /* out is cleared and refilled. return (admit_num, evict_num) */
+    check_batch(table_idx_ptr, cpu_idx_ptr, n);
+    auto& instruction = out.instruction;
+    instruction.clear();
+    admit_table_vector_.clear();
+    evict_table_vector_.clear();
+    /* step 1. mask already-cached slots, check_batch filled key_vector_ */
+    for (long i = 0; i < n; i++) {
+      auto slot = index_.find(key_vector_[i]);
+      if (slot != -1 && !masked_[slot]) {
+        masked_[slot] = 1;
+        masked_slots_.push_back(slot);
+      }
+    }
+    /* step 2. cache op for each id */
+    candidate_heap_.clear();
+    std::fill(in_heap_.begin(), in_heap_.end(), 0);
+    for (long t = 0; t < table_num_; t++) {
+      freq_list_.set_tail(freq_list_.head(t), t);
+      push_candidate(t);
+    }
+    for (long i = 0; i < n; i++) {
+      auto table = table_idx_ptr[i];
+      auto slot = index_.find(key_vector_[i]);
+      if (slot != -1) {
+        freq_list_.touch(slot);
+        instruction.gpu_idx_vector.push_back(slot);
+        continue;
+      }
+      if (row_num_[table] >= max_rows_[table] || available_cache_idxs_.empty()) {
+        auto evict_slot = evict_cache(table, row_num_[table] >= max_rows_[table]);
+        instruction.evict_cache_idx_vector.push_back(evict_slot);
+        instruction.evict_to_cpu_idx_vector.push_back(cache_cpu_match_[evict_slot]);
+        evict_table_vector_.push_back(slot_table_[evict_slot]);
+        cache_cpu_match_[evict_slot] = -1;
+        slot_table_[evict_slot] = -1;
+      }
+      slot = admit_cache(table, cpu_idx_ptr[i], key_vector_[i]);
+      masked_[slot] = 1;
+      masked_slots_.push_back(slot);
+      instruction.admit_cpu_idx_vector.push_back(cpu_idx_ptr[i]);
+      instruction.admit_to_cache_idx_vector.push_back(slot);
+      admit_table_vector_.push_back(table);
+      instruction.gpu_idx_vector.push_back(slot);
+    }
+    /* step 3. unmask */
+    for (auto slot : masked_slots_) {
+      masked_[slot] = 0;
+    }
+    masked_slots_.clear();
+    /* step 4. group admits and evicts by table */
+    group_by_table(admit_table_vector_, instruction.admit_cpu_idx_vector,
+                   instruction.admit_to_cache_idx_vector, out.admit_offsets);
+    group_by_table(evict_table_vector_, instruction.evict_to_cpu_idx_vector,
+                   instruction.evict_cache_idx_vector, out.evict_offsets);
+    return std::tuple<long, long>(instruction.admit_cpu_idx_vector.size(),
+                                  instruction.evict_cache_idx_vector.size());
+  }
+
+  /*
+      bound the rows of table. sum of min_rows over tables must fit the pool, and a batch
+      referencing more distinct ids of a table than its max_rows is rejected.
+  */
+  void set_quota(long table, long min_rows, long max_rows) {
+    if (table < 0 || table >= table_num_ || min_rows < 0 || min_rows > max_rows) {
+      throw std::runtime_error("Error: invalid quota.");
+    }
+    long min_sum = min_rows;
+    for (long t = 0; t < table_num_; t++) {
+      min_sum += t != table ? min_rows_[t] : 0;
+    }
+    if (min_sum > cache_capacity_) {
+      throw std::runtime_error("Error: min quotas exceed cache capacity.");
+    }
+    min_rows_[table] = min_rows;
+    max_rows_[table] = max_rows;
+  }
+
+  long table_num() const { return table_num_; }
+  long row_num(long table) const { return row_num_[table]; }  // rows table holds now
+
+  void init_state() {
+    index_.clear();
+    freq_list_.clear();
+    std::fill(cache_cpu_match_.begin(), cache_cpu_match_.end(), -1);
+    std::fill(slot_table_.begin(), slot_table_.end(), -1);
+    std::fill(row_num_.begin(), row_num_.end(), 0);
+    available_cache_idxs_.clear();
+    for (long i = cache_capacity_ - 1; i >= 0; i--) {
+      available_cache_idxs_.push_back(i);
+    }
+  }
+
+  long memory_bytes() const {
+    return index_.memory_bytes() + freq_list_.memory_bytes() +
+           (cache_cpu_match_.capacity() + slot_table_.capacity()) * sizeof(long) +
+           masked_.capacity() * sizeof(uint8_t) +
+           (masked_slots_.capacity() + available_cache_idxs_.capacity()) * sizeof(int);
+  }
+
+ private:
+  long cache_capacity_ = 0;
+  long table_num_ = 0;
+  FlatHashIndex index_;                // (table, cpu_idx) key -> slot
+  FlatFreqList freq_list_;             // one list per table
+  std::vector<long> cache_cpu_match_;  // slot -> cpu_idx
+  std::vector<long> slot_table_;       // slot -> table
+  std::vector<uint8_t> masked_;
+  std::vector<int> masked_slots_;  // record for faster de-mask
+  std::vector<int> available_cache_idxs_;
+  // per table
+  std::vector<long> min_rows_;
+  std::vector<long> max_rows_;
+  std::vector<long> row_num_;
+  // per-batch victim candidates: (tail freq when pushed, push stamp, table), min-heap
+  std::vector<std::tuple<long, long, long>> candidate_heap_;
+  std::vector<uint8_t> in_heap_;
+  long candidate_stamp_ = 0;
+  // per-batch scratch
+  std::vector<long> table_idx_vector_;
+  std::vector<long> key_vector_;
+  BatchIdSet batch_keys_;
+  std::vector<long> distinct_num_;  // per table
+  std::vector<long> admit_table_vector_;
+  std::vector<long> evict_table_vector_;
+  std::vector<long> group_fill_;
+  std::vector<long> group_cpu_idx_vector_;
+  std::vector<long> group_cache_idx_vector_;
+
+  long make_key(long table, long cpu_idx) const {
+    if (table < 0 || table >= table_num_ || cpu_idx < 0 || cpu_idx >= (1L << kTableShift)) {
+      throw std::runtime_error("Error: table or cpu idx out of range.");
+    }
+    return (table << kTableShift) | cpu_idx;
+  }
+
+  int admit_cache(long table, long cpu_idx, long key) {
+    auto slot = available_cache_idxs_.back();
+    available_cache_idxs_.pop_back();
+    cache_cpu_match_[slot] = cpu_idx;
+    slot_table_[slot] = table;
+    row_num_[table]++;
+    index_.insert(key, slot);
+    freq_list_.push_front(slot, table);
+    push_candidate(table);  // the table may have just climbed above its min quota
+    return slot;
+  }
+
+  void push_candidate(long table) {
+    if (in_heap_[table] || row_num_[table] <= min_rows_[table]) {
+      return;
+    }
+    auto slot = table_tail(table);
+    if (slot == -1) {
+      return;
+    }
+    candidate_heap_.emplace_back(freq_list_.freq(slot), candidate_stamp_++, table);
+    std::push_heap(candidate_heap_.begin(), candidate_heap_.end(), std::greater<>());
+    in_heap_[table] = 1;
+  }
+
+  /* first unmasked slot of table's list, -1 if none. moves the table's cursor there */
+  int table_tail(long table) {
+    auto slot = freq_list_.tail(table);
+    while (slot != -1 && masked_[slot]) {
+      slot = freq_list_.next(slot);
+    }
+    freq_list_.set_tail(slot, table);
+    return slot;
+  }
+
+  /*
+      fill key_vector_ and reject the batch before it changes anything. a miss of table t
+      can fail only when every table u holds at most max(d_u, min(min_rows_u, rows_u + d_u))
+      rows (d_u: distinct ids of u in the batch) and t one less, so the pool holding the sum
+      of those bounds over all tables makes every miss succeed. a table at its max quota
+      evicts its own rows, which needs d_t <= max_rows_t.
+  */
+  void check_batch(const long* table_idx_ptr, const long* cpu_idx_ptr, long n) {
+    key_vector_.resize(n);
+    batch_keys_.clear();
+    distinct_num_.assign(table_num_, 0);
+    for (long i = 0; i < n; i++) {
+      key_vector_[i] = make_key(table_idx_ptr[i], cpu_idx_ptr[i]);
+      if (!batch_keys_.contains(key_vector_[i])) {
+        batch_keys_.insert(key_vector_[i]);
+        distinct_num_[table_idx_ptr[i]]++;
+      }
+    }
+    long row_need = 0;
+    for (long t = 0; t < table_num_; t++) {
+      if (distinct_num_[t] > max_rows_[t]) {
+        throw std::runtime_error("Error: batch holds more ids of a table than its max quota.");
+      }
+      row_need +=
+          std::max(distinct_num_[t], std::min(min_rows_[t], row_num_[t] + distinct_num_[t]));
+    }
+    if (row_need > cache_capacity_) {
+      throw std::runtime_error("Error: no enough cache row num.");
+    }
+  }
+
+  /*
+      evict the LFU row of table if own, else of any table above its min quota, falling back
+      to table's own LFU row when min quotas protect every other candidate
+  */
+  int evict_cache(long table, bool own) {
+    long victim_table = -1;
+    int slot = -1;
+    if (!own) {
+      while (slot == -1 && !candidate_heap_.empty()) {
+        std::pop_heap(candidate_heap_.begin(), candidate_heap_.end(), std::greater<>());
+        auto key_freq = std::get<0>(candidate_heap_.back());
+        auto candidate_table = std::get<2>(candidate_heap_.back());
+        candidate_heap_.pop_back();
+        in_heap_[candidate_table] = 0;
+        if (row_num_[candidate_table] <= min_rows_[candidate_table]) {
+          continue;
+        }
+        auto candidate = table_tail(candidate_table);
+        if (candidate != -1 && freq_list_.freq(candidate) > key_freq) {
+          push_candidate(candidate_table);  // stale key
+        } else if (candidate != -1) {
+          slot = candidate;
+          victim_table = candidate_table;
+        }
+      }
+    }
+    if (slot == -1) {
+      victim_table = table;
+      slot = table_tail(table);
+    }
+    if (slot == -1) {  // check_batch rules this out
+      throw std::runtime_error("Error: no enough cache row num.");
+    }
+    freq_list_.set_tail(freq_list_.next(slot), victim_table);
+    freq_list_.erase(slot);
+    index_.erase(make_key(victim_table, cache_cpu_match_[slot]));
+    row_num_[victim_table]--;
+    available_cache_idxs_.push_back(slot);
+    push_candidate(victim_table);
+    return slot;
+  }
+
+  /* stable counting sort of the (cpu_idx, cache_idx) pairs by table, fills offsets */
+  void group_by_table(const std::vector<long>& table_vector, std::vector<long>& cpu_idx_vector,
+                      std::vector<long>& cache_idx_vector, std::vector<long>& offsets) {
+    offsets.assign(table_num_ + 1, 0);
+    for (auto table : table_vector) {
+      offsets[table + 1]++;
+    }
+    for (long t = 0; t < table_num_; t++) {
+      offsets[t + 1] += offsets[t];
+    }
+    long n = table_vector.size();
+    group_fill_.assign(offsets.begin(), offsets.end() - 1);
+    group_cpu_idx_vector_.resize(n);
+    group_cache_idx_vector_.resize(n);
+    for (long i = 0; i < n; i++) {
+      auto pos = group_fill_[table_vector[i]]++;
+      group_cpu_idx_vector_[pos] = cpu_idx_vector[i];
+      group_cache_idx_vector_[pos] = cache_idx_vector[i];
+    }
+    cpu_idx_vector.swap(group_cpu_idx_vector_);
+    cache_idx_vector.swap(group_cache_idx_vector_);
+  }
+};
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+/*
+    sort of (key, value) pairs by key, stable. when the key range is below the pair count it
+    is one counting sort, else an LSD radix sort of key - min_key, 8 bits per pass, skipping
+    the passes whose byte is the same in every key. O(n) per pass; scratch is kept across
+    calls.
+*/
+class RadixSorter {
+ public:
+  typedef std::pair<long, long> Pair;
+
+  void sort(std::vector<Pair>& pairs) {
+    long n = pairs.size();
+    if (n < 2) {
+      return;
+    }
+    auto min_key = pairs[0].first, max_key = pairs[0].first;
+    for (auto const& pair : pairs) {
+      min_key = std::min(min_key, pair.first);
+      max_key = std::max(max_key, pair.first);
+    }
+    auto range = static_cast<uint64_t>(max_key) - static_cast<uint64_t>(min_key);
+    scratch_.resize(n);
+    if (range < static_cast<uint64_t>(n)) {
+      count_vector_.assign(range + 2, 0);
+      for (auto const& pair : pairs) {
+        count_vector_[pair.first - min_key + 1]++;
+      }
+      for (uint64_t b = 0; b <= range; b++) {
+        count_vector_[b + 1] += count_vector_[b];
+      }
+      for (auto const& pair : pairs) {
+        scratch_[count_vector_[pair.first - min_key]++] = pair;
+      }
+      pairs.swap(scratch_);
+      return;
+    }
+    for (int shift = 0; shift < 64 && (range >> shift) != 0; shift += 8) {
+      long count[257] = {0};
+      for (auto const& pair : pairs) {
+        count[byte_of(pair.first - min_key, shift) + 1]++;
+      }
+      if (*std::max_element(count + 1, count + 257) == n) {
+        continue;
+      }
+      for (int b = 0; b < 256; b++) {
+        count[b + 1] += count[b];
+      }
+      for (auto const& pair : pairs) {
+        scratch_[count[byte_of(pair.first - min_key, shift)]++] = pair;
+      }
+      pairs.swap(scratch_);
+    }
+  }
+
+  /*
+      out = the k pairs (key_ptr[i], value_ptr[i]) with the largest keys, sorted by key,
+      ascending. keys <= 0 are never selected, ties at the k-th key are broken arbitrarily.
+      the k-th largest key is narrowed to a key range by 16-bit histogram passes over the
+      input (one for keys below 2^16, usually two), then one pass collects the pairs above
+      the range and the candidates inside it, which a selection cuts to size. O(n) time and
+      O(k) extra memory.
+  */
+  template <typename Value>
+  void select_top(const long* key_ptr, const Value* value_ptr, long n, long k,
+                  std::vector<Pair>& out) {
+    out.clear();
+    long max_key = 0;
+    for (long i = 0; i < n; i++) {
+      max_key = std::max(max_key, key_ptr[i]);
+    }
+    if (k <= 0 || max_key == 0) {
+      return;
+    }
+    // the k-th largest key lies in [low, high], need of the keys in it are taken
+    long low = 1, high = max_key, need = k;
+    while (true) {
+      int shift = 0;
+      while (((high - low) >> shift) >= kSelectBucketNum) {
+        shift++;
+      }
+      count_vector_.assign(kSelectBucketNum, 0);
+      for (long i = 0; i < n; i++) {
+        auto key = key_ptr[i];
+        bool in_range = key >= low && key <= high;
+        count_vector_[in_range ? (key - low) >> shift : 0] += in_range;
+      }
+      long bucket = (high - low) >> shift;
+      for (; bucket > 0 && count_vector_[bucket] < need; bucket--) {
+        need -= count_vector_[bucket];
+      }
+      high = std::min(high, low + ((bucket + 1) << shift) - 1);
+      low += bucket << shift;
+      if (count_vector_[bucket] <= need) {  // all of it, also when there are fewer than k keys
+        need = count_vector_[bucket];
+        break;
+      }
+      if (shift == 0 || count_vector_[bucket] <= 2 * need) {
+        break;
+      }
+    }
+    out.reserve(std::min(n, k));
+    scratch_.clear();
+    for (long i = 0; i < n; i++) {
+      auto key = key_ptr[i];
+      if (key > high) {
+        out.emplace_back(key, value_ptr[i]);
+      } else if (key >= low) {
+        if (low == high) {  // one key value, the first need of them
+          if (need > 0) {
+            out.emplace_back(key, value_ptr[i]);
+            need--;
+          }
+        } else {
+          scratch_.emplace_back(key, value_ptr[i]);
+        }
+      }
+    }
+    if ((long)scratch_.size() > need) {
+      std::nth_element(scratch_.begin(), scratch_.begin() + need, scratch_.end(),
+                       [](const Pair& a, const Pair& b) { return a.first > b.first; });
+      scratch_.resize(need);
+    }
+    out.insert(out.end(), scratch_.begin(), scratch_.end());
+    sort(out);
+  }
+
+  /*
+      unique op: unique = the distinct keys of key_ptr[0, n), ascending, count[i] = how often
+      unique[i] occurs. keys are sorted as key - min_key, so only the bits the keys span are
+      sorted:
+          chunk_num * range within 2n: per-chunk histograms over the key range, merged in
+                          key order (no more scratch than the radix sort's 2n keys),
+          else:           LSD radix sort, up to kUniqueDigitBits bits per pass, passes whose
+                          digit is the same in every key skipped, then a run count.
+      with a pool the input is cut into one chunk per thread (chunks of at least
+      kMinChunkSize keys) and every pass runs chunk-parallel, stable by chunk order.
+  */
+  template <typename Key>
+  void unique_count(const Key* key_ptr, long n, std::vector<Key>& unique,
+                    std::vector<long>& count, ThreadPool* pool = nullptr) {
+    unique.clear();
+    count.clear();
+    if (n <= 0) {
+      return;
+    }
+    long chunk_num = 1;
+    if (pool) {
+      chunk_num = std::max(1L, std::min(pool->thread_num(), n / kMinChunkSize));
+    }
+    /* step 1. key range */
+    chunk_min_.assign(chunk_num, key_ptr[0]);
+    chunk_max_.assign(chunk_num, key_ptr[0]);
+    for_chunks(pool, chunk_num, n, [&](long c, long begin, long end) {
+      auto min_key = key_ptr[begin], max_key = key_ptr[begin];
+      for (long i = begin; i < end; i++) {
+        min_key = std::min(min_key, key_ptr[i]);
+        max_key = std::max(max_key, key_ptr[i]);
+      }
+      chunk_min_[c] = min_key;
+      chunk_max_[c] = max_key;
+    });
+    auto min_key = *std::min_element(chunk_min_.begin(), chunk_min_.end());
+    auto max_key = *std::max_element(chunk_max_.begin(), chunk_max_.end());
+    auto range = static_cast<uint64_t>(max_key) - static_cast<uint64_t>(min_key);
+    if (range < 2 * static_cast<uint64_t>(n) &&
+        static_cast<uint64_t>(chunk_num) * (range + 1) <= 2 * static_cast<uint64_t>(n)) {
+      histogram_unique(key_ptr, n, min_key, range + 1, chunk_num, pool, unique, count);
+      return;
+    }
+    /* step 2. radix sort of key - min_key */
+    key_vector_.resize(n);
+    key_scratch_.resize(n);
+    for_chunks(pool, chunk_num, n, [&](long, long begin, long end) {
+      for (long i = begin; i < end; i++) {
+        key_vector_[i] = static_cast<uint64_t>(key_ptr[i]) - static_cast<uint64_t>(min_key);
+      }
+    });
+    int bits = 64 - __builtin_clzll(range);
+    int pass_num = (bits + kUniqueDigitBits - 1) / kUniqueDigitBits;
+    int digit_bits = (bits + pass_num - 1) / pass_num;
+    long digit_num = 1L << digit_bits;
+    uint64_t digit_mask = digit_num - 1;
+    for (int shift = 0; shift < bits; shift += digit_bits) {
+      hist_vector_.assign(chunk_num * digit_num, 0);
+      for_chunks(pool, chunk_num, n, [&](long c, long begin, long end) {
+        auto hist = hist_vector_.data() + c * digit_num;
+        for (long i = begin; i < end; i++) {
+          hist[(key_vector_[i] >> shift) & digit_mask]++;
+        }
+      });
+      // exclusive offsets in (digit, chunk) order, a pass is skipped when one digit summed
+      // over all chunks holds every key
+      long offset = 0;
+      bool uniform = false;
+      for (long d = 0; d < digit_num && !uniform; d++) {
+        long digit_size = 0;
+        for (long c = 0; c < chunk_num; c++) {
+          digit_size += hist_vector_[c * digit_num + d];
+        }
+        uniform = digit_size == n;
+        for (long c = 0; c < chunk_num; c++) {
+          auto size = hist_vector_[c * digit_num + d];
+          hist_vector_[c * digit_num + d] = offset;
+          offset += size;
+        }
+      }
+      if (uniform) {
+        continue;
+      }
+      for_chunks(pool, chunk_num, n, [&](long c, long begin, long end) {
+        auto hist = hist_vector_.data() + c * digit_num;
+        for (long i = begin; i < end; i++) {
+          auto key = key_vector_[i];
+          key_scratch_[hist[(key >> shift) & digit_mask]++] = key;
+        }
+      });
+      key_vector_.swap(key_scratch_);
+    }
+    /* step 3. runs: count the run starts per chunk (branch free), then write each run */
+    chunk_offset_.assign(chunk_num + 1, 0);
+    for_chunks(pool, chunk_num, n, [&](long c, long begin, long end) {
+      long start_num = begin == 0 ? 1 : key_vector_[begin] != key_vector_[begin - 1];
+      for (long i = begin + 1; i < end; i++) {
+        start_num += key_vector_[i] != key_vector_[i - 1];
+      }
+      chunk_offset_[c + 1] = start_num;
+    });
+    for (long c = 0; c < chunk_num; c++) {
+      chunk_offset_[c + 1] += chunk_offset_[c];
+    }
+    long unique_num = chunk_offset_[chunk_num];
+    unique.resize(unique_num);
+    count.resize(unique_num);
+    run_start_.resize(unique_num + 1);
+    run_start_[unique_num] = n;
+    for_chunks(pool, chunk_num, n, [&](long c, long begin, long end) {
+      auto m = chunk_offset_[c];
+      for (long i = begin; i < end; i++) {
+        if (i == 0 || key_vector_[i] != key_vector_[i - 1]) {
+          unique[m] = static_cast<Key>(key_vector_[i] + static_cast<uint64_t>(min_key));
+          run_start_[m++] = i;
+        }
+      }
+    });
+    for_chunks(pool, chunk_num, unique_num, [&](long, long begin, long end) {
+      for (long m = begin; m < end; m++) {
+        count[m] = run_start_[m + 1] - run_start_[m];
+      }
+    });
+  }
+
+ private:
+  static const long kSelectBucketNum = 1L << 16;
+  static const int kUniqueDigitBits = 11;
+  static const long kMinChunkSize = 1L << 15;
+
+  std::vector<Pair> scratch_;
+  std::vector<long> count_vector_;
+  // unique_count scratch
+  std::vector<uint64_t> key_vector_;
+  std::vector<uint64_t> key_scratch_;
+  std::vector<long> hist_vector_;  // chunk-major histograms, then offsets
+  std::vector<long> chunk_min_;
+  std::vector<long> chunk_max_;
+  std::vector<long> chunk_offset_;
+  std::vector<long> run_start_;
+
+  /* fn(c, begin, end) for chunk c of chunk_num near-equal chunks of [0, n) */
+  template <typename Fn>
+  static void for_chunks(ThreadPool* pool, long chunk_num, long n, const Fn& fn) {
+    auto chunk = [&](long c) { fn(c, n * c / chunk_num, n * (c + 1) / chunk_num); };
+    if (pool && chunk_num > 1) {
+      pool->parallel_for(chunk_num, chunk);
+    } else {
+      for (long c = 0; c < chunk_num; c++) {
+        chunk(c);
+      }
+    }
+  }
+
+  /* unique_count for keys in [min_key, min_key + bucket_num): one histogram per chunk, then
+     key slices merge the chunk histograms and write their distinct keys in order */
+  template <typename Key>
+  void histogram_unique(const Key* key_ptr, long n, long min_key, long bucket_num,
+                        long chunk_num, ThreadPool* pool, std::vector<Key>& unique,
+                        std::vector<long>& count) {
+    hist_vector_.resize(chunk_num * bucket_num);
+    for_chunks(pool, chunk_num, n, [&](long c, long begin, long end) {
+      auto hist = hist_vector_.data() + c * bucket_num;
+      std::fill(hist, hist + bucket_num, 0);  // each chunk zeroes its own histogram
+      for (long i = begin; i < end; i++) {
+        hist[key_ptr[i] - min_key]++;
+      }
+    });
+    chunk_offset_.assign(chunk_num + 1, 0);
+    for_chunks(pool, chunk_num, bucket_num, [&](long c, long begin, long end) {
+      long distinct_num = 0;
+      for (long b = begin; b < end; b++) {
+        auto total = hist_vector_[b];
+        for (long h = 1; h < chunk_num; h++) {
+          total += hist_vector_[h * bucket_num + b];
+        }
+        hist_vector_[b] = total;
+        distinct_num += total != 0;
+      }
+      chunk_offset_[c + 1] = distinct_num;
+    });
+    for (long c = 0; c < chunk_num; c++) {
+      chunk_offset_[c + 1] += chunk_offset_[c];
+    }
+    unique.resize(chunk_offset_[chunk_num]);
+    count.resize(chunk_offset_[chunk_num]);
+    for_chunks(pool, chunk_num, bucket_num, [&](long c, long begin, long end) {
+      auto m = chunk_offset_[c];
+      for (long b = begin; b < end; b++) {
+        if (hist_vector_[b] != 0) {
+          unique[m] = static_cast<Key>(min_key + b);
+          count[m++] = hist_vector_[b];
+        }
+      }
+    });
+  }
+
+  static int byte_of(uint64_t key, int shift) { return (key >> shift) & 0xff; }
+};
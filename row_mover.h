@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "cache_instruction.h"
+#include "thread_pool.h"
+
+/*
+    reference host data plane for the managers' instructions. owns a backing table of
+    cpu_row_num rows and a cache table of cache_row_num rows, row_width floats each, and
+    executes a batch's instruction on them:
+        1. write back: evicted cache rows -> backing rows,
+        2. load: admitted backing rows -> cache rows,
+        3. gather: the cache rows of gpu_idx_vector -> a dense output batch.
+    write back must finish before load, a load may reuse an evicted row.
+    copies are split into chunks of at most kChunkRows rows and spread over a ThreadPool.
+    write back uses non-temporal stores (the rows go cold), load and gather prefetch the
+    next source row. when the manager filled out.admit_run_vector / evict_run_vector
+    (set_transfer_plan), the runs are copied instead of the index pairs.
+*/
+class RowMover {
+ public:
+  static const long kChunkRows = 64;
+  static const long kRowAlignFloats = 16;  // rows start on a cache line
+
+  RowMover(long cpu_row_num, long cache_row_num, long row_width, long thread_num = 1)
+      : cpu_row_num_(cpu_row_num),
+        cache_row_num_(cache_row_num),
+        row_width_(row_width),
+        row_stride_((row_width + kRowAlignFloats - 1) / kRowAlignFloats * kRowAlignFloats),
+        backing_(allocate(cpu_row_num * row_stride_)),
+        cache_(allocate(cache_row_num * row_stride_)),
+        pool_(thread_num) {
+    if (cpu_row_num <= 0 || cache_row_num <= 0 || row_width <= 0) {
+      throw std::runtime_error("Error: invalid row mover shape.");
+    }
+    pool_.parallel_for(kInitTaskNum, [this](long t) {
+      zero_rows(backing_.get(), cpu_row_num_, t);
+      zero_rows(cache_.get(), cache_row_num_, t);
+    });
+  }
+
+  RowMover(const RowMover&) = delete;
+  RowMover& operator=(const RowMover&) = delete;
+
+  long row_width() const { return row_width_; }
+  long row_stride() const { return row_stride_; }  // floats between consecutive rows
+  long thread_num() const { return pool_.thread_num(); }
+  float* backing_row(long cpu_idx) { return backing_.get() + cpu_idx * row_stride_; }
+  float* cache_row(long cache_idx) { return cache_.get() + cache_idx * row_stride_; }
+
+  /* write back, then load. returns the rows moved */
+  long apply(const CacheInstructionBuffer& out) {
+    write_back(out);
+    load(out);
+    return out.evict_cache_idx_vector.size() + out.admit_cpu_idx_vector.size();
+  }
+
+  /* the two halves of apply, for a caller that moves backing rows in between */
+  void write_back(const CacheInstructionBuffer& out) {
+    if (!out.evict_run_vector.empty() || !out.admit_run_vector.empty()) {
+      copy_runs(out.evict_run_vector, cache_.get(), cache_row_num_, backing_.get(), cpu_row_num_,
+                true);
+    } else {
+      copy_pairs(out.evict_cache_idx_vector, out.evict_to_cpu_idx_vector, cache_.get(),
+                 cache_row_num_, backing_.get(), cpu_row_num_, true);
+    }
+  }
+
+  void load(const CacheInstructionBuffer& out) {
+    if (!out.evict_run_vector.empty() || !out.admit_run_vector.empty()) {
+      copy_runs(out.admit_run_vector, backing_.get(), cpu_row_num_, cache_.get(), cache_row_num_,
+                false);
+    } else {
+      copy_pairs(out.admit_cpu_idx_vector, out.admit_to_cache_idx_vector, backing_.get(),
+                 cpu_row_num_, cache_.get(), cache_row_num_, false);
+    }
+  }
+
+  long apply(const CacheInstruction& instruction) {
+    copy_pairs(std::get<3>(instruction), std::get<4>(instruction), cache_.get(), cache_row_num_,
+               backing_.get(), cpu_row_num_, true);
+    copy_pairs(std::get<1>(instruction), std::get<2>(instruction), backing_.get(), cpu_row_num_,
+               cache_.get(), cache_row_num_, false);
+    return std::get<3>(instruction).size() + std::get<1>(instruction).size();
+  }
+
+  /*
+      row i of batch_out (row_width floats, densely packed) = cache row gpu_idx_vector[i].
+      gpu idx -1 (an id bypassed by the admission filter) reads backing row cpu_idx_ptr[i].
+  */
+  void gather(const std::vector<long>& gpu_idx_vector, float* batch_out,
+              const long* cpu_idx_ptr = nullptr) {
+    long n = gpu_idx_vector.size();
+    for (long i = 0; i < n; i++) {
+      if (gpu_idx_vector[i] == -1 && cpu_idx_ptr) {
+        check_row(cpu_idx_ptr[i], cpu_row_num_);
+      } else {
+        check_row(gpu_idx_vector[i], cache_row_num_);
+      }
+    }
+    auto task_num = (n + kChunkRows - 1) / kChunkRows;
+    pool_.parallel_for(task_num, [&](long t) {
+      auto end = std::min(n, (t + 1) * kChunkRows);
+      for (long i = t * kChunkRows; i < end; i++) {
+        if (i + 1 < end && gpu_idx_vector[i + 1] != -1) {
+          __builtin_prefetch(cache_row(gpu_idx_vector[i + 1]));
+        }
+        auto src = gpu_idx_vector[i] != -1 ? cache_row(gpu_idx_vector[i])
+                                           : backing_row(cpu_idx_ptr[i]);
+        memcpy(batch_out + i * row_width_, src, sizeof(float) * row_width_);
+      }
+    });
+  }
+
+ private:
+  static const long kInitTaskNum = 64;
+
+  struct FreeDeleter {
+    void operator()(float* ptr) const { free(ptr); }
+  };
+
+  long cpu_row_num_;
+  long cache_row_num_;
+  long row_width_;
+  long row_stride_;
+  std::unique_ptr<float[], FreeDeleter> backing_;
+  std::unique_ptr<float[], FreeDeleter> cache_;
+  ThreadPool pool_;
+  std::vector<CopyRun> chunk_vector_;  // scratch, the batch's copies cut into chunks
+
+  static float* allocate(long float_num) {
+    auto bytes = std::max(1L, float_num) * sizeof(float);
+    bytes = (bytes + 63) / 64 * 64;
+    auto ptr = static_cast<float*>(aligned_alloc(64, bytes));
+    if (!ptr) {
+      throw std::runtime_error("Error: cannot allocate row table.");
+    }
+    return ptr;
+  }
+
+  void zero_rows(float* table, long row_num, long t) {
+    auto begin = row_num * t / kInitTaskNum;
+    auto end = row_num * (t + 1) / kInitTaskNum;
+    memset(table + begin * row_stride_, 0, sizeof(float) * (end - begin) * row_stride_);
+  }
+
+  static void check_row(long idx, long row_num) {
+    if (idx < 0 || idx >= row_num) {
+      throw std::runtime_error("Error: row index out of range.");
+    }
+  }
+
+  void copy_pairs(const std::vector<long>& src, const std::vector<long>& dst,
+                  const float* src_table, long src_row_num, float* dst_table, long dst_row_num,
+                  bool non_temporal) {
+    chunk_vector_.clear();
+    for (size_t i = 0; i < src.size(); i++) {
+      check_row(src[i], src_row_num);
+      check_row(dst[i], dst_row_num);
+      chunk_vector_.push_back({src[i], dst[i], 1});
+    }
+    run_chunks(src_table, dst_table, non_temporal);
+  }
+
+  void copy_runs(const std::vector<CopyRun>& runs, const float* src_table, long src_row_num,
+                 float* dst_table, long dst_row_num, bool non_temporal) {
+    chunk_vector_.clear();
+    for (auto const& run : runs) {
+      check_row(run.src_start, src_row_num);
+      check_row(run.src_start + run.length - 1, src_row_num);
+      check_row(run.dst_start, dst_row_num);
+      check_row(run.dst_start + run.length - 1, dst_row_num);
+      for (long offset = 0; offset < run.length; offset += kChunkRows) {
+        chunk_vector_.push_back({run.src_start + offset, run.dst_start + offset,
+                                 std::min(kChunkRows, run.length - offset)});
+      }
+    }
+    run_chunks(src_table, dst_table, non_temporal);
+  }
+
+  /* single rows are grouped kChunkRows per task, runs are already cut to kChunkRows */
+  void run_chunks(const float* src_table, float* dst_table, bool non_temporal) {
+    long n = chunk_vector_.size();
+    auto task_num = (n + kChunkRows - 1) / kChunkRows;
+    pool_.parallel_for(task_num, [&](long t) {
+      auto end = std::min(n, (t + 1) * kChunkRows);
+      for (long i = t * kChunkRows; i < end; i++) {
+        auto const& chunk = chunk_vector_[i];
+        if (i + 1 < end) {
+          __builtin_prefetch(src_table + chunk_vector_[i + 1].src_start * row_stride_);
+        }
+        copy_rows(dst_table + chunk.dst_start * row_stride_,
+                  src_table + chunk.src_start * row_stride_, chunk.length, non_temporal);
+      }
+#ifdef __SSE2__
+      if (non_temporal) {
+        _mm_sfence();
+      }
+#endif
+    });
+  }
+
+  /* length consecutive rows. padding between rows is copied too, it is never read */
+  void copy_rows(float* dst, const float* src, long length, bool non_temporal) {
+    long float_num = length * row_stride_;
+#ifdef __SSE2__
+    if (non_temporal) {
+      // row_stride_ is a multiple of 16 floats and tables are 64-byte aligned
+      auto d = reinterpret_cast<__m128i*>(dst);
+      auto s = reinterpret_cast<const __m128i*>(src);
+      for (long i = 0; i < float_num / 4; i++) {
+        _mm_stream_si128(d + i, _mm_load_si128(s + i));
+      }
+      return;
+    }
+#endif
+    memcpy(dst, src, sizeof(float) * float_num);
+  }
+};
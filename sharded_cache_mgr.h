@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "cache_instruction.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+/*
+    N independent managers, each owning cache rows [shard_offset, shard_offset + shard_capacity)
+    and the cpu indices hashed to it. a batch is partitioned by shard, the shards run in
+    parallel on a thread pool and their instructions are merged back:
+        gpu_idx_vector keeps the input order, an id a shard's admission filter bypassed
+        keeps gpu idx -1,
+        admit/evict/bypass vectors are concatenated in shard order.
+    LFU is per shard, so global accuracy is slightly lower than one manager of the same
+    total capacity. hit_rate() measures that tradeoff.
+
+    Manager must be constructible from a capacity and provide
+    prepare_ids(const long*, long, CacheInstructionBuffer&).
+*/
+template <typename Manager>
+class ShardedCacheIndicesManager {
+ public:
+  ShardedCacheIndicesManager(long cache_capacity, long shard_num, long thread_num = 0)
+      : pool_(thread_num > 0 ? thread_num : shard_num) {
+    if (shard_num <= 0 || shard_num > cache_capacity) {
+      throw std::runtime_error("Error: invalid shard num.");
+    }
+    long offset = 0;
+    for (long s = 0; s < shard_num; s++) {
+      auto shard_capacity = cache_capacity / shard_num + (s < cache_capacity % shard_num);
+      shards_.emplace_back(new Manager(shard_capacity));
+      shard_offset_.push_back(offset);
+      offset += shard_capacity;
+    }
+    shard_out_.resize(shard_num);
+    shard_begin_.resize(shard_num + 1);
+    admit_begin_.resize(shard_num + 1);
+    evict_begin_.resize(shard_num + 1);
+    bypass_begin_.resize(shard_num + 1);
+    bypass_lookup_num_.resize(shard_num);
+  }
+
+  CacheInstruction prepare_ids(const std::vector<long>& cpu_idx_vector) {
+    CacheInstructionBuffer out;
+    out.reserve(cpu_idx_vector.size());
+    prepare_ids(cpu_idx_vector.data(), cpu_idx_vector.size(), out);
+    return std::move(out).to_instruction();
+  }
+
+  std::tuple<long, long> prepare_ids(const long* cpu_idx_ptr, long n, CacheInstructionBuffer& out) {
+    long shard_num = shards_.size();
+    out.clear();
+    if (trace_writer_) {
+      trace_writer_->append(cpu_idx_ptr, n);
+    }
+    // partition op: counting sort by shard, remember each id's input position
+    {
+      std::fill(shard_begin_.begin(), shard_begin_.end(), 0);
+      for (long i = 0; i < n; i++) {
+        shard_begin_[shard_of(cpu_idx_ptr[i]) + 1]++;
+      }
+      for (long s = 0; s < shard_num; s++) {
+        shard_begin_[s + 1] += shard_begin_[s];
+      }
+      shard_cpu_idx_vector_.resize(n);
+      input_pos_vector_.resize(n);
+      shard_fill_.assign(shard_begin_.begin(), shard_begin_.end() - 1);
+      for (long i = 0; i < n; i++) {
+        auto pos = shard_fill_[shard_of(cpu_idx_ptr[i])]++;
+        shard_cpu_idx_vector_[pos] = cpu_idx_ptr[i];
+        input_pos_vector_[pos] = i;
+      }
+    }
+    // cache op on each shard
+    pool_.parallel_for(shard_num, [&](long s) {
+      shards_[s]->prepare_ids(shard_cpu_idx_vector_.data() + shard_begin_[s],
+                              shard_begin_[s + 1] - shard_begin_[s], shard_out_[s]);
+    });
+    // merge op
+    admit_begin_[0] = evict_begin_[0] = bypass_begin_[0] = 0;
+    for (long s = 0; s < shard_num; s++) {
+      admit_begin_[s + 1] = admit_begin_[s] + shard_out_[s].admit_cpu_idx_vector.size();
+      evict_begin_[s + 1] = evict_begin_[s] + shard_out_[s].evict_cache_idx_vector.size();
+      bypass_begin_[s + 1] = bypass_begin_[s] + shard_out_[s].bypass_cpu_idx_vector.size();
+    }
+    out.gpu_idx_vector.resize(n);
+    out.admit_cpu_idx_vector.resize(admit_begin_[shard_num]);
+    out.admit_to_cache_idx_vector.resize(admit_begin_[shard_num]);
+    out.evict_cache_idx_vector.resize(evict_begin_[shard_num]);
+    out.evict_to_cpu_idx_vector.resize(evict_begin_[shard_num]);
+    out.bypass_cpu_idx_vector.resize(bypass_begin_[shard_num]);
+    pool_.parallel_for(shard_num, [&](long s) {
+      auto const& shard_out = shard_out_[s];
+      auto offset = shard_offset_[s];
+      auto input_pos = input_pos_vector_.data() + shard_begin_[s];
+      long bypass_lookup_num = 0;
+      for (size_t j = 0; j < shard_out.gpu_idx_vector.size(); j++) {
+        auto gpu_idx = shard_out.gpu_idx_vector[j];
+        bypass_lookup_num += gpu_idx == -1;
+        out.gpu_idx_vector[input_pos[j]] = gpu_idx == -1 ? -1 : gpu_idx + offset;
+      }
+      bypass_lookup_num_[s] = bypass_lookup_num;
+      for (size_t j = 0; j < shard_out.admit_cpu_idx_vector.size(); j++) {
+        out.admit_cpu_idx_vector[admit_begin_[s] + j] = shard_out.admit_cpu_idx_vector[j];
+        out.admit_to_cache_idx_vector[admit_begin_[s] + j] =
+            shard_out.admit_to_cache_idx_vector[j] + offset;
+      }
+      for (size_t j = 0; j < shard_out.evict_cache_idx_vector.size(); j++) {
+        out.evict_cache_idx_vector[evict_begin_[s] + j] =
+            shard_out.evict_cache_idx_vector[j] + offset;
+        out.evict_to_cpu_idx_vector[evict_begin_[s] + j] = shard_out.evict_to_cpu_idx_vector[j];
+      }
+      std::copy(shard_out.bypass_cpu_idx_vector.begin(), shard_out.bypass_cpu_idx_vector.end(),
+                out.bypass_cpu_idx_vector.begin() + bypass_begin_[s]);
+    });
+    auto admit_num = admit_begin_[shard_num];
+    lookup_num_ += n;
+    hit_num_ += n - admit_num;
+    for (long s = 0; s < shard_num; s++) {
+      hit_num_ -= bypass_lookup_num_[s];
+    }
+    return std::tuple<long, long>(admit_num, evict_begin_[shard_num]);
+  }
+
+  long shard_num() const { return shards_.size(); }
+  Manager& shard(long s) { return *shards_[s]; }
+  long shard_offset(long s) const { return shard_offset_[s]; }
+
+  // ids served from a cache row without admission / all ids, since construction or last reset
+  long lookup_num() const { return lookup_num_; }
+  long hit_num() const { return hit_num_; }
+  double hit_rate() const { return lookup_num_ > 0 ? double(hit_num_) / lookup_num_ : 0.0; }
+  void reset_hit_counter() { lookup_num_ = hit_num_ = 0; }
+
+  /* record every prepare_ids input to writer (not owned), before partitioning */
+  void set_trace_writer(TraceWriter* writer) { trace_writer_ = writer; }
+
+ private:
+  ThreadPool pool_;
+  std::vector<std::unique_ptr<Manager>> shards_;
+  std::vector<long> shard_offset_;  // shard -> first cache row it owns
+  std::vector<CacheInstructionBuffer> shard_out_;
+
+  // per-batch scratch
+  std::vector<long> shard_begin_;  // shard -> begin in shard_cpu_idx_vector_
+  std::vector<long> shard_fill_;
+  std::vector<long> shard_cpu_idx_vector_;
+  std::vector<long> input_pos_vector_;  // partitioned position -> input position
+  std::vector<long> admit_begin_;
+  std::vector<long> evict_begin_;
+  std::vector<long> bypass_begin_;
+  std::vector<long> bypass_lookup_num_;  // shard -> ids of the batch it bypassed
+
+  long lookup_num_ = 0;
+  long hit_num_ = 0;
+  TraceWriter* trace_writer_ = nullptr;
+
+  long shard_of(long cpu_idx) const {
+    auto h = static_cast<uint64_t>(cpu_idx) * 0x9E3779B97F4A7C15ull;
+    return static_cast<long>((h >> 32) % shards_.size());
+  }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/*
+    manager state snapshot: a fixed 128-byte header followed by int64 sections in an order
+    fixed by the manager kind. everything is 8-byte aligned and stored in native byte order,
+    so a restore reads the sections straight out of an mmap of the file.
+*/
+namespace snapshot_format {
+static const char kMagic[8] = {'L', 'F', 'U', 'S', 'N', 'A', 'P', '\0'};
+static const uint32_t kVersion = 1;
+static const uint32_t kByteOrder = 0x01020304;
+
+enum SnapshotKind : uint32_t { kCacheIndicesManager = 1, kSortCacheIndicesManager = 2 };
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t kind;
+  uint32_t byte_order;
+  uint32_t reserved0;
+  int64_t capacity;  // cache rows
+  int64_t row_num;   // cached rows
+  int64_t free_num;  // free-slot stack size
+  int64_t aging_epoch;
+  int64_t aging_pass_epoch;
+  int64_t aging_batch_count;
+  int64_t aging_cursor;
+  int64_t reserved[6];
+};
+static_assert(sizeof(SnapshotHeader) == 128, "snapshot header must stay 128 bytes");
+static_assert(sizeof(long) == sizeof(int64_t), "snapshot sections are stored as long");
+
+inline SnapshotHeader make_header(SnapshotKind kind) {
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.kind = kind;
+  header.byte_order = kByteOrder;
+  return header;
+}
+}  // namespace snapshot_format
+
+class SnapshotWriter {
+ public:
+  SnapshotWriter(const std::string& path) {
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+      throw std::runtime_error("Error: cannot open snapshot " + path);
+    }
+  }
+
+  SnapshotWriter(const SnapshotWriter&) = delete;
+  SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+  ~SnapshotWriter() {
+    if (file_) {
+      fclose(file_);
+    }
+  }
+
+  void write_header(const snapshot_format::SnapshotHeader& header) {
+    write(&header, sizeof(header));
+  }
+
+  void write_section(const long* data, long n) { write(data, sizeof(long) * n); }
+
+  /* narrower integer arrays are widened, sections are always longs on disk */
+  template <typename T>
+  void write_section(const T* data, long n) {
+    long buffer[1024];
+    for (long i = 0; i < n; i += 1024) {
+      auto m = std::min<long>(1024, n - i);
+      std::copy(data + i, data + i + m, buffer);
+      write(buffer, sizeof(long) * m);
+    }
+  }
+
+  void close() {
+    auto ok = fclose(file_) == 0;
+    file_ = nullptr;
+    if (!ok) {
+      throw std::runtime_error("Error: snapshot write failed.");
+    }
+  }
+
+ private:
+  FILE* file_ = nullptr;
+
+  void write(const void* data, size_t bytes) {
+    if (bytes > 0 && fwrite(data, 1, bytes, file_) != bytes) {
+      throw std::runtime_error("Error: snapshot write failed.");
+    }
+  }
+};
+
+/* maps a snapshot and hands out its sections in order, without copying */
+class SnapshotReader {
+ public:
+  SnapshotReader(const std::string& path, snapshot_format::SnapshotKind kind) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      throw std::runtime_error("Error: cannot open snapshot " + path);
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || st.st_size < (long)sizeof(snapshot_format::SnapshotHeader)) {
+      unmap();
+      throw std::runtime_error("Error: not a snapshot " + path);
+    }
+    size_ = st.st_size;
+    auto addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd_, 0);
+    if (addr == MAP_FAILED) {
+      unmap();
+      throw std::runtime_error("Error: cannot mmap snapshot " + path);
+    }
+    data_ = static_cast<const char*>(addr);
+    memcpy(&header_, data_, sizeof(header_));
+    if (memcmp(header_.magic, snapshot_format::kMagic, sizeof(snapshot_format::kMagic)) != 0) {
+      unmap();
+      throw std::runtime_error("Error: not a snapshot " + path);
+    }
+    if (header_.version != snapshot_format::kVersion ||
+        header_.byte_order != snapshot_format::kByteOrder) {
+      unmap();
+      throw std::runtime_error("Error: unsupported snapshot version or byte order in " + path);
+    }
+    if (header_.kind != kind) {
+      unmap();
+      throw std::runtime_error("Error: snapshot of another manager kind in " + path);
+    }
+    pos_ = sizeof(header_);
+  }
+
+  SnapshotReader(const SnapshotReader&) = delete;
+  SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+  ~SnapshotReader() { unmap(); }
+
+  const snapshot_format::SnapshotHeader& header() const { return header_; }
+
+  /* next section of n longs */
+  const long* section(long n) {
+    if (n < 0 || n > (size_ - pos_) / (long)sizeof(long)) {
+      throw std::runtime_error("Error: truncated snapshot.");
+    }
+    auto ptr = reinterpret_cast<const long*>(data_ + pos_);
+    pos_ += sizeof(long) * n;
+    return ptr;
+  }
+
+ private:
+  int fd_ = -1;
+  const char* data_ = nullptr;
+  long size_ = 0;
+  long pos_ = 0;
+  snapshot_format::SnapshotHeader header_;
+
+  void unmap() {
+    if (data_) {
+      munmap(const_cast<char*>(data_), size_);
+      data_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+};
@@ -1,19 +1,36 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <cstring>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <limits>
 #include <list>
 #include <map>
+#include <memory>
 #include <set>
 #include <stack>
+#include <string>
 #include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "cache_instruction.h"
+#include "concurrent_index_table.h"
+#include "dense_index_map.h"
+#include "lookahead.h"
+#include "radix_sort.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "transfer_plan.h"
+#include "trace.h"
+
 struct cache_freq_ptr_cmp {
-  bool operator()(const long* p1, const long* p2) const {
+  template <typename Count>
+  bool operator()(const Count* p1, const Count* p2) const {
     if (*p1 == *p2) {
       return p1 < p2;
     }
@@ -21,90 +38,730 @@ struct cache_freq_ptr_cmp {
   }
 };
 
-class SortCacheIndicesManager {
+/*
+    cache rows grouped by freq: one exact bucket per freq in [0, kExactBucketNum), then every
+    freq octave above is split into 2^kSubBucketBits buckets, so a wider bucket spans freqs
+    within 1/16 of each other and bucket order is freq order. a bucket is a bitmap over the
+    rows with a summary
+    word per 64 words, so rows move in O(1) when their freq changes and come out of a bucket
+    in cache_idx order, skipping empty stretches 4096 rows at a time. a bucket's bitmap is
+    allocated on first use, about one bit per row.
+*/
+class FreqBucketIndex {
+ public:
+  static const int kExactBits = 8;
+  static const long kExactBucketNum = 1L << kExactBits;
+  static const int kSubBucketBits = 4;
+  static const long kBucketNum = kExactBucketNum + ((63 - kExactBits) << kSubBucketBits);
+
+  void init(long row_num) {
+    row_num_ = row_num;
+    buckets_.assign(kBucketNum, Bucket());
+    row_bucket_.assign(row_num, 0);
+    for (long row = 0; row < row_num; row++) {
+      set(0, row);
+    }
+  }
+
+  /* drop rows >= row_num, or add rows up to row_num into bucket 0 */
+  void resize(long row_num) {
+    long old_row_num = row_num_;
+    for (long row = row_num; row < old_row_num; row++) {
+      reset(row_bucket_[row], row);
+    }
+    row_num_ = row_num;
+    for (auto& bucket : buckets_) {
+      if (!bucket.words.empty()) {
+        bucket.words.resize(word_num(), 0);
+        bucket.summary.resize(summary_num(), 0);
+      }
+    }
+    row_bucket_.resize(row_num, 0);
+    for (long row = old_row_num; row < row_num; row++) {
+      set(0, row);
+    }
+  }
+
+  void move(long row, long freq) {
+    auto bucket = bucket_of(freq);
+    if (bucket != row_bucket_[row]) {
+      reset(row_bucket_[row], row);
+      set(bucket, row);
+      row_bucket_[row] = bucket;
+    }
+  }
+
+  static long bucket_of(long freq) {
+    if (freq < kExactBucketNum) {
+      return std::max(freq, 0L);
+    }
+    long octave = 63 - __builtin_clzll(freq);
+    return kExactBucketNum + ((octave - kExactBits) << kSubBucketBits) +
+           ((freq >> (octave - kSubBucketBits)) & ((1L << kSubBucketBits) - 1));
+  }
+  static bool exact(long bucket) { return bucket < kExactBucketNum; }  // one freq only
+  long size(long bucket) const { return buckets_[bucket].size; }
+
+  /* the first row >= row in bucket, -1 if there is none */
+  long next(long bucket, long row) const {
+    auto const& b = buckets_[bucket];
+    if (row >= row_num_ || b.size == 0) {
+      return -1;
+    }
+    long w = row >> 6;
+    auto bits = b.words[w] & (~0ULL << (row & 63));
+    if (bits) {
+      return (w << 6) + __builtin_ctzll(bits);
+    }
+    long s = (w + 1) >> 6;
+    if (s >= (long)b.summary.size()) {
+      return -1;
+    }
+    auto summary_bits = b.summary[s] & (~0ULL << ((w + 1) & 63));
+    while (!summary_bits) {
+      if (++s >= (long)b.summary.size()) {
+        return -1;
+      }
+      summary_bits = b.summary[s];
+    }
+    w = (s << 6) + __builtin_ctzll(summary_bits);
+    return (w << 6) + __builtin_ctzll(b.words[w]);
+  }
+
+ private:
+  struct Bucket {
+    std::vector<uint64_t> words;    // bit row & 63 of word row >> 6: row is in the bucket
+    std::vector<uint64_t> summary;  // bit w & 63 of word w >> 6: word w is not zero
+    long size = 0;
+  };
+
+  long row_num_ = 0;
+  std::vector<Bucket> buckets_;
+  std::vector<uint16_t> row_bucket_;
+  static_assert(kBucketNum <= 65536, "row_bucket_ holds a bucket in 16 bits");
+
+  long word_num() const { return (row_num_ + 63) >> 6; }
+  long summary_num() const { return (word_num() + 63) >> 6; }
+
+  void set(long bucket, long row) {
+    auto& b = buckets_[bucket];
+    if (b.words.empty()) {
+      b.words.assign(word_num(), 0);
+      b.summary.assign(summary_num(), 0);
+    }
+    long w = row >> 6;
+    b.words[w] |= 1ULL << (row & 63);
+    b.summary[w >> 6] |= 1ULL << (w & 63);
+    b.size++;
+  }
+
+  void reset(long bucket, long row) {
+    auto& b = buckets_[bucket];
+    long w = row >> 6;
+    b.words[w] &= ~(1ULL << (row & 63));
+    if (!b.words[w]) {
+      b.summary[w >> 6] &= ~(1ULL << (w & 63));
+    }
+    b.size--;
+  }
+};
+
+/*
+    how the swap op finds LFU victims.
+    kSet:    all rows kept in a std::set ordered by (freq, cache_idx). O(log C) per freq update.
+    kSelect: rows kept in FreqBucketIndex, victims selected per batch by walking the lowest
+             buckets in (freq, cache_idx) order up to the last victim; a bucket wider than
+             one freq is collected and partially sorted, the walk stops in the first one it
+             cannot take whole. O(1) per freq update, same victims as kSet.
+*/
+enum class SortEvictEngine { kSet, kSelect };
+
+/*
+    Index is the type of cpu and cache indices, Count the type of freqs; both signed, -1
+    marks protected freqs and empty rows. SortCacheIndicesManager is the long / long manager,
+    CompactSortCacheIndicesManager the int32_t / int32_t one: half the per-row arrays and
+    output bytes for capacity, cpu_row_num and ids below 2^31, freqs saturating at 2^31 - 1.
+*/
+template <typename Index = long, typename Count = long>
+class BasicSortCacheIndicesManager {
  public:
-  SortCacheIndicesManager(long cuda_row_num = 0, long cpu_row_num = 0) {
+  typedef BasicCacheInstructionBuffer<Index> InstructionBuffer;
+  typedef BasicConcurrentIndexTable<Index> LookupTable;
+
+  // prepare_ids phases timed with LFU_CACHE_PHASE_TIMERS, CacheCounters::phase_ns index
+  enum StatsPhase {
+    kUniquePhase,
+    kIsinPhase,
+    kSwapPhase,
+    kRestorePhase,
+    kUpdateFreqPhase,
+    kGatherPhase,
+    kAgePhase,
+    kPlanPhase,
+    kPhaseNum
+  };
+  static const char* stats_phase_name(int phase) {
+    static const char* names[] = {"unique", "isin", "swap", "restore", "update_freq", "gather",
+                                  "age", "plan"};
+    return phase >= 0 && phase < kPhaseNum ? names[phase] : "";
+  }
+
+  /*
+      cpu_row_num bounds the cpu index space for IndexMapMode::kDense / kPaged, where the isin op
+      becomes one array lookup per unique id instead of a merge-join over a std::map.
+  */
+  BasicSortCacheIndicesManager(long cuda_row_num = 0, long cpu_row_num = 0,
+                               SortEvictEngine evict_engine = SortEvictEngine::kSet,
+                               IndexMapMode index_mode = IndexMapMode::kMap)
+      : dense_map_(index_mode == IndexMapMode::kMap ? 0 : cpu_row_num,
+                   index_mode == IndexMapMode::kPaged) {
+    if (cuda_row_num > std::numeric_limits<Index>::max() ||
+        cpu_row_num > std::numeric_limits<Index>::max()) {
+      throw std::runtime_error("Error: capacity or cpu row num exceeds the index type.");
+    }
     cuda_row_num_ = cuda_row_num;
     cpu_row_num_ = cpu_row_num;
-    cache_freq_ = new long[cuda_row_num_];
-    cache_cpu_match_ = new long[cuda_row_num_];
+    evict_engine_ = evict_engine;
+    index_mode_ = index_mode;
+    row_alloc_num_ = cuda_row_num_;
+    cache_freq_ = new Count[row_alloc_num_];
+    cache_cpu_match_ = new Index[row_alloc_num_];
     this->init_map();
   }
 
-  ~SortCacheIndicesManager() {
+  ~BasicSortCacheIndicesManager() {
     delete[] cache_freq_;
     delete[] cache_cpu_match_;
   }
 
   void init_map() {
-    memset(cache_freq_, 0, cuda_row_num_);
+    wait_reclaim();
+    memset(cache_freq_, 0, sizeof(Count) * cuda_row_num_);
     cache_freq_set_.clear();
-    for (long i = 0; i < cuda_row_num_; i++) {
-      cache_freq_set_.insert(cache_freq_ + i);
+    if (evict_engine_ == SortEvictEngine::kSet) {
+      for (long i = 0; i < cuda_row_num_; i++) {
+        cache_freq_set_.insert(cache_freq_set_.end(), cache_freq_ + i);
+      }
+    } else {
+      freq_bucket_index_.init(cuda_row_num_);
     }
-    memset(cache_cpu_match_, -1, cuda_row_num_);
+    memset(cache_cpu_match_, -1, sizeof(Index) * cuda_row_num_);
     cpu_cache_map_.clear();
+    dense_map_.clear();
     while (!available_cache_row_stack_.empty()) {
       available_cache_row_stack_.pop();
     }
     for (long i = cuda_row_num_ - 1; i >= 0; i--) {
       available_cache_row_stack_.push(i);
     }
+    cache_epoch_.assign(cuda_row_num_, aging_epoch_);
+    aging_cursor_ = cuda_row_num_;
+    aging_batch_count_ = 0;
+    LFU_STATS(stats_.clear_rows());
+    LFU_STATS(stats_.publish());
+    this->republish_lookup();
+  }
+
+  /*
+      change cuda_row_num between batches, keeping every row's freq. growing adds free rows.
+      shrinking drops rows [new_row_num, cuda_row_num): the rows cached there move to free
+      rows below new_row_num, hottest first, and the rest are evicted. out gets the moves as
+      evict + admit pairs (cache row -> cpu -> new cache row) and the evictions as evict pairs,
+      so a data plane applies it like a batch; gpu_idx_vector stays empty.
+      return (moved_num, evicted_num). the work is proportional to the rows added or dropped
+      plus the free rows; row storage grows geometrically, and rebuilding the kSet order on
+      reallocation amortizes the same way.
+  */
+  std::tuple<long, long> resize(long new_row_num, InstructionBuffer& out) {
+    if (new_row_num <= 0 || new_row_num > std::numeric_limits<Index>::max()) {
+      throw std::runtime_error("Error: invalid cache capacity.");
+    }
+    wait_reclaim();
+    if (new_row_num < reclaim_high_) {
+      throw std::runtime_error("Error: reclaim watermark exceeds the new capacity.");
+    }
+    out.clear();
+    auto old_row_num = cuda_row_num_;
+    if (new_row_num >= old_row_num) {
+      if (new_row_num > row_alloc_num_) {
+        this->grow_rows(std::max(new_row_num, 2 * row_alloc_num_));
+      }
+      for (long i = old_row_num; i < new_row_num; i++) {
+        cache_freq_[i] = 0;
+        cache_cpu_match_[i] = -1;
+        if (evict_engine_ == SortEvictEngine::kSet) {
+          cache_freq_set_.insert(cache_freq_ + i);
+        }
+      }
+      if (evict_engine_ == SortEvictEngine::kSelect) {
+        freq_bucket_index_.resize(new_row_num);
+      }
+      cache_epoch_.resize(new_row_num, aging_epoch_);
+      for (long i = new_row_num - 1; i >= old_row_num; i--) {
+        available_cache_row_stack_.push(i);
+      }
+    } else {
+      // 1. keep the free rows below new_row_num
+      std::vector<long> kept_free;
+      for (; !available_cache_row_stack_.empty(); available_cache_row_stack_.pop()) {
+        if (available_cache_row_stack_.top() < new_row_num) {
+          kept_free.push_back(available_cache_row_stack_.top());
+        }
+      }
+      // 2. cached rows being dropped, hottest first
+      std::vector<long> dropped_rows;
+      for (long i = new_row_num; i < old_row_num; i++) {
+        if (cache_cpu_match_[i] != -1) {
+          dropped_rows.push_back(i);
+        }
+      }
+      std::stable_sort(dropped_rows.begin(), dropped_rows.end(),
+                       [this](long a, long b) { return cache_freq_[a] > cache_freq_[b]; });
+      // 3. move them into the kept free rows in stack order, evict the ones left over
+      size_t free_it = 0;
+      for (auto cache_idx : dropped_rows) {
+        auto cpu_idx = cache_cpu_match_[cache_idx];
+        out.evict_cache_idx_vector.push_back(cache_idx);
+        out.evict_to_cpu_idx_vector.push_back(cpu_idx);
+        if (free_it == kept_free.size()) {
+          LFU_STATS(stats_.add_row(cache_freq_[cache_idx], -1));
+          if (index_mode_ != IndexMapMode::kMap) {
+            dense_map_.erase(cpu_idx);
+          } else {
+            cpu_cache_map_.erase(cpu_idx);
+          }
+          cache_cpu_match_[cache_idx] = -1;
+          continue;
+        }
+        auto new_cache_idx = kept_free[free_it++];
+        this->set_freq(new_cache_idx, cache_freq_[cache_idx]);  // a free row, no stats move
+        cache_epoch_[new_cache_idx] = cache_epoch_[cache_idx];
+        cache_cpu_match_[new_cache_idx] = cpu_idx;
+        cache_cpu_match_[cache_idx] = -1;
+        if (index_mode_ != IndexMapMode::kMap) {
+          dense_map_.insert(cpu_idx, new_cache_idx);
+        } else {
+          cpu_cache_map_[cpu_idx] = new_cache_idx;
+        }
+        out.admit_cpu_idx_vector.push_back(cpu_idx);
+        out.admit_to_cache_idx_vector.push_back(new_cache_idx);
+      }
+      for (auto i = kept_free.size(); i > free_it; i--) {
+        available_cache_row_stack_.push(kept_free[i - 1]);
+      }
+      // 4. drop the rows from the freq order
+      if (evict_engine_ == SortEvictEngine::kSet) {
+        for (long i = new_row_num; i < old_row_num; i++) {
+          cache_freq_set_.erase(cache_freq_ + i);
+        }
+      } else {
+        freq_bucket_index_.resize(new_row_num);
+      }
+      cache_epoch_.resize(new_row_num);
+      aging_cursor_ = std::min(aging_cursor_, new_row_num);
+    }
+    cuda_row_num_ = new_row_num;
+    if (transfer_plan_) {
+      transfer_planner_.plan(out);
+    }
+    LFU_STATS(stats_.publish());
+    if (lookup_table_ && !lookup_deferred_) {
+      lookup_table_->publish(out);
+    }
+    return std::tuple<long, long>(out.admit_cpu_idx_vector.size(),
+                                  out.evict_cache_idx_vector.size() -
+                                      out.admit_cpu_idx_vector.size());
+  }
+
+  long capacity() const { return cuda_row_num_; }
+
+  /*
+      proactive eviction between batches, see CacheIndicesManager::set_reclaim_watermark,
+      same rules. the victims are the rows the swap op would pick, found by the same walk,
+      so prepare_ids then draws free rows and skips select_victims.
+  */
+  void set_reclaim_watermark(long low, long high) {
+    if (low < 0 || high < low || high > cuda_row_num_) {
+      throw std::runtime_error("Error: invalid reclaim watermark.");
+    }
+    wait_reclaim();
+    reclaim_low_ = low;
+    reclaim_high_ = high;
+  }
+
+  std::tuple<long, long> reclaim(InstructionBuffer& out) {
+    wait_reclaim();
+    return run_reclaim(out);
+  }
+
+  void reclaim_async(InstructionBuffer& out) {
+    wait_reclaim();
+    pending_reclaim_ = std::async(std::launch::async, [this, &out] { return run_reclaim(out); });
+  }
+
+  std::tuple<long, long> wait_reclaim() const {
+    if (!pending_reclaim_.valid()) {
+      return std::tuple<long, long>(0, 0);
+    }
+    return pending_reclaim_.get();
+  }
+
+  /*
+      bulk warm-up from historical access counts: reset the state, then cache the cuda_row_num
+      ids with the highest counts, each with freq = its count. ids with count <= 0 are
+      skipped, ids must be distinct.
+      the ids are selected in linear time and radix sorted by count; row r gets the r-th
+      lowest count, so (freq, cache_idx) order is row order after the free rows and the kSet
+      order is built by appends. the std::map of kMap is filled by appends after a radix sort
+      by cpu idx. out gets the admits (cpu -> cache) for the data plane to prefill,
+      gpu_idx_vector stays empty. return (admit_num, 0).
+  */
+  std::tuple<long, long> warm_up(const Index* cpu_idx_ptr, const long* count_ptr, long n,
+                                 InstructionBuffer& out) {
+    wait_reclaim();
+    out.clear();
+    radix_sorter_.select_top(count_ptr, cpu_idx_ptr, n, cuda_row_num_, warm_pair_vector_);
+    long warm_num = warm_pair_vector_.size();
+    // rows [0, warm_num) take the ids, [warm_num, cuda_row_num_) stay free with freq 0
+    memset(cache_freq_, 0, sizeof(Count) * cuda_row_num_);
+    memset(cache_cpu_match_, -1, sizeof(Index) * cuda_row_num_);
+    for (long r = 0; r < warm_num; r++) {
+      // counts saturate at the largest Count, as update_freq does
+      cache_freq_[r] =
+          std::min<long>(warm_pair_vector_[r].first, std::numeric_limits<Count>::max());
+      cache_cpu_match_[r] = warm_pair_vector_[r].second;
+      warm_pair_vector_[r] = RadixSorter::Pair(warm_pair_vector_[r].second, r);
+    }
+    cpu_cache_map_.clear();
+    dense_map_.clear();
+    try {
+      if (index_mode_ == IndexMapMode::kMap) {
+        // (cpu_idx, cache_idx) in cpu order, appended to the map
+        radix_sorter_.sort(warm_pair_vector_);
+      }
+      for (long r = 0; r < warm_num; r++) {
+        auto cpu_idx = warm_pair_vector_[r].first;
+        auto cache_idx = warm_pair_vector_[r].second;
+        if (index_mode_ != IndexMapMode::kMap) {
+          if (dense_map_.find(cpu_idx) != -1) {
+            throw std::runtime_error("Error: duplicate cpu idx in warm up.");
+          }
+          dense_map_.insert(cpu_idx, cache_idx);
+        } else {
+          if (r > 0 && warm_pair_vector_[r - 1].first == cpu_idx) {
+            throw std::runtime_error("Error: duplicate cpu idx in warm up.");
+          }
+          cpu_cache_map_.emplace_hint(cpu_cache_map_.end(), cpu_idx, cache_idx);
+        }
+      }
+    } catch (...) {
+      init_map();
+      throw;
+    }
+    cache_freq_set_.clear();
+    if (evict_engine_ == SortEvictEngine::kSet) {
+      for (long i = warm_num; i < cuda_row_num_; i++) {
+        cache_freq_set_.insert(cache_freq_set_.end(), cache_freq_ + i);
+      }
+      for (long i = 0; i < warm_num; i++) {
+        cache_freq_set_.insert(cache_freq_set_.end(), cache_freq_ + i);
+      }
+    } else {
+      freq_bucket_index_.init(cuda_row_num_);
+      for (long i = 0; i < warm_num; i++) {
+        freq_bucket_index_.move(i, cache_freq_[i]);
+      }
+    }
+    while (!available_cache_row_stack_.empty()) {
+      available_cache_row_stack_.pop();
+    }
+    for (long i = cuda_row_num_ - 1; i >= warm_num; i--) {
+      available_cache_row_stack_.push(i);
+    }
+    cache_epoch_.assign(cuda_row_num_, aging_epoch_);
+    aging_cursor_ = cuda_row_num_;
+    aging_batch_count_ = 0;
+    for (long r = 0; r < warm_num; r++) {
+      out.admit_cpu_idx_vector.push_back(cache_cpu_match_[r]);
+      out.admit_to_cache_idx_vector.push_back(r);
+    }
+#if LFU_CACHE_STATS
+    stats_.clear_rows();
+    for (long r = 0; r < warm_num; r++) {
+      stats_.add_row(cache_freq_[r], 1);
+    }
+    stats_.publish();
+#endif
+    if (transfer_plan_) {
+      transfer_planner_.plan(out);
+    }
+    this->republish_lookup();
+    return std::tuple<long, long>(warm_num, 0);
+  }
+
+  /*
+      snapshot sections: cache_freq_, cache_cpu_match_ and cache_epoch_ per cache row, the
+      free-row stack from bottom to top, every cache row in (freq, cache_idx) order, then the
+      cached (cpu_idx, cache_idx) pairs in cpu_idx order.
+      the two ordered sections let load_state rebuild the std::set and std::map by hinted
+      appends in O(cuda_row_num).
+  */
+  void save_state(const std::string& path) const {
+    wait_reclaim();
+    auto header = snapshot_format::make_header(snapshot_format::kSortCacheIndicesManager);
+    std::vector<long> free_stack;
+    for (auto stack_copy = available_cache_row_stack_; !stack_copy.empty(); stack_copy.pop()) {
+      free_stack.push_back(stack_copy.top());
+    }
+    std::reverse(free_stack.begin(), free_stack.end());
+    std::vector<long> freq_order(cuda_row_num_);
+    for (long i = 0; i < cuda_row_num_; i++) {
+      freq_order[i] = i;
+    }
+    std::sort(freq_order.begin(), freq_order.end(), [this](long a, long b) {
+      return cache_freq_[a] != cache_freq_[b] ? cache_freq_[a] < cache_freq_[b] : a < b;
+    });
+    std::vector<long> cached_cpu_idx, cached_cache_idx;
+    for (long i = 0; i < cuda_row_num_; i++) {
+      if (cache_cpu_match_[i] != -1) {
+        cached_cache_idx.push_back(i);
+      }
+    }
+    std::sort(cached_cache_idx.begin(), cached_cache_idx.end(),
+              [this](long a, long b) { return cache_cpu_match_[a] < cache_cpu_match_[b]; });
+    for (auto cache_idx : cached_cache_idx) {
+      cached_cpu_idx.push_back(cache_cpu_match_[cache_idx]);
+    }
+    header.capacity = cuda_row_num_;
+    header.row_num = cached_cache_idx.size();
+    header.free_num = free_stack.size();
+    header.aging_epoch = aging_epoch_;
+    header.aging_pass_epoch = aging_pass_epoch_;
+    header.aging_batch_count = aging_batch_count_;
+    header.aging_cursor = aging_cursor_;
+    SnapshotWriter writer(path);
+    writer.write_header(header);
+    writer.write_section(cache_freq_, cuda_row_num_);
+    writer.write_section(cache_cpu_match_, cuda_row_num_);
+    writer.write_section(cache_epoch_.data(), cuda_row_num_);
+    writer.write_section(free_stack.data(), free_stack.size());
+    writer.write_section(freq_order.data(), freq_order.size());
+    writer.write_section(cached_cpu_idx.data(), cached_cpu_idx.size());
+    writer.write_section(cached_cache_idx.data(), cached_cache_idx.size());
+    writer.close();
+  }
+
+  /*
+      restore a save_state snapshot. cuda_row_num must match, engine and index mode may differ.
+      every section is checked before the state changes, so a corrupt snapshot throws and
+      leaves the manager as it was.
+  */
+  void load_state(const std::string& path) {
+    wait_reclaim();
+    SnapshotReader reader(path, snapshot_format::kSortCacheIndicesManager);
+    auto const& header = reader.header();
+    if (header.capacity != cuda_row_num_ || header.row_num < 0 || header.free_num < 0 ||
+        header.row_num + header.free_num != cuda_row_num_) {
+      throw std::runtime_error("Error: snapshot capacity mismatch.");
+    }
+    auto freq_ptr = reader.section(cuda_row_num_);
+    auto cpu_match_ptr = reader.section(cuda_row_num_);
+    auto epoch_ptr = reader.section(cuda_row_num_);
+    auto free_ptr = reader.section(header.free_num);
+    auto freq_order_ptr = reader.section(cuda_row_num_);
+    auto cached_cpu_idx_ptr = reader.section(header.row_num);
+    auto cached_cache_idx_ptr = reader.section(header.row_num);
+    check_state(header.row_num, freq_ptr, cpu_match_ptr, epoch_ptr, free_ptr, freq_order_ptr,
+                cached_cpu_idx_ptr, cached_cache_idx_ptr);
+    for (long i = 0; i < cuda_row_num_; i++) {
+      cache_freq_[i] = freq_ptr[i];
+      cache_cpu_match_[i] = cpu_match_ptr[i];
+    }
+    cache_epoch_.assign(epoch_ptr, epoch_ptr + cuda_row_num_);
+    cache_freq_set_.clear();
+    if (evict_engine_ == SortEvictEngine::kSet) {
+      for (long i = 0; i < cuda_row_num_; i++) {
+        cache_freq_set_.insert(cache_freq_set_.end(), cache_freq_ + freq_order_ptr[i]);
+      }
+    } else {
+      freq_bucket_index_.init(cuda_row_num_);
+      for (long i = 0; i < cuda_row_num_; i++) {
+        freq_bucket_index_.move(i, cache_freq_[i]);
+      }
+    }
+    cpu_cache_map_.clear();
+    dense_map_.clear();
+    for (long i = 0; i < header.row_num; i++) {
+      if (index_mode_ != IndexMapMode::kMap) {
+        dense_map_.insert(cached_cpu_idx_ptr[i], cached_cache_idx_ptr[i]);
+      } else {
+        cpu_cache_map_.emplace_hint(cpu_cache_map_.end(), cached_cpu_idx_ptr[i],
+                                    cached_cache_idx_ptr[i]);
+      }
+    }
+    available_cache_row_stack_ =
+        std::stack<Index>(std::deque<Index>(free_ptr, free_ptr + header.free_num));
+    aging_epoch_ = header.aging_epoch;
+    aging_pass_epoch_ = header.aging_pass_epoch;
+    aging_batch_count_ = header.aging_batch_count;
+    aging_cursor_ = std::min<long>(std::max<long>(header.aging_cursor, 0), cuda_row_num_);
+#if LFU_CACHE_STATS
+    stats_.clear_rows();
+    for (long i = 0; i < header.row_num; i++) {
+      stats_.add_row(cache_freq_[cached_cache_idx_ptr[i]], 1);
+    }
+    stats_.publish();
+#endif
+    this->republish_lookup();
   }
 
-  std::tuple<std::vector<long>, std::vector<long>, std::vector<long>, std::vector<long>,
-             std::vector<long>>
-  prepare_ids(std::vector<long> cpu_idx_vector) {
+  /*
+      cumulative and last-batch counters plus the current freq histogram of cached rows. safe
+      to poll from any thread: the manager publishes a consistent copy at the end of each
+      prepare_ids. returns zeros when built with LFU_CACHE_STATS=0.
+  */
+  CacheStats stats() const {
+#if LFU_CACHE_STATS
+    return stats_.snapshot();
+#else
+    return CacheStats();
+#endif
+  }
+
+  /* restart the cumulative counters. the histogram reflects state and is kept */
+  void reset_stats() {
+#if LFU_CACHE_STATS
+    stats_.reset();
+#endif
+  }
+
+  /*
+      transfer planning. when enabled, the rows admitted by a batch (victims and free rows) are
+      matched to its cpu indices by TransferPlanner::match_slots, so consecutive ids land in
+      consecutive rows, and out.admit_run_vector / evict_run_vector group the transfers into
+      contiguous copies. off by default: it changes which row an id is admitted to, and since
+      equal freqs are evicted in row order, which of them become victims later.
+  */
+  void set_transfer_plan(bool enabled) {
+    wait_reclaim();
+    transfer_plan_ = enabled;
+  }
+
+  /*
+      threads of the unique op (RadixSorter::unique_count), 1 by default. batches below
+      thread_num * 32k ids stay on the calling thread.
+  */
+  void set_unique_threads(long thread_num) {
+    wait_reclaim();
+    unique_pool_ = thread_num > 1 ? std::make_unique<ThreadPool>(thread_num) : nullptr;
+  }
+
+  /*
+      lock-free cpu_idx -> cache_idx lookups for other threads, ids in [0, cpu_row_num); see
+      ConcurrentIndexTable and CacheIndicesManager::enable_concurrent_lookup, same rules.
+  */
+  void enable_concurrent_lookup(long cpu_row_num, bool deferred = false) {
+    wait_reclaim();
+    lookup_table_ =
+        cpu_row_num > 0 ? std::make_unique<LookupTable>(cpu_row_num) : nullptr;
+    lookup_deferred_ = deferred;
+    this->republish_lookup();
+  }
+
+  /* the table for reader threads, nullptr unless enabled */
+  const LookupTable* concurrent_lookup() const { return lookup_table_.get(); }
+
+  /* deferred mode: publish the batch out came from */
+  void publish_lookup(const InstructionBuffer& out) {
+    wait_reclaim();
+    if (lookup_table_) {
+      lookup_table_->publish(out);
+    }
+  }
+
+  /*
+      freq aging: every period_batches batches all freqs are shifted right by shift.
+      the pass walks cache rows in index order, ceil(cuda_row_num / period_batches) rows per
+      prepare_ids call, so no call pays O(cuda_row_num log cuda_row_num).
+      period_batches <= 0 disables aging.
+  */
+  void set_aging(long period_batches, int shift = 1) {
+    wait_reclaim();
+    aging_period_ = period_batches;
+    aging_shift_ = std::max(shift, 1);
+    aging_batch_count_ = 0;
+  }
+
+  BasicCacheInstruction<Index> prepare_ids(const std::vector<Index>& cpu_idx_vector) {
+    InstructionBuffer out;
+    out.reserve(cpu_idx_vector.size());
+    prepare_ids(cpu_idx_vector.data(), cpu_idx_vector.size(), out);
+    return std::move(out).to_instruction();
+  }
+
+  std::tuple<long, long> prepare_ids(const Index* cpu_idx_ptr, long n, InstructionBuffer& out) {
     /*
-        cpu_idx_vector -> gpu_idx_vector
+        cpu_idx_ptr[0, n) -> gpu_idx_vector
         admit_cpu_idx_vector     ---swap-->  admit_to_cache_idx_vector
         evict_to_cpu_idx_vector  <--swap--   evict_cache_idx_vector
-        return (gpu_idx_vector,
-                admit_cpu_idx_vector,
-                admit_to_cache_idx_vector,
-                evict_cache_idx_vector,
-                evict_to_cpu_idx_vector
-            )
+        out is cleared and refilled. return (admit_num, evict_num)
     */
-    std::vector<long> gpu_idx_vector;
-    std::vector<long> admit_cpu_idx_vector;
-    std::vector<long> admit_to_cache_idx_vector;
-    std::vector<long> evict_cache_idx_vector;
-    std::vector<long> evict_to_cpu_idx_vector;
+    wait_reclaim();
+    out.clear();
+    if (lookup_table_) {
+      lookup_table_->check_range(cpu_idx_ptr, n);
+    }
+    if (trace_writer_) {
+      trace_writer_->append(cpu_idx_ptr, n);
+    }
+    LFU_STATS(stats_.begin_batch());
+    auto& admit_cpu_idx_vector = out.admit_cpu_idx_vector;
+    auto& admit_to_cache_idx_vector = out.admit_to_cache_idx_vector;
+    auto& evict_cache_idx_vector = out.evict_cache_idx_vector;
+    auto& evict_to_cpu_idx_vector = out.evict_to_cpu_idx_vector;
 
     // unique op
-    std::vector<long> unique_cpu_idx_vector;
-    std::vector<long> unique_count_vector;
+    unique_cpu_idx_vector_.clear();
+    unique_count_vector_.clear();
     {
-      std::vector<long> cpu_idx_vector_clone(cpu_idx_vector);
-      std::sort(cpu_idx_vector_clone.begin(), cpu_idx_vector_clone.end());
-      for (auto cpu_idx : cpu_idx_vector_clone) {
-        if (unique_cpu_idx_vector.empty() || unique_cpu_idx_vector.back() != cpu_idx) {
-          unique_cpu_idx_vector.push_back(cpu_idx);
-          unique_count_vector.push_back(1);
-        } else {
-          unique_count_vector.back() += 1;
-        }
-      }
-      if (unique_cpu_idx_vector.size() > cuda_row_num_) {
+      radix_sorter_.unique_count(cpu_idx_ptr, n, unique_cpu_idx_vector_, unique_count_vector_,
+                                 unique_pool_.get());
+      if ((long)unique_cpu_idx_vector_.size() > cuda_row_num_) {
         throw std::runtime_error("Error: no enough cache row num.");
       }
     }
+    LFU_STATS_PHASE(stats_, kUniquePhase);
     // isin op
-    std::vector<long> already_cached_idx_vector;
-    std::vector<long> backup_freq_vector;
-    {
+    already_cached_idx_vector_.clear();
+    backup_freq_vector_.clear();
+    if (index_mode_ != IndexMapMode::kMap) {
+      if (!unique_cpu_idx_vector_.empty() &&
+          (unique_cpu_idx_vector_.front() < 0 || unique_cpu_idx_vector_.back() >= cpu_row_num_)) {
+        throw std::runtime_error("Error: cpu idx out of cpu row num.");
+      }
+      for (auto cpu_idx : unique_cpu_idx_vector_) {
+        auto cache_idx = dense_map_.find(cpu_idx);
+        if (cache_idx != -1) {
+          // protect, same as below
+          already_cached_idx_vector_.push_back(cache_idx);
+          backup_freq_vector_.push_back(cache_freq_[cache_idx]);
+          cache_freq_[cache_idx] = -1;
+        } else {
+          admit_cpu_idx_vector.push_back(cpu_idx);
+        }
+      }
+    } else {
       auto cached_cpu_idx_iter = cpu_cache_map_.begin();
-      auto incoming_cpu_idx_iter = unique_cpu_idx_vector.begin();
+      auto incoming_cpu_idx_iter = unique_cpu_idx_vector_.begin();
       while (cached_cpu_idx_iter != cpu_cache_map_.end() &&
-             incoming_cpu_idx_iter != unique_cpu_idx_vector.end()) {
+             incoming_cpu_idx_iter != unique_cpu_idx_vector_.end()) {
         if (cached_cpu_idx_iter->first == *incoming_cpu_idx_iter) {
           /*
               protect this cache_idx from being evicted
               mark corresponding freqs with -1.
           */
-          already_cached_idx_vector.push_back(cached_cpu_idx_iter->second);
-          backup_freq_vector.push_back(cache_freq_[cached_cpu_idx_iter->second]);
+          already_cached_idx_vector_.push_back(cached_cpu_idx_iter->second);
+          backup_freq_vector_.push_back(cache_freq_[cached_cpu_idx_iter->second]);
           cache_freq_[cached_cpu_idx_iter->second] = -1;
           cached_cpu_idx_iter++;
           incoming_cpu_idx_iter++;
@@ -115,11 +772,12 @@ class SortCacheIndicesManager {
           incoming_cpu_idx_iter++;
         }
       }
-      while (incoming_cpu_idx_iter != unique_cpu_idx_vector.end()){
+      while (incoming_cpu_idx_iter != unique_cpu_idx_vector_.end()) {
         admit_cpu_idx_vector.push_back(*incoming_cpu_idx_iter);
         incoming_cpu_idx_iter++;
-      } 
+      }
     }
+    LFU_STATS_PHASE(stats_, kIsinPhase);
     // swap op
     {
       auto admit_cpu_idx_iter = admit_cpu_idx_vector.begin();
@@ -127,69 +785,272 @@ class SortCacheIndicesManager {
       // 1. check available rows
       while (!available_cache_row_stack_.empty() &&
              admit_cpu_idx_iter != admit_cpu_idx_vector.end()) {
-        admit_to_cache_idx_vector.push_back(this->admit_to_cache(*admit_cpu_idx_iter++));
+        auto cache_idx = this->admit_to_cache(*admit_cpu_idx_iter++);
+        admit_to_cache_idx_vector.push_back(cache_idx);
+        // free rows are still indexed by freq, mark them so step 2 can't evict them
+        already_cached_idx_vector_.push_back(cache_idx);
+        backup_freq_vector_.push_back(cache_freq_[cache_idx]);
+        cache_freq_[cache_idx] = -1;
       }
       // 2. no enough rows, evict LFU
-      auto freq_order_cache_idx_ptr_iter = cache_freq_set_.begin();
-      while (admit_cpu_idx_iter != admit_cpu_idx_vector.end()) {
-        while (*(*freq_order_cache_idx_ptr_iter) == -1) {
-          // pass marked
-          freq_order_cache_idx_ptr_iter++;
-        }
-        auto evict_cache_idx = *freq_order_cache_idx_ptr_iter - cache_freq_;  // ptr locate trick
+      this->select_victims(admit_cpu_idx_vector.end() - admit_cpu_idx_iter);
+      for (auto evict_cache_idx : victim_idx_vector_) {
         evict_cache_idx_vector.push_back(evict_cache_idx);
         evict_to_cpu_idx_vector.push_back(this->evict_from_cache(evict_cache_idx));
         admit_to_cache_idx_vector.push_back(this->admit_to_cache(*admit_cpu_idx_iter++));
-        freq_order_cache_idx_ptr_iter++;
+      }
+      // 3. hand the admitted rows out in ascending order
+      if (transfer_plan_) {
+        this->match_admitted_slots(admit_cpu_idx_vector, admit_to_cache_idx_vector);
       }
     }
+    LFU_STATS_PHASE(stats_, kSwapPhase);
     // restore marked freqs
     {
-      auto cache_idx_iter = already_cached_idx_vector.begin();
-      auto freq_iter = backup_freq_vector.begin();
-      for (; cache_idx_iter != already_cached_idx_vector.end() &&
-             freq_iter != backup_freq_vector.end();
+      auto cache_idx_iter = already_cached_idx_vector_.begin();
+      auto freq_iter = backup_freq_vector_.begin();
+      for (; cache_idx_iter != already_cached_idx_vector_.end() &&
+             freq_iter != backup_freq_vector_.end();
            cache_idx_iter++, freq_iter++) {
         cache_freq_[*cache_idx_iter] = *freq_iter;
       }
     }
+    LFU_STATS_PHASE(stats_, kRestorePhase);
     // update freqs
     /* we don't update freqs during eviction because those marked freqs(-1) misguide sorting */
     {
       for (auto cache_idx : admit_to_cache_idx_vector) {
-        cache_freq_[cache_idx] = 0;
+        this->set_freq(cache_idx, 0);
+        cache_epoch_[cache_idx] = aging_epoch_;
       }
-      auto incoming_cpu_idx_iter = unique_cpu_idx_vector.begin();
-      auto unique_count_iter = unique_count_vector.begin();
-      for (; incoming_cpu_idx_iter != unique_cpu_idx_vector.end() &&
-             unique_count_iter != unique_count_vector.end();
+      auto incoming_cpu_idx_iter = unique_cpu_idx_vector_.begin();
+      auto unique_count_iter = unique_count_vector_.begin();
+      for (; incoming_cpu_idx_iter != unique_cpu_idx_vector_.end() &&
+             unique_count_iter != unique_count_vector_.end();
            incoming_cpu_idx_iter++, unique_count_iter++) {
-        this->update_freq(cpu_cache_map_.find(*incoming_cpu_idx_iter)->second, *unique_count_iter);
+        this->update_freq(this->locate_on_cache(*incoming_cpu_idx_iter), *unique_count_iter);
       }
     }
+    LFU_STATS_PHASE(stats_, kUpdateFreqPhase);
 
-    for (auto cpu_idx : cpu_idx_vector) {
-      gpu_idx_vector.push_back(cpu_cache_map_.find(cpu_idx)->second);
+    for (long i = 0; i < n; i++) {
+      out.gpu_idx_vector.push_back(this->locate_on_cache(cpu_idx_ptr[i]));
     }
-    return std::tuple<std::vector<long>, std::vector<long>, std::vector<long>, std::vector<long>,
-                      std::vector<long>>(gpu_idx_vector, admit_cpu_idx_vector,
-                                         admit_to_cache_idx_vector, evict_cache_idx_vector,
-                                         evict_to_cpu_idx_vector);
+    LFU_STATS_PHASE(stats_, kGatherPhase);
+    // incremental aging
+    this->age_step();
+    LFU_STATS_PHASE(stats_, kAgePhase);
+    if (transfer_plan_) {
+      transfer_planner_.plan(out);
+    }
+    LFU_STATS_PHASE(stats_, kPlanPhase);
+#if LFU_CACHE_STATS
+    auto& batch = stats_.batch();
+    batch.lookup_num = n;
+    batch.unique_num = unique_cpu_idx_vector_.size();
+    batch.admit_num = batch.miss_num = admit_cpu_idx_vector.size();
+    batch.hit_num = n - batch.miss_num;
+    batch.evict_num = evict_cache_idx_vector.size();
+    stats_.end_batch();
+#endif
+    if (lookup_table_ && !lookup_deferred_) {
+      lookup_table_->publish(out);
+    }
+    return std::tuple<long, long>(admit_cpu_idx_vector.size(), evict_cache_idx_vector.size());
+  }
+
+  /*
+      register upcoming batches. rows referenced by the window are passed over in the swap op
+      and only evicted, in freq order, when nothing else is left.
+      typical step t: pop_lookahead() (batch t is now current), push_lookahead(batch t + k),
+      prepare_ids(batch t).
+  */
+  void push_lookahead(const Index* cpu_idx_ptr, long n) {
+    wait_reclaim();
+    lookahead_.push(cpu_idx_ptr, n);
+  }
+  void push_lookahead(const std::vector<Index>& cpu_idx_vector) {
+    push_lookahead(cpu_idx_vector.data(), cpu_idx_vector.size());
+  }
+  void pop_lookahead() {
+    wait_reclaim();
+    lookahead_.pop();
+  }
+  void clear_lookahead() {
+    wait_reclaim();
+    lookahead_.clear();
+  }
+  long lookahead_size() const { return lookahead_.size(); }
+
+  /*
+      record every prepare_ids input to writer (not owned), nullptr stops recording.
+      replay the trace with TraceReader.
+  */
+  void set_trace_writer(TraceWriter* writer) {
+    wait_reclaim();
+    trace_writer_ = writer;
   }
 
  private:
   long cuda_row_num_;
+  long row_alloc_num_;  // rows allocated in cache_freq_ / cache_cpu_match_, >= cuda_row_num_
   long cpu_row_num_;
-  long* cache_freq_;  // gpu idx -> use freq
-  std::set<long*, cache_freq_ptr_cmp>
+  SortEvictEngine evict_engine_;
+  FreqBucketIndex freq_bucket_index_;  // kSelect only
+  Count* cache_freq_;  // gpu idx -> use freq
+  std::set<Count*, cache_freq_ptr_cmp>
       cache_freq_set_;  // set of cache_freq ptrs. sort by ptr target(freq).
 
-  long* cache_cpu_match_;               // gpu idx -> cpu idx
-  std::map<long, long> cpu_cache_map_;  // keys: cpu indices that are cached;
-                                        // values: corresponding gpu indices
-  std::stack<long> available_cache_row_stack_;
+  Index* cache_cpu_match_;                // gpu idx -> cpu idx
+  std::map<Index, Index> cpu_cache_map_;  // keys: cpu indices that are cached;
+                                          // values: corresponding gpu indices
+  IndexMapMode index_mode_;
+  BasicDenseIndexMap<Index> dense_map_;  // replaces cpu_cache_map_ in kDense / kPaged
+  std::stack<Index> available_cache_row_stack_;
+
+  // per-batch scratch, kept across calls to avoid reallocation
+  std::vector<Index> unique_cpu_idx_vector_;
+  std::vector<long> unique_count_vector_;
+  std::vector<long> already_cached_idx_vector_;
+  std::vector<Count> backup_freq_vector_;
+  std::vector<long> lookahead_skipped_idx_vector_;
+  std::vector<long> victim_idx_vector_;
+  std::vector<long> bucket_candidate_vector_;
+
+  LookaheadWindow lookahead_;  // upcoming batches, protected from eviction
+  TraceWriter* trace_writer_ = nullptr;  // prepare_ids input recorder, not owned
+
+  // aging config, per-row aging epoch and the next row of the running aging pass
+  long aging_period_ = 0;
+  int aging_shift_ = 1;
+  long aging_batch_count_ = 0;
+  long aging_epoch_ = 0;
+  long aging_pass_epoch_ = 0;
+  long aging_cursor_ = 0;
+  std::vector<Count> cache_epoch_;
+
+#if LFU_CACHE_STATS
+  CacheStatsRecorder stats_;
+#endif
+
+  bool transfer_plan_ = false;  // see set_transfer_plan
+  TransferPlanner transfer_planner_;
+
+  // unique op and warm_up
+  RadixSorter radix_sorter_;
+  std::unique_ptr<ThreadPool> unique_pool_;
+
+  // reader-side mapping, see enable_concurrent_lookup
+  std::unique_ptr<LookupTable> lookup_table_;
+  bool lookup_deferred_ = false;
+  std::vector<Index> lookup_cpu_idx_vector_;
+  std::vector<Index> lookup_cache_idx_vector_;
+
+  // free-row watermark, see set_reclaim_watermark
+  long reclaim_low_ = 0;
+  long reclaim_high_ = 0;
+  // running reclaim_async. declared last: destroying it joins the thread first
+  mutable std::future<std::tuple<long, long>> pending_reclaim_;
+
+  std::tuple<long, long> run_reclaim(InstructionBuffer& out) {
+    out.clear();
+    long free_num = available_cache_row_stack_.size();
+    if (reclaim_high_ <= 0 || free_num >= reclaim_low_) {
+      return std::tuple<long, long>(0, 0);
+    }
+    this->select_victims(reclaim_high_ - free_num, false);
+    for (auto cache_idx : victim_idx_vector_) {
+      out.evict_cache_idx_vector.push_back(cache_idx);
+      out.evict_to_cpu_idx_vector.push_back(this->evict_from_cache(cache_idx));
+    }
+    if (transfer_plan_) {
+      transfer_planner_.plan(out);
+    }
+    LFU_STATS(stats_.add_reclaim(out.evict_cache_idx_vector.size()));
+    if (lookup_table_ && !lookup_deferred_) {
+      lookup_table_->publish(out);
+    }
+    return std::tuple<long, long>(0, out.evict_cache_idx_vector.size());
+  }
+
+  /*
+      load_state's checks: freqs and epochs fit Count and are not negative (no row is
+      protected between batches), the free stack holds exactly the rows without a cpu idx,
+      freq_order is every row in (freq, cache_idx) order, and the cached pairs match
+      cache_cpu_match_ in ascending cpu idx order.
+  */
+  void check_state(long row_num, const long* freq_ptr, const long* cpu_match_ptr,
+                   const long* epoch_ptr, const long* free_ptr, const long* freq_order_ptr,
+                   const long* cached_cpu_idx_ptr, const long* cached_cache_idx_ptr) const {
+    auto corrupt = [] { throw std::runtime_error("Error: corrupt snapshot."); };
+    long match_free_num = 0;
+    for (long i = 0; i < cuda_row_num_; i++) {
+      if (freq_ptr[i] < 0 || freq_ptr[i] > std::numeric_limits<Count>::max() ||
+          cpu_match_ptr[i] < -1 || cpu_match_ptr[i] > std::numeric_limits<Index>::max() ||
+          epoch_ptr[i] < 0 || epoch_ptr[i] > std::numeric_limits<Count>::max()) {
+        corrupt();
+      }
+      match_free_num += cpu_match_ptr[i] == -1;
+    }
+    long free_num = cuda_row_num_ - row_num;
+    if (match_free_num != free_num) {
+      corrupt();
+    }
+    std::vector<char> row_seen(cuda_row_num_, 0);
+    for (long i = 0; i < free_num; i++) {
+      auto cache_idx = free_ptr[i];
+      if (cache_idx < 0 || cache_idx >= cuda_row_num_ || row_seen[cache_idx] ||
+          cpu_match_ptr[cache_idx] != -1) {
+        corrupt();
+      }
+      row_seen[cache_idx] = 1;
+    }
+    for (long i = 0; i < cuda_row_num_; i++) {
+      auto cache_idx = freq_order_ptr[i];
+      if (cache_idx < 0 || cache_idx >= cuda_row_num_) {
+        corrupt();
+      }
+      if (i > 0) {
+        auto prev_idx = freq_order_ptr[i - 1];
+        if (freq_ptr[prev_idx] > freq_ptr[cache_idx] ||
+            (freq_ptr[prev_idx] == freq_ptr[cache_idx] && prev_idx >= cache_idx)) {
+          corrupt();
+        }
+      }
+    }
+    for (long i = 0; i < row_num; i++) {
+      auto cpu_idx = cached_cpu_idx_ptr[i];
+      auto cache_idx = cached_cache_idx_ptr[i];
+      if (cache_idx < 0 || cache_idx >= cuda_row_num_ || cpu_match_ptr[cache_idx] != cpu_idx ||
+          cpu_idx < 0 || (i > 0 && cpu_idx <= cached_cpu_idx_ptr[i - 1]) ||
+          (index_mode_ != IndexMapMode::kMap && !dense_map_.in_range(cpu_idx))) {
+        corrupt();
+      }
+    }
+  }
+
+  /* rebuild the reader table from cache_cpu_match_ */
+  void republish_lookup() {
+    if (!lookup_table_) {
+      return;
+    }
+    lookup_cpu_idx_vector_.clear();
+    lookup_cache_idx_vector_.clear();
+    for (long i = 0; i < cuda_row_num_; i++) {
+      if (cache_cpu_match_[i] != -1) {
+        lookup_cpu_idx_vector_.push_back(cache_cpu_match_[i]);
+        lookup_cache_idx_vector_.push_back(i);
+      }
+    }
+    lookup_table_->assign(lookup_cpu_idx_vector_.data(), lookup_cache_idx_vector_.data(),
+                          lookup_cpu_idx_vector_.size());
+  }
+  std::vector<RadixSorter::Pair> warm_pair_vector_;
 
   long locate_on_cache(long cpu_idx) {
+    if (index_mode_ != IndexMapMode::kMap) {
+      return dense_map_.find(cpu_idx);
+    }
     auto cache_idx = cpu_cache_map_.find(cpu_idx);
     if (cache_idx != cpu_cache_map_.end()) {
       return cache_idx->second;
@@ -201,7 +1062,12 @@ class SortCacheIndicesManager {
   long admit_to_cache(long cpu_idx) {
     auto cache_idx = this->draw_available_cache();
     cache_cpu_match_[cache_idx] = cpu_idx;
-    cpu_cache_map_.insert(std::pair<long, long>(cpu_idx, cache_idx));
+    LFU_STATS(stats_.add_row(cache_freq_[cache_idx], 1));
+    if (index_mode_ != IndexMapMode::kMap) {
+      dense_map_.insert(cpu_idx, cache_idx);
+    } else {
+      cpu_cache_map_.insert(std::pair<Index, Index>(cpu_idx, cache_idx));
+    }
     return cache_idx;
   }
 
@@ -211,22 +1077,198 @@ class SortCacheIndicesManager {
     }
     auto cpu_idx = cache_cpu_match_[cache_idx];
     cache_cpu_match_[cache_idx] = -1;
-    cpu_cache_map_.erase(cpu_idx);
+    LFU_STATS(stats_.add_row(cache_freq_[cache_idx], -1));
+    if (index_mode_ != IndexMapMode::kMap) {
+      dense_map_.erase(cpu_idx);
+    } else {
+      cpu_cache_map_.erase(cpu_idx);
+    }
     this->give_available_cache(cache_idx);
     return cpu_idx;
   }
 
+  void match_admitted_slots(const std::vector<Index>& admit_cpu_idx_vector,
+                            std::vector<Index>& admit_to_cache_idx_vector) {
+    /* admit_cpu_idx_vector is ascending (unique op). only the cpu <-> row pairing changes */
+    if (admit_to_cache_idx_vector.size() < 2) {
+      return;
+    }
+    auto const& slots =
+        transfer_planner_.match_slots(admit_cpu_idx_vector, admit_to_cache_idx_vector);
+    for (size_t k = 0; k < slots.size(); k++) {
+      auto cpu_idx = admit_cpu_idx_vector[k];
+      cache_cpu_match_[slots[k]] = cpu_idx;
+      if (index_mode_ != IndexMapMode::kMap) {
+        dense_map_.insert(cpu_idx, slots[k]);
+      } else {
+        cpu_cache_map_[cpu_idx] = slots[k];
+      }
+      admit_to_cache_idx_vector[k] = slots[k];
+    }
+  }
+
   void update_freq(long cache_idx, long count) {
-    // erase and reinsert ptr to maintain set order
-    cache_freq_set_.erase(cache_freq_ + cache_idx);
-    cache_freq_[cache_idx] += count;
-    cache_freq_set_.insert(cache_freq_ + cache_idx);
+    long max_freq = std::numeric_limits<Count>::max();
+    this->set_freq(cache_idx, count > max_freq - cache_freq_[cache_idx]
+                                  ? max_freq
+                                  : cache_freq_[cache_idx] + count);
   }
 
   void set_freq(long cache_idx, long count) {
-    cache_freq_set_.erase(cache_freq_ + cache_idx);
-    cache_freq_[cache_idx] = count;
-    cache_freq_set_.insert(cache_freq_ + cache_idx);
+#if LFU_CACHE_STATS
+    if (cache_cpu_match_[cache_idx] != -1) {
+      stats_.move_row(cache_freq_[cache_idx], count);
+    }
+#endif
+    if (evict_engine_ == SortEvictEngine::kSet) {
+      // erase and reinsert ptr to maintain set order
+      cache_freq_set_.erase(cache_freq_ + cache_idx);
+      cache_freq_[cache_idx] = count;
+      cache_freq_set_.insert(cache_freq_ + cache_idx);
+    } else {
+      cache_freq_[cache_idx] = count;
+      freq_bucket_index_.move(cache_idx, count);
+    }
+  }
+
+  /* whether select_victims may take a row; a row the lookahead needs is put aside instead */
+  bool is_victim_candidate(long cache_idx) {
+    if (cache_freq_[cache_idx] == -1) {
+      // pass marked
+      LFU_STATS(stats_.batch().masked_skip_num++);
+      return false;
+    }
+    if (cache_cpu_match_[cache_idx] == -1) {
+      return false;
+    }
+    if (lookahead_.contains(cache_cpu_match_[cache_idx])) {
+      // needed by upcoming batches, rank last
+      LFU_STATS(stats_.batch().lookahead_skip_num++);
+      lookahead_skipped_idx_vector_.push_back(cache_idx);
+      return false;
+    }
+    return true;
+  }
+
+  void select_victims(long evict_num, bool take_lookahead = true) {
+    /*
+        fill victim_idx_vector_ with up to evict_num unmarked cached rows in (freq, cache_idx)
+        order. rows needed by lookahead_ are ranked after every other row, and left out
+        without take_lookahead. free rows (cpu idx -1) only remain unmarked between batches.
+    */
+    victim_idx_vector_.clear();
+    lookahead_skipped_idx_vector_.clear();
+    if (evict_num == 0) {
+      return;
+    }
+    if (evict_engine_ == SortEvictEngine::kSet) {
+      for (auto freq_order_cache_idx_ptr_iter = cache_freq_set_.begin();
+           freq_order_cache_idx_ptr_iter != cache_freq_set_.end() &&
+           (long)victim_idx_vector_.size() < evict_num;
+           freq_order_cache_idx_ptr_iter++) {
+        auto cache_idx = *freq_order_cache_idx_ptr_iter - cache_freq_;  // ptr locate trick
+        if (this->is_victim_candidate(cache_idx)) {
+          victim_idx_vector_.push_back(cache_idx);
+        }
+      }
+    } else {
+      auto freq_order = [this](long a, long b) {
+        return cache_freq_[a] != cache_freq_[b] ? cache_freq_[a] < cache_freq_[b] : a < b;
+      };
+      for (long bucket = 0; bucket < FreqBucketIndex::kBucketNum &&
+                            (long)victim_idx_vector_.size() < evict_num;
+           bucket++) {
+        if (freq_bucket_index_.size(bucket) == 0) {
+          continue;
+        }
+        if (FreqBucketIndex::exact(bucket)) {
+          // one freq, its rows come in cache_idx order
+          for (auto cache_idx = freq_bucket_index_.next(bucket, 0);
+               cache_idx != -1 && (long)victim_idx_vector_.size() < evict_num;
+               cache_idx = freq_bucket_index_.next(bucket, cache_idx + 1)) {
+            if (this->is_victim_candidate(cache_idx)) {
+              victim_idx_vector_.push_back(cache_idx);
+            }
+          }
+          continue;
+        }
+        // the bucket mixes freqs, sort what is taken from it
+        bucket_candidate_vector_.clear();
+        auto skipped_begin = lookahead_skipped_idx_vector_.size();
+        for (auto cache_idx = freq_bucket_index_.next(bucket, 0); cache_idx != -1;
+             cache_idx = freq_bucket_index_.next(bucket, cache_idx + 1)) {
+          if (this->is_victim_candidate(cache_idx)) {
+            bucket_candidate_vector_.push_back(cache_idx);
+          }
+        }
+        std::sort(lookahead_skipped_idx_vector_.begin() + skipped_begin,
+                  lookahead_skipped_idx_vector_.end(), freq_order);
+        auto take = std::min<long>(evict_num - victim_idx_vector_.size(),
+                                   bucket_candidate_vector_.size());
+        std::partial_sort(bucket_candidate_vector_.begin(), bucket_candidate_vector_.begin() + take,
+                          bucket_candidate_vector_.end(), freq_order);
+        victim_idx_vector_.insert(victim_idx_vector_.end(), bucket_candidate_vector_.begin(),
+                                  bucket_candidate_vector_.begin() + take);
+      }
+    }
+    // rows ranked last, all of them are collected once the walk runs out
+    for (size_t i = 0; take_lookahead && (long)victim_idx_vector_.size() < evict_num; i++) {
+      victim_idx_vector_.push_back(lookahead_skipped_idx_vector_[i]);
+    }
+  }
+
+  void age_step() {
+    if (aging_period_ <= 0) {
+      return;
+    }
+    if (++aging_batch_count_ % aging_period_ == 0) {
+      aging_epoch_++;
+    }
+    auto budget = (cuda_row_num_ + aging_period_ - 1) / aging_period_;
+    for (; budget > 0; budget--) {
+      if (aging_cursor_ == cuda_row_num_) {
+        // a pass ends at the last row, start the next one if an epoch is pending
+        if (aging_pass_epoch_ == aging_epoch_) {
+          break;
+        }
+        aging_pass_epoch_ = aging_epoch_;
+        aging_cursor_ = 0;
+      }
+      auto cache_idx = aging_cursor_++;
+      if (cache_epoch_[cache_idx] == aging_epoch_) {
+        continue;
+      }
+      auto shift = std::min<long>(sizeof(Count) * 8 - 1,
+                                  aging_shift_ * (aging_epoch_ - cache_epoch_[cache_idx]));
+      cache_epoch_[cache_idx] = aging_epoch_;
+      if (cache_freq_[cache_idx] > 0) {
+        this->set_freq(cache_idx, cache_freq_[cache_idx] >> shift);
+      }
+    }
+  }
+
+  void grow_rows(long row_alloc_num) {
+    /* reallocate the per-row arrays. the kSet order keeps its sequence with new pointers */
+    auto cache_freq = new Count[row_alloc_num];
+    auto cache_cpu_match = new Index[row_alloc_num];
+    memcpy(cache_freq, cache_freq_, sizeof(Count) * cuda_row_num_);
+    memcpy(cache_cpu_match, cache_cpu_match_, sizeof(Index) * cuda_row_num_);
+    std::vector<long> freq_order;
+    if (evict_engine_ == SortEvictEngine::kSet) {
+      freq_order.reserve(cuda_row_num_);
+      for (auto freq_ptr : cache_freq_set_) {
+        freq_order.push_back(freq_ptr - cache_freq_);
+      }
+      cache_freq_set_.clear();
+    }
+    delete[] cache_freq_;
+    delete[] cache_cpu_match_;
+    cache_freq_ = cache_freq;
+    cache_cpu_match_ = cache_cpu_match;
+    row_alloc_num_ = row_alloc_num;
+    for (auto cache_idx : freq_order) {
+      cache_freq_set_.insert(cache_freq_set_.end(), cache_freq_ + cache_idx);
+    }
   }
 
   long draw_available_cache() {
@@ -239,4 +1281,7 @@ class SortCacheIndicesManager {
   }
 
   void give_available_cache(long cache_idx) { available_cache_row_stack_.push(cache_idx); }
-};
\ No newline at end of file
+};
+
+typedef BasicSortCacheIndicesManager<> SortCacheIndicesManager;
+typedef BasicSortCacheIndicesManager<int32_t, int32_t> CompactSortCacheIndicesManager;
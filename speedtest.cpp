@@ -2,6 +2,8 @@
 #include <experimental/random>
 
 #include "cache_mgr.h"
+#include "flat_cache_mgr.h"
+#include "sharded_cache_mgr.h"
 #include "sort_cache_mgr.h"
 
 #define CacheRowNum 163840
@@ -36,12 +38,11 @@ void print_cache_instruction(CacheInstruction inst) {
   std::cout << std::endl;
 }
 
-int main() {
-  CacheIndicesManager mgr(CacheRowNum);
+template <typename Manager>
+double run_speedtest(Manager& mgr, int repeat) {
   long request[CacheRowNum];
 
   double cache_op_time = 0.0;
-  int repeat = 100;
   for (int epoch = 0; epoch < repeat; epoch++) {
     for (int i = 0; i < CacheRowNum; i++) {
       request[i] = experimental::randint(0, RandRange - 1);
@@ -56,7 +57,51 @@ int main() {
     // make sure prepare_ids is fully called, not optimized out
     print_cache_instruction(ret);
   }
-  cout << "total time: " << cache_op_time / 1000 << " ms" << endl;
-  cout << "average time: " << cache_op_time / 1000 / repeat << " ms" << endl;
+  return cache_op_time;
+}
+
+int main() {
+  int repeat = 100;
+  for (auto index_mode : {IndexMapMode::kMap, IndexMapMode::kDense}) {
+    CacheIndicesManager mgr(CacheRowNum, RandRange, index_mode);
+    double cache_op_time = run_speedtest(mgr, repeat);
+    cout << "CacheIndicesManager " << (index_mode == IndexMapMode::kMap ? "kMap" : "kDense")
+         << endl;
+    cout << "total time: " << cache_op_time / 1000 << " ms" << endl;
+    cout << "average time: " << cache_op_time / 1000 / repeat << " ms" << endl;
+  }
+  {
+    FlatCacheIndicesManager mgr(CacheRowNum);
+    double cache_op_time = run_speedtest(mgr, repeat);
+    cout << "FlatCacheIndicesManager" << endl;
+    cout << "total time: " << cache_op_time / 1000 << " ms" << endl;
+    cout << "average time: " << cache_op_time / 1000 / repeat << " ms" << endl;
+    cout << "memory: " << mgr.memory_bytes() << " bytes, " << mgr.memory_bytes_per_row()
+         << " bytes per row" << endl;
+  }
+  for (auto evict_engine : {SortEvictEngine::kSet, SortEvictEngine::kSelect}) {
+    SortCacheIndicesManager mgr(CacheRowNum, RandRange, evict_engine);
+    double cache_op_time = run_speedtest(mgr, repeat);
+    cout << "SortCacheIndicesManager "
+         << (evict_engine == SortEvictEngine::kSet ? "kSet" : "kSelect") << endl;
+    cout << "total time: " << cache_op_time / 1000 << " ms" << endl;
+    cout << "average time: " << cache_op_time / 1000 / repeat << " ms" << endl;
+  }
+  {
+    SortCacheIndicesManager mgr(CacheRowNum, RandRange, SortEvictEngine::kSelect,
+                                IndexMapMode::kDense);
+    double cache_op_time = run_speedtest(mgr, repeat);
+    cout << "SortCacheIndicesManager kSelect kDense" << endl;
+    cout << "total time: " << cache_op_time / 1000 << " ms" << endl;
+    cout << "average time: " << cache_op_time / 1000 / repeat << " ms" << endl;
+  }
+  for (long shard_num : {1, 2, 4, 8, 16}) {
+    ShardedCacheIndicesManager<FlatCacheIndicesManager> mgr(CacheRowNum, shard_num);
+    double cache_op_time = run_speedtest(mgr, repeat);
+    cout << "ShardedCacheIndicesManager<FlatCacheIndicesManager> shard_num " << shard_num << endl;
+    cout << "total time: " << cache_op_time / 1000 << " ms" << endl;
+    cout << "average time: " << cache_op_time / 1000 / repeat << " ms" << endl;
+    cout << "hit rate: " << mgr.hit_rate() << endl;
+  }
   return 0;
-}
\ No newline at end of file
+}
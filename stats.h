@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+/*
+    compile-time switches:
+    LFU_CACHE_STATS=0         removes every counter update from prepare_ids, stats() returns
+                              zeros.
+    LFU_CACHE_PHASE_TIMERS=1  also times the phases of prepare_ids (two clock reads per phase).
+*/
+#ifndef LFU_CACHE_STATS
+#define LFU_CACHE_STATS 1
+#endif
+#ifndef LFU_CACHE_PHASE_TIMERS
+#define LFU_CACHE_PHASE_TIMERS 0
+#endif
+
+#if LFU_CACHE_STATS
+#define LFU_STATS(stmt) stmt
+#else
+#define LFU_STATS(stmt)
+#endif
+
+#if LFU_CACHE_STATS && LFU_CACHE_PHASE_TIMERS
+#define LFU_STATS_PHASE(recorder, phase) (recorder).end_phase(phase)
+#else
+#define LFU_STATS_PHASE(recorder, phase)
+#endif
+
+struct CacheCounters {
+  static const int kMaxPhaseNum = 8;
+
+  long batch_num = 0;
+  long lookup_num = 0;  // input ids, duplicates included
+  long unique_num = 0;  // distinct ids per batch, summed
+  long hit_num = 0;     // ids served without admission
+  long miss_num = 0;    // ids that caused an admission or were bypassed
+  long bypass_num = 0;  // ids the admission filter served from cpu
+  long admit_num = 0;
+  long evict_num = 0;
+  long masked_skip_num = 0;     // masked rows passed over while looking for a victim
+  long lookahead_skip_num = 0;  // rows passed over because the lookahead window needs them
+  long reclaim_num = 0;         // rows evicted ahead of time by reclaim(), not in evict_num
+  long phase_ns[kMaxPhaseNum] = {};  // see the manager's stats_phase_name()
+
+  CacheCounters& operator+=(const CacheCounters& other) {
+    batch_num += other.batch_num;
+    lookup_num += other.lookup_num;
+    unique_num += other.unique_num;
+    hit_num += other.hit_num;
+    miss_num += other.miss_num;
+    bypass_num += other.bypass_num;
+    admit_num += other.admit_num;
+    evict_num += other.evict_num;
+    masked_skip_num += other.masked_skip_num;
+    lookahead_skip_num += other.lookahead_skip_num;
+    reclaim_num += other.reclaim_num;
+    for (int i = 0; i < kMaxPhaseNum; i++) {
+      phase_ns[i] += other.phase_ns[i];
+    }
+    return *this;
+  }
+
+  double hit_rate() const { return lookup_num > 0 ? double(hit_num) / lookup_num : 0.0; }
+  double duplicate_ratio() const {
+    return lookup_num > 0 ? 1.0 - double(unique_num) / lookup_num : 0.0;
+  }
+};
+
+struct CacheStats {
+  /* bucket 0 holds freq <= 0, bucket k holds freq in [2^(k-1), 2^k) */
+  static const int kFreqBucketNum = 64;
+
+  CacheCounters total;       // since construction or reset_stats()
+  CacheCounters last_batch;  // the latest prepare_ids call
+  long freq_histogram[kFreqBucketNum] = {};  // cached rows per freq bucket, current state
+
+  static int freq_bucket(long freq) { return freq <= 0 ? 0 : 64 - __builtin_clzl(freq); }
+};
+
+/*
+    owned by a manager. prepare_ids fills batch_ with plain stores; end_batch() publishes
+    totals, the batch and the histogram under a seqlock with relaxed atomics, so snapshot()
+    can be polled from any thread and never blocks or slows the manager.
+    reset() only moves the poller's baseline.
+*/
+class CacheStatsRecorder {
+ public:
+  CacheCounters& batch() { return batch_; }
+
+  void begin_batch() {
+    batch_ = CacheCounters();
+    batch_.batch_num = 1;
+#if LFU_CACHE_PHASE_TIMERS
+    phase_start_ = std::chrono::steady_clock::now();
+#endif
+  }
+
+  void end_phase(int phase) {
+#if LFU_CACHE_PHASE_TIMERS
+    auto now = std::chrono::steady_clock::now();
+    batch_.phase_ns[phase] +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - phase_start_).count();
+    phase_start_ = now;
+#else
+    (void)phase;
+#endif
+  }
+
+  void add_row(long freq, long row_num) { histogram_[CacheStats::freq_bucket(freq)] += row_num; }
+
+  void move_row(long old_freq, long new_freq) {
+    auto old_bucket = CacheStats::freq_bucket(old_freq);
+    auto new_bucket = CacheStats::freq_bucket(new_freq);
+    if (old_bucket != new_bucket) {
+      histogram_[old_bucket]--;
+      histogram_[new_bucket]++;
+    }
+  }
+
+  void clear_rows() { std::fill(histogram_, histogram_ + CacheStats::kFreqBucketNum, 0); }
+
+  /* rows evicted by reclaim(), between batches */
+  void add_reclaim(long row_num) {
+    total_.reclaim_num += row_num;
+    publish();
+  }
+
+  void end_batch() {
+    total_ += batch_;
+    publish();
+  }
+
+  /* publish without a batch, after init_state / load_state */
+  void publish() {
+    auto seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    store(published_total_, total_);
+    store(published_batch_, batch_);
+    for (int i = 0; i < CacheStats::kFreqBucketNum; i++) {
+      published_histogram_[i].store(histogram_[i], std::memory_order_relaxed);
+    }
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  CacheStats snapshot() const {
+    CacheStats stats;
+    while (true) {
+      auto seq = seq_.load(std::memory_order_acquire);
+      if (seq & 1) {
+        continue;
+      }
+      load(published_total_, stats.total);
+      load(published_batch_, stats.last_batch);
+      for (int i = 0; i < CacheStats::kFreqBucketNum; i++) {
+        stats.freq_histogram[i] = published_histogram_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == seq) {
+        break;
+      }
+    }
+    std::lock_guard<std::mutex> lock(baseline_mutex_);
+    auto baseline = baseline_;
+    subtract(stats.total, baseline);
+    return stats;
+  }
+
+  void reset() {
+    CacheCounters total;
+    while (true) {
+      auto seq = seq_.load(std::memory_order_acquire);
+      if (seq & 1) {
+        continue;
+      }
+      load(published_total_, total);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == seq) {
+        break;
+      }
+    }
+    std::lock_guard<std::mutex> lock(baseline_mutex_);
+    baseline_ = total;
+  }
+
+ private:
+  static const int kFieldNum = 11;
+  static const int kCounterNum = kFieldNum + CacheCounters::kMaxPhaseNum;
+  typedef std::atomic<long> PublishedCounters[kCounterNum];
+
+  // manager thread only
+  CacheCounters batch_;
+  CacheCounters total_;
+  long histogram_[CacheStats::kFreqBucketNum] = {};
+#if LFU_CACHE_PHASE_TIMERS
+  std::chrono::steady_clock::time_point phase_start_;
+#endif
+
+  // published under seq_
+  std::atomic<long> seq_{0};
+  PublishedCounters published_total_ = {};
+  PublishedCounters published_batch_ = {};
+  std::atomic<long> published_histogram_[CacheStats::kFreqBucketNum] = {};
+
+  // poller side
+  mutable std::mutex baseline_mutex_;
+  CacheCounters baseline_;
+
+  static long& counter(CacheCounters& c, int i) {
+    long* fields[kFieldNum] = {&c.batch_num, &c.lookup_num,      &c.unique_num,
+                               &c.hit_num,   &c.miss_num,        &c.bypass_num,
+                               &c.admit_num, &c.evict_num,       &c.masked_skip_num,
+                               &c.lookahead_skip_num, &c.reclaim_num};
+    return i < kFieldNum ? *fields[i] : c.phase_ns[i - kFieldNum];
+  }
+
+  static void store(PublishedCounters& dst, CacheCounters& src) {
+    for (int i = 0; i < kCounterNum; i++) {
+      dst[i].store(counter(src, i), std::memory_order_relaxed);
+    }
+  }
+
+  static void load(const PublishedCounters& src, CacheCounters& dst) {
+    for (int i = 0; i < kCounterNum; i++) {
+      counter(dst, i) = src[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  static void subtract(CacheCounters& c, CacheCounters& baseline) {
+    for (int i = 0; i < kCounterNum; i++) {
+      counter(c, i) -= counter(baseline, i);
+    }
+  }
+};
@@ -1,5 +1,13 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+
 #include "cache_mgr.h"
+#include "multi_table_cache_mgr.h"
+#include "sharded_cache_mgr.h"
 #include "sort_cache_mgr.h"
+#include "workload.h"
 template <typename T>
 void print_vector(std::vector<T> v) {
   for (auto i : v) {
@@ -22,6 +30,12 @@ void print_cache_instruction(CacheInstruction inst) {
   std::cout << std::endl;
 }
 
+SortCacheIndicesManager select_mgr(4, 0, SortEvictEngine::kSelect);
+CacheIndicesManager lfu_mgr(4);
+FlatCacheIndicesManager flat_mgr(4);
+MultiTableCacheIndicesManager multi_mgr(4, 2);
+int mismatch = 0;
+
 void op(SortCacheIndicesManager& mgr, long request[], long n) {
   std::cout << "incoming request: ";
   for (long i = 0; i < n; i++) {
@@ -31,6 +45,325 @@ void op(SortCacheIndicesManager& mgr, long request[], long n) {
   std::vector<long> request_vector(request, request + n);
   auto ret = mgr.prepare_ids(request_vector);
   print_cache_instruction(ret);
+  // kSelect engine must pick the same victims
+  if (select_mgr.prepare_ids(request_vector) != ret) {
+    std::cout << "kSelect mismatch" << std::endl;
+    mismatch++;
+  }
+  // FlatCacheIndicesManager must behave like CacheIndicesManager
+  auto flat_ret = flat_mgr.prepare_ids(request_vector);
+  if (flat_ret != lfu_mgr.prepare_ids(request_vector)) {
+    std::cout << "flat mismatch" << std::endl;
+    mismatch++;
+  }
+  // a shared pool serving one table must behave like FlatCacheIndicesManager
+  long table_offsets[] = {0, n, n};
+  MultiTableInstructionBuffer multi_out;
+  multi_mgr.prepare_ids(table_offsets, request, multi_out);
+  if (std::move(multi_out.instruction).to_instruction() != flat_ret) {
+    std::cout << "multi table mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+const std::string snapshot_path =
+    (std::filesystem::temp_directory_path() / "cache_test_snapshot.bin").string();
+
+// FlatCacheIndicesManager must emit CacheIndicesManager's instructions on a zipf stream,
+// with -1 as the hottest id
+void check_flat() {
+  CacheIndicesManager lfu(2000);
+  FlatCacheIndicesManager flat(2000);
+  ZipfWorkload workload(20000, 1.0, 5);
+  std::vector<long> request_vector(512);
+  bool valid = true;
+  for (long b = 0; b < 60; b++) {
+    workload.next_batch(request_vector.data(), request_vector.size());
+    for (auto& cpu_idx : request_vector) {
+      cpu_idx--;
+    }
+    valid &= flat.prepare_ids(request_vector) == lfu.prepare_ids(request_vector);
+  }
+  if (!valid) {
+    std::cout << "flat zipf mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+// kSelect must pick kSet's victims once rows climb past the one-freq buckets
+void check_select_hot() {
+  SortCacheIndicesManager set_mgr(64, 256);
+  SortCacheIndicesManager select_mgr(64, 256, SortEvictEngine::kSelect, IndexMapMode::kDense);
+  std::mt19937_64 rng(7);
+  bool valid = true;
+  for (long b = 0; b < 100; b++) {
+    std::vector<long> request_vector;
+    for (long i = 0; i < 16; i++) {
+      auto cpu_idx = static_cast<long>(rng() % 256 * (rng() % 256) / 256);
+      request_vector.insert(request_vector.end(), 256 + rng() % 1000, cpu_idx);
+    }
+    valid &= set_mgr.prepare_ids(request_vector) == select_mgr.prepare_ids(request_vector);
+  }
+  if (!valid) {
+    std::cout << "kSelect hot mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+// a manager restored from a snapshot must continue exactly like the saved one
+template <typename Manager>
+void check_snapshot(Manager& mgr, Manager& restored, const std::vector<long>& request_vector) {
+  mgr.save_state(snapshot_path);
+  restored.load_state(snapshot_path);
+  if (restored.prepare_ids(request_vector) != mgr.prepare_ids(request_vector)) {
+    std::cout << "snapshot mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+template <typename A, typename B>
+bool same_vector(const std::vector<A>& a, const std::vector<B>& b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+// an int32 manager must emit the same instructions as its long twin, across a resize and
+// snapshots loaded from one into the other
+template <typename Manager, typename CompactManager>
+void check_compact(Manager& mgr, CompactManager& compact_mgr, const char* name) {
+  ZipfWorkload workload(20000, 1.0, 3);
+  std::vector<long> request_vector(512);
+  std::vector<int32_t> compact_request_vector(request_vector.size());
+  typename Manager::InstructionBuffer out;
+  typename CompactManager::InstructionBuffer compact_out;
+  bool valid = true;
+  for (long b = 0; b < 60; b++) {
+    workload.next_batch(request_vector.data(), request_vector.size());
+    std::copy(request_vector.begin(), request_vector.end(), compact_request_vector.begin());
+    mgr.prepare_ids(request_vector.data(), request_vector.size(), out);
+    compact_mgr.prepare_ids(compact_request_vector.data(), compact_request_vector.size(),
+                            compact_out);
+    valid &= same_vector(out.gpu_idx_vector, compact_out.gpu_idx_vector) &&
+             same_vector(out.admit_cpu_idx_vector, compact_out.admit_cpu_idx_vector) &&
+             same_vector(out.admit_to_cache_idx_vector, compact_out.admit_to_cache_idx_vector) &&
+             same_vector(out.evict_cache_idx_vector, compact_out.evict_cache_idx_vector) &&
+             same_vector(out.evict_to_cpu_idx_vector, compact_out.evict_to_cpu_idx_vector);
+    if (b == 20) {
+      mgr.save_state(snapshot_path);
+      compact_mgr.load_state(snapshot_path);
+    } else if (b == 30) {
+      compact_mgr.save_state(snapshot_path);
+      mgr.load_state(snapshot_path);
+    } else if (b == 40) {
+      mgr.resize(1500, out);
+      compact_mgr.resize(1500, compact_out);
+      valid &= same_vector(out.evict_cache_idx_vector, compact_out.evict_cache_idx_vector) &&
+               same_vector(out.evict_to_cpu_idx_vector, compact_out.evict_to_cpu_idx_vector);
+    }
+  }
+  if (!valid) {
+    std::cout << name << " compact mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+// word of the saved snapshot, counted from the first section
+long snapshot_word(long word) {
+  std::ifstream file(snapshot_path, std::ios::binary);
+  file.seekg(sizeof(snapshot_format::SnapshotHeader) + word * sizeof(long));
+  long value = 0;
+  file.read(reinterpret_cast<char*>(&value), sizeof(value));
+  return value;
+}
+
+void patch_snapshot(long word, long value) {
+  std::fstream file(snapshot_path, std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(sizeof(snapshot_format::SnapshotHeader) + word * sizeof(long));
+  file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// a corrupt snapshot must throw and leave the manager it is loaded into untouched
+template <typename Manager, typename Patch>
+void check_corrupt_snapshot(Manager& mgr, Manager& restored, Manager& fresh,
+                            const std::vector<long>& request_vector, Patch patch) {
+  mgr.save_state(snapshot_path);
+  patch();
+  bool thrown = false;
+  try {
+    restored.load_state(snapshot_path);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown || restored.prepare_ids(request_vector) != fresh.prepare_ids(request_vector)) {
+    std::cout << "corrupt snapshot mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+// a shrink below the reclaim watermark must throw before it changes anything, and once the
+// watermark is lowered a reclaim after the shrink must free only up to high rows
+template <typename Manager>
+void check_reclaim_resize(Manager& mgr) {
+  std::vector<long> request_vector(mgr.capacity());
+  for (size_t i = 0; i < request_vector.size(); i++) {
+    request_vector[i] = i;
+  }
+  mgr.prepare_ids(request_vector);
+  mgr.set_reclaim_watermark(10, 90);
+  typename Manager::InstructionBuffer out;
+  bool thrown = false;
+  try {
+    mgr.resize(50, out);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  mgr.set_reclaim_watermark(5, 20);
+  mgr.resize(50, out);
+  long shrink_evict_num = out.evict_cache_idx_vector.size();
+  mgr.reclaim(out);
+  if (!thrown || shrink_evict_num != 50 || out.evict_cache_idx_vector.size() != 20) {
+    std::cout << "reclaim resize mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+// an id a shard's admission filter bypassed must keep gpu idx -1 in the merged output and be
+// listed once in the merged bypass vector
+void check_sharded_bypass() {
+  ShardedCacheIndicesManager<CacheIndicesManager> sharded(16, 2, 1);
+  for (long s = 0; s < sharded.shard_num(); s++) {
+    sharded.shard(s).set_admission_filter(true);
+  }
+  long bypass_lookup_num = 0;
+  for (long b = 0; b < 20; b++) {
+    std::vector<long> request_vector;
+    for (long i = 0; i < 6; i++) {
+      request_vector.push_back(b % 2 ? i : 100 * b + i);
+    }
+    CacheInstructionBuffer out;
+    sharded.prepare_ids(request_vector.data(), request_vector.size(), out);
+    auto bypass_vector = out.bypass_cpu_idx_vector;
+    std::sort(bypass_vector.begin(), bypass_vector.end());
+    bool valid = std::unique(bypass_vector.begin(), bypass_vector.end()) == bypass_vector.end();
+    for (size_t i = 0; i < request_vector.size(); i++) {
+      auto gpu_idx = out.gpu_idx_vector[i];
+      if (gpu_idx == -1) {
+        bypass_lookup_num++;
+        valid &= std::binary_search(bypass_vector.begin(), bypass_vector.end(), request_vector[i]);
+      } else {
+        valid &= gpu_idx >= 0 && gpu_idx < 16;
+      }
+    }
+    if (!valid) {
+      std::cout << "sharded bypass mismatch" << std::endl;
+      mismatch++;
+    }
+  }
+  if (bypass_lookup_num == 0) {
+    std::cout << "sharded bypass mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+// a batch with an id out of the dense range must throw before it changes anything
+void check_dense_range() {
+  CacheIndicesManager dense_mgr(4, 16, IndexMapMode::kDense);
+  CacheIndicesManager expected_mgr(4, 16, IndexMapMode::kDense);
+  std::vector<long> request_vector = {1, 2, 3, 4};
+  dense_mgr.prepare_ids(request_vector);
+  expected_mgr.prepare_ids(request_vector);
+  std::vector<long> bad_vector = {1, 5, 6, 16};
+  bool thrown = false;
+  try {
+    dense_mgr.prepare_ids(bad_vector);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  request_vector = {5, 6, 7, 1};
+  if (!thrown || dense_mgr.prepare_ids(request_vector) != expected_mgr.prepare_ids(request_vector)) {
+    std::cout << "dense range mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+// rows under a table's min quota must never be stolen by another table, a table at its max
+// quota must evict its own rows while free rows remain, and offsets not starting at 0 throw
+void check_quota() {
+  MultiTableCacheIndicesManager min_mgr(8, 2), max_mgr(8, 2);
+  min_mgr.set_quota(0, 4, 8);
+  max_mgr.set_quota(0, 0, 2);
+  MultiTableInstructionBuffer out;
+  bool valid = true;
+  // table 0 fills its min quota with cold rows, then table 1 keeps bringing hotter ids
+  std::vector<long> request_vector = {0, 1, 2, 3};
+  long table0_offsets[] = {0, 4, 4};
+  min_mgr.prepare_ids(table0_offsets, request_vector.data(), out);
+  for (long b = 0; b < 4; b++) {
+    request_vector.clear();
+    for (long i = 0; i < 8; i++) {
+      request_vector.push_back(10 * b + 100 + i / 2);
+    }
+    long table1_offsets[] = {0, 0, 8};
+    min_mgr.prepare_ids(table1_offsets, request_vector.data(), out);
+    valid &= out.evict_offsets[1] == 0 && out.evict_offsets[2] == (b > 0 ? 4 : 0);
+    valid &= min_mgr.row_num(0) == 4 && min_mgr.row_num(1) == 4;
+  }
+  // table 0 holds at most 2 rows though 6 rows stay free
+  for (long b = 0; b < 4; b++) {
+    request_vector = {2 * b, 2 * b + 1};
+    long table0_offsets[] = {0, 2, 2};
+    max_mgr.prepare_ids(table0_offsets, request_vector.data(), out);
+    valid &= out.evict_offsets[1] == (b > 0 ? 2 : 0) && max_mgr.row_num(0) == 2;
+  }
+  bool thrown = false;
+  try {
+    long bad_offsets[] = {1, 2, 2};
+    max_mgr.prepare_ids(bad_offsets, request_vector.data(), out);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  if (!valid || !thrown) {
+    std::cout << "quota mismatch" << std::endl;
+    mismatch++;
+  }
+}
+
+// a batch with a bad tag or id, or more distinct ids of a table than its max quota, must
+// throw before it changes anything
+void check_rejected_batch() {
+  MultiTableCacheIndicesManager rejecting_mgr(8, 2), expected_mgr(8, 2);
+  rejecting_mgr.set_quota(0, 0, 2);
+  expected_mgr.set_quota(0, 0, 2);
+  MultiTableInstructionBuffer out, expected_out;
+  std::vector<long> table_vector = {0, 0, 1, 1, 1};
+  std::vector<long> request_vector = {0, 1, 5, 6, 7};
+  rejecting_mgr.prepare_tagged_ids(table_vector.data(), request_vector.data(), 5, out);
+  expected_mgr.prepare_tagged_ids(table_vector.data(), request_vector.data(), 5, expected_out);
+  std::vector<std::vector<long>> bad_table_vectors = {{1, 1, 2}, {1, 0, 1}, {0, 0, 0}};
+  std::vector<std::vector<long>> bad_request_vectors = {{8, 9, 0}, {8, 2, -1}, {2, 3, 4}};
+  bool valid = true;
+  for (size_t b = 0; b < bad_table_vectors.size(); b++) {
+    bool thrown = false;
+    try {
+      rejecting_mgr.prepare_tagged_ids(bad_table_vectors[b].data(),
+                                       bad_request_vectors[b].data(), 3, out);
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    valid &= thrown;
+  }
+  table_vector = {0, 0, 1, 1};
+  request_vector = {1, 2, 7, 8};
+  rejecting_mgr.prepare_tagged_ids(table_vector.data(), request_vector.data(), 4, out);
+  expected_mgr.prepare_tagged_ids(table_vector.data(), request_vector.data(), 4, expected_out);
+  valid &= std::move(out.instruction).to_instruction() ==
+           std::move(expected_out.instruction).to_instruction();
+  for (long t = 0; t < 2; t++) {
+    valid &= rejecting_mgr.row_num(t) == expected_mgr.row_num(t);
+  }
+  if (!valid) {
+    std::cout << "rejected batch mismatch" << std::endl;
+    mismatch++;
+  }
 }
 
 int main() {
@@ -65,5 +398,75 @@ int main() {
   //   long n = sizeof(request) / sizeof(request[0]);
   //   op(mgr, request, n);
   // }
-  return 0;
+  {
+    std::vector<long> request_vector = {12, 14, 11, 15, 15};
+    SortCacheIndicesManager restored(4);
+    check_snapshot(mgr, restored, request_vector);
+    CacheIndicesManager lfu_restored(4);
+    check_snapshot(lfu_mgr, lfu_restored, request_vector);
+  }
+  {
+    // 3 cached rows and 1 free row. list manager sections: cache_idx [0, 3), cpu_idx [3, 6),
+    // freq [6, 9), epoch [9, 12), free stack [12, 13)
+    std::vector<long> request_vector = {1, 2, 3};
+    CacheIndicesManager lfu_saved(4);
+    lfu_saved.prepare_ids(request_vector);
+    // copy word src over word dst, or write value
+    auto copy_word = [](long dst, long src) {
+      return [=] { patch_snapshot(dst, snapshot_word(src)); };
+    };
+    auto set_word = [](long dst, long value) { return [=] { patch_snapshot(dst, value); }; };
+    std::vector<std::function<void()>> lfu_patches = {
+        copy_word(4, 3),        // duplicate cpu idx
+        copy_word(1, 0),        // duplicate cache idx
+        copy_word(12, 0),       // cached row on the free stack
+        set_word(7, 1L << 40),  // freq out of Count
+    };
+    for (auto const& patch : lfu_patches) {
+      CacheIndicesManager lfu_restored(4), lfu_fresh(4);
+      check_corrupt_snapshot(lfu_saved, lfu_restored, lfu_fresh, request_vector, patch);
+    }
+    // sort manager sections: freq [0, 4), cpu_match [4, 8), epoch [8, 12), free stack
+    // [12, 13), freq_order [13, 17), cached cpu_idx [17, 20), cached cache_idx [20, 23)
+    SortCacheIndicesManager sort_saved(4);
+    sort_saved.prepare_ids(request_vector);
+    std::vector<std::function<void()>> sort_patches = {
+        set_word(0, -1),         // negative freq
+        set_word(12, 1L << 40),  // free row out of range
+        copy_word(12, 20),       // cached row on the free stack
+        set_word(20, 1L << 40),  // cached cache idx out of range
+        copy_word(14, 13),       // freq_order not a permutation
+    };
+    for (auto const& patch : sort_patches) {
+      SortCacheIndicesManager sort_restored(4), sort_fresh(4);
+      check_corrupt_snapshot(sort_saved, sort_restored, sort_fresh, request_vector, patch);
+    }
+  }
+  {
+    CacheIndicesManager lfu_reclaim(100);
+    check_reclaim_resize(lfu_reclaim);
+    SortCacheIndicesManager sort_reclaim(100, 100);
+    check_reclaim_resize(sort_reclaim);
+  }
+  check_sharded_bypass();
+  check_flat();
+  check_select_hot();
+  check_dense_range();
+  check_quota();
+  check_rejected_batch();
+  {
+    CacheIndicesManager lfu_long(2000, 20000);
+    CompactCacheIndicesManager lfu_compact(2000, 20000);
+    check_compact(lfu_long, lfu_compact, "cim");
+    SortCacheIndicesManager sort_long(2000, 20000);
+    CompactSortCacheIndicesManager sort_compact(2000, 20000);
+    check_compact(sort_long, sort_compact, "sort_set");
+    SortCacheIndicesManager select_long(2000, 20000, SortEvictEngine::kSelect,
+                                        IndexMapMode::kDense);
+    CompactSortCacheIndicesManager select_compact(2000, 20000, SortEvictEngine::kSelect,
+                                                  IndexMapMode::kDense);
+    check_compact(select_long, select_compact, "sort_select_dense");
+  }
+  std::remove(snapshot_path.c_str());
+  return mismatch;
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    fixed-size pool for fork-join loops.
+    parallel_for(n, fn) runs fn(0) ... fn(n - 1) on the workers and the calling thread,
+    then returns. the first exception thrown by a task is rethrown to the caller.
+*/
+class ThreadPool {
+ public:
+  ThreadPool(long thread_num = 1) {
+    for (long i = 1; i < thread_num; i++) {
+      workers_.emplace_back([this] { worker_loop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    task_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  long thread_num() const { return workers_.size() + 1; }
+
+  void parallel_for(long n, const std::function<void(long)>& fn) {
+    if (workers_.empty() || n <= 1) {
+      for (long i = 0; i < n; i++) {
+        fn(i);
+      }
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &fn;
+      task_num_ = n;
+      next_task_ = 0;
+      error_ = nullptr;
+      pending_workers_ = workers_.size();
+      generation_++;
+    }
+    task_cv_.notify_all();
+    run_tasks();
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_workers_ == 0; });
+    task_ = nullptr;
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+ private:
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable task_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(long)>* task_ = nullptr;
+  long task_num_ = 0;
+  std::atomic<long> next_task_{0};
+  long pending_workers_ = 0;
+  long generation_ = 0;
+  bool stop_ = false;
+  std::exception_ptr error_;
+
+  void worker_loop() {
+    long seen_generation = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        task_cv_.wait(lock, [&] { return stop_ || generation_ != seen_generation; });
+        if (stop_) {
+          return;
+        }
+        seen_generation = generation_;
+      }
+      run_tasks();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_workers_ == 0) {
+        done_cv_.notify_one();
+      }
+    }
+  }
+
+  void run_tasks() {
+    for (long i = next_task_++; i < task_num_; i = next_task_++) {
+      try {
+        (*task_)(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+          error_ = std::current_exception();
+        }
+      }
+    }
+  }
+};
@@ -0,0 +1,203 @@
+// three-tier step: TieredCacheIndicesManager over a device cache, a host tier and a scratch
+// file holding every row. each batch writes back device rows, demotes host rows to the file,
+// promotes file rows to host, loads device rows and gathers the batch. with --verify 1 every
+// gathered row is checked against the same oracle as e2e_bench.
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file_tier.h"
+#include "row_mover.h"
+#include "tiered_cache_mgr.h"
+#include "workload.h"
+
+using namespace std;
+
+struct TieredConfig {
+  string workload = "zipf";
+  string path = "tiered_rows.bin";
+  long batch_num = 100;
+  long batch_size = 8192;
+  long capacity = 16384;
+  long host_capacity = 65536;
+  long id_range = 1048576;
+  long row_width = 32;
+  long thread_num = 1;
+  bool verify = false;
+  double skew = 1.0;
+  uint64_t seed = 7;
+};
+
+void print_usage() {
+  cerr << "usage: tiered_bench [--workload uniform|zipf|shift] [--file PATH] [--batches N]\n"
+          "                    [--batch-size N] [--capacity N] [--host-capacity N]\n"
+          "                    [--id-range N] [--width FLOATS] [--threads N] [--verify 0|1]\n"
+          "                    [--skew S] [--seed N]\n";
+}
+
+TieredConfig parse_args(int argc, char** argv) {
+  TieredConfig config;
+  for (int i = 1; i < argc; i++) {
+    string key = argv[i];
+    if (key == "--help" || key == "-h") {
+      print_usage();
+      exit(0);
+    }
+    if (i + 1 >= argc) {
+      print_usage();
+      throw runtime_error("Error: missing value for " + key);
+    }
+    string value = argv[++i];
+    if (key == "--workload") {
+      config.workload = value;
+    } else if (key == "--file") {
+      config.path = value;
+    } else if (key == "--batches") {
+      config.batch_num = stol(value);
+    } else if (key == "--batch-size") {
+      config.batch_size = stol(value);
+    } else if (key == "--capacity") {
+      config.capacity = stol(value);
+    } else if (key == "--host-capacity") {
+      config.host_capacity = stol(value);
+    } else if (key == "--id-range") {
+      config.id_range = stol(value);
+    } else if (key == "--width") {
+      config.row_width = stol(value);
+    } else if (key == "--threads") {
+      config.thread_num = stol(value);
+    } else if (key == "--verify") {
+      config.verify = stol(value) != 0;
+    } else if (key == "--skew") {
+      config.skew = stod(value);
+    } else if (key == "--seed") {
+      config.seed = stoull(value);
+    } else {
+      print_usage();
+      throw runtime_error("Error: unknown option " + key);
+    }
+  }
+  // the oracle stores ids and counts in floats
+  if (config.verify && (config.id_range > (1L << 24) || config.batch_num * config.batch_size +
+                                                                config.row_width >
+                                                            (1L << 24))) {
+    throw runtime_error("Error: --verify needs ids and update counts below 2^24.");
+  }
+  return config;
+}
+
+vector<vector<long>> make_batches(const TieredConfig& config) {
+  function<void(long*, long)> next_batch;
+  if (config.workload == "uniform") {
+    auto gen = make_shared<UniformWorkload>(config.id_range, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "zipf") {
+    auto gen = make_shared<ZipfWorkload>(config.id_range, config.skew, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "shift") {
+    auto gen = make_shared<ShiftingHotSetWorkload>(config.id_range, 8192, 0.8, 10, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else {
+    throw runtime_error("Error: unknown workload " + config.workload);
+  }
+  vector<vector<long>> batches(config.batch_num, vector<long>(config.batch_size));
+  for (auto& batch : batches) {
+    next_batch(batch.data(), batch.size());
+  }
+  return batches;
+}
+
+/* file row id starts as (id, 1, 2, ..., width - 1) */
+void fill_file(FileRowStore& file) {
+  const long kRowsPerWrite = 4096;
+  long width = file.row_width();
+  vector<float> rows(kRowsPerWrite * width);
+  for (long first = 0; first < file.row_num(); first += kRowsPerWrite) {
+    auto row_num = min(kRowsPerWrite, file.row_num() - first);
+    for (long r = 0; r < row_num; r++) {
+      rows[r * width] = float(first + r);
+      for (long c = 1; c < width; c++) {
+        rows[r * width + c] = float(c);
+      }
+    }
+    file.write_rows(first, row_num, rows.data());
+  }
+}
+
+/* the e2e_bench oracle: every gather adds 1 to columns 1.. of the gathered device rows */
+long verify_batch(RowMover& mover, const vector<long>& batch, const CacheInstructionBuffer& out,
+                  const vector<float>& batch_rows, vector<long>& update_count) {
+  long error_num = 0;
+  long width = mover.row_width();
+  for (size_t i = 0; i < batch.size(); i++) {
+    auto row = batch_rows.data() + i * width;
+    bool ok = row[0] == float(batch[i]);
+    for (long c = 1; c < width && ok; c++) {
+      ok = row[c] == float(c + update_count[batch[i]]);
+    }
+    error_num += !ok;
+  }
+  for (size_t i = 0; i < batch.size(); i++) {
+    auto row = mover.cache_row(out.gpu_idx_vector[i]);
+    for (long c = 1; c < width; c++) {
+      row[c] += 1.0f;
+    }
+    update_count[batch[i]]++;
+  }
+  return error_num;
+}
+
+int main(int argc, char** argv) {
+  auto config = parse_args(argc, argv);
+  auto batches = make_batches(config);
+  TieredCacheIndicesManager mgr(config.capacity, config.host_capacity, config.id_range);
+  // host tier = the mover's backing table, device tier = its cache table
+  RowMover mover(config.host_capacity, config.capacity, config.row_width, config.thread_num);
+  FileRowStore file(config.path, config.id_range, config.row_width, config.thread_num);
+  unlink(config.path.c_str());  // scratch: the file goes away with the descriptor
+  fill_file(file);
+  vector<long> update_count(config.verify ? config.id_range : 0);
+  vector<float> batch_rows(config.batch_size * config.row_width);
+  TieredInstructionBuffer out;
+  double prepare_s = 0.0, io_s = 0.0, apply_s = 0.0, gather_s = 0.0;
+  long id_num = 0, admit_num = 0, error_num = 0;
+  long promote_ios = 0, demote_ios = 0;
+  for (auto const& batch : batches) {
+    auto start = chrono::steady_clock::now();
+    admit_num += get<0>(mgr.prepare_ids(batch.data(), batch.size(), out));
+    auto prepared = chrono::steady_clock::now();
+    mover.write_back(out.device);
+    auto written_back = chrono::steady_clock::now();
+    demote_ios += file.write_runs(out.demote_run_vector, mover.backing_row(0), mover.row_stride());
+    promote_ios += file.read_runs(out.promote_run_vector, mover.backing_row(0), mover.row_stride());
+    auto promoted = chrono::steady_clock::now();
+    mover.load(out.device);
+    auto loaded = chrono::steady_clock::now();
+    mover.gather(out.device.gpu_idx_vector, batch_rows.data());
+    auto gathered = chrono::steady_clock::now();
+    prepare_s += chrono::duration<double>(prepared - start).count();
+    io_s += chrono::duration<double>(promoted - written_back).count();
+    apply_s += chrono::duration<double>(written_back - prepared + loaded - promoted).count();
+    gather_s += chrono::duration<double>(gathered - loaded).count();
+    id_num += batch.size();
+    if (config.verify) {
+      error_num += verify_batch(mover, batch, out.device, batch_rows, update_count);
+    }
+  }
+  cout << "capacity,host_capacity,width,threads,batch_num,id_num,prepare_s,io_s,apply_s,gather_s,"
+          "promote_rows,promote_ios,demote_rows,demote_ios,device_hit_rate,host_hit_rate,errors"
+       << endl;
+  cout << config.capacity << "," << config.host_capacity << "," << config.row_width << ","
+       << mover.thread_num() << "," << batches.size() << "," << id_num << "," << prepare_s << ","
+       << io_s << "," << apply_s << "," << gather_s << "," << mgr.promote_num() << ","
+       << promote_ios << "," << mgr.demote_num() << "," << demote_ios << ","
+       << (id_num > 0 ? 1.0 - double(admit_num) / id_num : 0.0) << ","
+       << (id_num > 0 ? 1.0 - double(mgr.promote_num()) / id_num : 0.0) << ","
+       << (config.verify ? to_string(error_num) : string("-")) << endl;
+  return error_num > 0 ? 1 : 0;
+}
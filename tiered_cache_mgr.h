@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "cache_instruction.h"
+#include "cache_mgr.h"
+#include "dense_index_map.h"
+#include "eviction_policy.h"
+#include "transfer_plan.h"
+
+/*
+    instructions of one TieredCacheIndicesManager batch, applied in this order:
+        1. device.evict_*: device rows -> host rows,
+        2. demote_*:       host rows -> file rows,
+        3. promote_*:      file rows -> host rows,
+        4. device.admit_*: host rows -> device rows.
+    device is a CacheIndicesManager instruction whose cpu indices are host rows; its
+    gpu_idx_vector keeps the input order. file rows are ids.
+    demote_run_vector (host -> file) and promote_run_vector (file -> host) group the file
+    transfers into contiguous runs ordered by file row, ready for one large I/O per run.
+*/
+struct TieredInstructionBuffer {
+  CacheInstructionBuffer device;
+  std::vector<long> demote_host_idx_vector;
+  std::vector<long> demote_to_file_idx_vector;
+  std::vector<long> promote_file_idx_vector;
+  std::vector<long> promote_to_host_idx_vector;
+  std::vector<CopyRun> demote_run_vector;
+  std::vector<CopyRun> promote_run_vector;
+
+  void clear() {
+    device.clear();
+    demote_host_idx_vector.clear();
+    demote_to_file_idx_vector.clear();
+    promote_file_idx_vector.clear();
+    promote_to_host_idx_vector.clear();
+    demote_run_vector.clear();
+    promote_run_vector.clear();
+  }
+};
+
+enum class Tier { kDevice, kHost, kFile };
+
+/*
+    three tiers: a device cache of cache_capacity rows, a host tier of host_capacity rows and
+    a file tier holding every id's row at file row id, ids in [0, file_row_num).
+    the device tier is a CacheIndicesManager over the ids (LFU, masking, aging as usual).
+    the host tier is inclusive of the device tier: a device row is written back to the host
+    row of its id, and host rows of device-resident ids are pinned. the other host rows are
+    kept in the order they left the device, and the oldest is demoted to the file when a
+    batch needs a host row for an id read from the file.
+    ids read from the file in one batch are matched to the host rows they get by
+    TransferPlanner::match_slots, so consecutive ids land in consecutive host rows and the
+    reads coalesce into runs.
+*/
+class TieredCacheIndicesManager {
+ public:
+  TieredCacheIndicesManager(long cache_capacity, long host_capacity, long file_row_num)
+      : host_capacity_(host_capacity),
+        file_row_num_(file_row_num),
+        device_(cache_capacity),
+        host_map_(file_row_num, true),
+        evictable_(host_capacity) {
+    if (host_capacity < cache_capacity) {
+      throw std::runtime_error("Error: host tier must hold at least the device cache rows.");
+    }
+    if (file_row_num < host_capacity) {
+      throw std::runtime_error("Error: file tier must hold at least the host tier rows.");
+    }
+    host_file_match_.assign(host_capacity_, -1);
+    on_device_.assign(host_capacity_, 0);
+    free_host_rows_.reserve(host_capacity_);
+    init_state();
+  }
+
+  /* out is cleared and refilled. return (admit_num, evict_num) of the device tier */
+  std::tuple<long, long> prepare_ids(const long* cpu_idx_ptr, long n,
+                                     TieredInstructionBuffer& out) {
+    out.clear();
+    for (long i = 0; i < n; i++) {
+      if (cpu_idx_ptr[i] < 0 || cpu_idx_ptr[i] >= file_row_num_) {
+        throw std::runtime_error("Error: cpu idx out of file row num.");
+      }
+    }
+    /* step 1. device tier, cpu indices are still ids */
+    auto& device = out.device;
+    auto result = device_.prepare_ids(cpu_idx_ptr, n, device);
+    /* step 2. ids leaving the device keep their host row, now evictable */
+    for (auto& cpu_idx : device.evict_to_cpu_idx_vector) {
+      auto host_idx = host_map_.find(cpu_idx);
+      on_device_[host_idx] = 0;
+      evictable_.push_back(host_idx);
+      cpu_idx = host_idx;
+    }
+    /* step 3. pin the host rows of admitted ids, collect the ids read from file */
+    missing_vector_.clear();
+    for (auto cpu_idx : device.admit_cpu_idx_vector) {
+      auto host_idx = host_map_.find(cpu_idx);
+      if (host_idx == -1) {
+        missing_vector_.push_back(cpu_idx);
+      } else {
+        evictable_.erase(host_idx);
+        on_device_[host_idx] = 1;
+      }
+    }
+    /* step 4. host rows for them: free rows, then the evictable rows that left the device
+               first, demoting their ids.
+    */
+    std::sort(missing_vector_.begin(), missing_vector_.end());
+    host_row_vector_.clear();
+    while (host_row_vector_.size() < missing_vector_.size()) {
+      if (!free_host_rows_.empty()) {
+        host_row_vector_.push_back(free_host_rows_.back());
+        free_host_rows_.pop_back();
+        continue;
+      }
+      auto host_idx = evictable_.front();
+      evictable_.erase(host_idx);
+      auto victim = host_file_match_[host_idx];
+      host_map_.erase(victim);
+      out.demote_host_idx_vector.push_back(host_idx);
+      out.demote_to_file_idx_vector.push_back(victim);
+      host_row_vector_.push_back(host_idx);
+    }
+    auto const& rows = planner_.match_slots(missing_vector_, host_row_vector_);
+    for (size_t k = 0; k < missing_vector_.size(); k++) {
+      host_map_.insert(missing_vector_[k], rows[k]);
+      host_file_match_[rows[k]] = missing_vector_[k];
+      on_device_[rows[k]] = 1;
+      out.promote_file_idx_vector.push_back(missing_vector_[k]);
+      out.promote_to_host_idx_vector.push_back(rows[k]);
+    }
+    /* step 5. device admits read host rows */
+    for (auto& cpu_idx : device.admit_cpu_idx_vector) {
+      cpu_idx = host_map_.find(cpu_idx);
+    }
+    /* step 6. file runs by file row. runs are symmetric, so demotes are coalesced from the
+               file side and flipped back.
+    */
+    planner_.coalesce(out.promote_file_idx_vector, out.promote_to_host_idx_vector,
+                      out.promote_run_vector);
+    planner_.coalesce(out.demote_to_file_idx_vector, out.demote_host_idx_vector,
+                      out.demote_run_vector);
+    for (auto& run : out.demote_run_vector) {
+      std::swap(run.src_start, run.dst_start);
+    }
+    if (transfer_plan_) {
+      planner_.plan(device);
+    }
+    promote_num_ += out.promote_file_idx_vector.size();
+    demote_num_ += out.demote_host_idx_vector.size();
+    return result;
+  }
+
+  /* also fill out.device.admit_run_vector / evict_run_vector, in host rows */
+  void set_transfer_plan(bool enabled) { transfer_plan_ = enabled; }
+
+  void set_aging(long period_batches, int shift = 1) { device_.set_aging(period_batches, shift); }
+
+  Tier tier_of(long cpu_idx) const {
+    auto host_idx = host_map_.find(cpu_idx);
+    if (host_idx == -1) {
+      return Tier::kFile;
+    }
+    return on_device_[host_idx] ? Tier::kDevice : Tier::kHost;
+  }
+
+  /* host row of cpu_idx, -1 if it is only in the file */
+  long host_idx(long cpu_idx) const { return host_map_.find(cpu_idx); }
+
+  long promote_num() const { return promote_num_; }
+  long demote_num() const { return demote_num_; }
+
+  CacheStats stats() const { return device_.stats(); }
+
+  void init_state() {
+    device_.init_state();
+    host_map_.clear();
+    evictable_.clear();
+    std::fill(host_file_match_.begin(), host_file_match_.end(), -1);
+    std::fill(on_device_.begin(), on_device_.end(), 0);
+    free_host_rows_.clear();
+    for (long i = host_capacity_ - 1; i >= 0; i--) {
+      free_host_rows_.push_back(i);
+    }
+    promote_num_ = 0;
+    demote_num_ = 0;
+  }
+
+ private:
+  long host_capacity_;
+  long file_row_num_;
+  CacheIndicesManager device_;
+  DenseIndexMap host_map_;             // id -> host row, paged
+  SlotList evictable_;                 // host rows not on the device, oldest first
+  std::vector<long> host_file_match_;  // host row -> id
+  std::vector<uint8_t> on_device_;     // host row -> its id is in the device tier
+  std::vector<long> free_host_rows_;   // stack, lowest row on top
+  bool transfer_plan_ = false;
+  TransferPlanner planner_;
+  std::vector<long> missing_vector_;   // admitted ids read from file, sorted
+  std::vector<long> host_row_vector_;  // host rows they take
+  long promote_num_ = 0;
+  long demote_num_ = 0;
+};
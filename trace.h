@@ -0,0 +1,275 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+    binary index trace: the batches passed to prepare_ids, in order.
+
+    file   := header batch*
+    header := "LFUTRACE" version(u32 le) reserved(u32 le)
+    batch  := id_num(varint) payload_bytes(varint) payload
+    payload:= id_num zigzag varints, each the delta to the previous id of the batch (first: to 0)
+
+    ids keep their input order, prepare_ids output depends on it.
+    payload_bytes lets a reader skip a batch without decoding it.
+*/
+namespace trace_format {
+static const char kMagic[8] = {'L', 'F', 'U', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t kVersion = 1;
+static const long kHeaderBytes = 16;
+
+inline void put_u32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = static_cast<uint8_t>(v >> (8 * i));
+  }
+}
+
+inline uint32_t get_u32(const uint8_t* p) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++) {
+    v |= static_cast<uint32_t>(p[i]) << (8 * i);
+  }
+  return v;
+}
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+/* decode one varint at p, no further than end. return nullptr on truncation */
+inline const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint64_t& v) {
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    auto byte = *p++;
+    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+inline uint64_t zigzag(long v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline long unzigzag(uint64_t v) { return static_cast<long>(v >> 1) ^ -static_cast<long>(v & 1); }
+}  // namespace trace_format
+
+/*
+    appends batches to a trace file. attach it to a manager with set_trace_writer() to record
+    every prepare_ids input, or call append() directly.
+*/
+class TraceWriter {
+ public:
+  TraceWriter(const std::string& path) {
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+      throw std::runtime_error("Error: cannot open trace " + path);
+    }
+    uint8_t header[trace_format::kHeaderBytes];
+    memcpy(header, trace_format::kMagic, sizeof(trace_format::kMagic));
+    trace_format::put_u32(header + 8, trace_format::kVersion);
+    trace_format::put_u32(header + 12, 0);
+    write(header, sizeof(header));
+  }
+
+  TraceWriter(const TraceWriter&) = delete;
+  TraceWriter& operator=(const TraceWriter&) = delete;
+
+  ~TraceWriter() { close(); }
+
+  template <typename Index>
+  void append(const Index* cpu_idx_ptr, long n) {
+    if (!file_) {
+      throw std::runtime_error("Error: trace is closed.");
+    }
+    payload_.clear();
+    long prev = 0;
+    for (long i = 0; i < n; i++) {
+      trace_format::put_varint(payload_, trace_format::zigzag(cpu_idx_ptr[i] - prev));
+      prev = cpu_idx_ptr[i];
+    }
+    head_.clear();
+    trace_format::put_varint(head_, n);
+    trace_format::put_varint(head_, payload_.size());
+    write(head_.data(), head_.size());
+    write(payload_.data(), payload_.size());
+    batch_num_++;
+    id_num_ += n;
+  }
+
+  void flush() {
+    if (file_) {
+      fflush(file_);
+    }
+  }
+
+  void close() {
+    if (file_) {
+      fclose(file_);
+      file_ = nullptr;
+    }
+  }
+
+  long batch_num() const { return batch_num_; }
+  long id_num() const { return id_num_; }
+  long bytes_written() const { return bytes_written_; }
+
+ private:
+  FILE* file_ = nullptr;
+  std::vector<uint8_t> head_;
+  std::vector<uint8_t> payload_;
+  long batch_num_ = 0;
+  long id_num_ = 0;
+  long bytes_written_ = 0;
+
+  void write(const void* data, size_t bytes) {
+    if (fwrite(data, 1, bytes, file_) != bytes) {
+      throw std::runtime_error("Error: trace write failed.");
+    }
+    bytes_written_ += bytes;
+  }
+};
+
+/*
+    streams batches out of a memory-mapped trace. the file is never copied into memory:
+    pages are faulted in sequentially and released behind the cursor, so a multi-GB trace
+    replays with a small resident set.
+*/
+class TraceReader {
+ public:
+  static const long kReleaseBytes = 64L << 20;  // madvise(DONTNEED) granularity
+
+  TraceReader(const std::string& path) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      throw std::runtime_error("Error: cannot open trace " + path);
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || st.st_size < trace_format::kHeaderBytes) {
+      ::close(fd_);
+      throw std::runtime_error("Error: not a trace " + path);
+    }
+    size_ = st.st_size;
+    auto addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd_);
+      throw std::runtime_error("Error: cannot mmap trace " + path);
+    }
+    data_ = static_cast<const uint8_t*>(addr);
+    madvise(addr, size_, MADV_SEQUENTIAL);
+    if (memcmp(data_, trace_format::kMagic, sizeof(trace_format::kMagic)) != 0) {
+      unmap();
+      throw std::runtime_error("Error: not a trace " + path);
+    }
+    if (trace_format::get_u32(data_ + 8) != trace_format::kVersion) {
+      unmap();
+      throw std::runtime_error("Error: unsupported trace version in " + path);
+    }
+    rewind();
+  }
+
+  TraceReader(const TraceReader&) = delete;
+  TraceReader& operator=(const TraceReader&) = delete;
+
+  ~TraceReader() { unmap(); }
+
+  /* true if path starts with the trace magic */
+  static bool is_trace(const std::string& path) {
+    char magic[sizeof(trace_format::kMagic)];
+    auto file = fopen(path.c_str(), "rb");
+    if (!file) {
+      return false;
+    }
+    auto ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+              memcmp(magic, trace_format::kMagic, sizeof(magic)) == 0;
+    fclose(file);
+    return ok;
+  }
+
+  /* decode the next batch into out. return false at the end of the trace */
+  bool next_batch(std::vector<long>& out) {
+    auto end = data_ + size_;
+    if (pos_ == end) {
+      return false;
+    }
+    uint64_t id_num, payload_bytes;
+    auto p = trace_format::get_varint(pos_, end, id_num);
+    p = p ? trace_format::get_varint(p, end, payload_bytes) : nullptr;
+    if (!p || payload_bytes > static_cast<uint64_t>(end - p)) {
+      throw std::runtime_error("Error: truncated trace.");
+    }
+    // every id takes at least one payload byte, check before a corrupt count sizes out
+    if (id_num > payload_bytes) {
+      throw std::runtime_error("Error: corrupt trace.");
+    }
+    auto payload_end = p + payload_bytes;
+    out.resize(id_num);
+    long prev = 0;
+    for (uint64_t i = 0; i < id_num; i++) {
+      uint64_t v;
+      p = trace_format::get_varint(p, payload_end, v);
+      if (!p) {
+        throw std::runtime_error("Error: truncated trace.");
+      }
+      prev += trace_format::unzigzag(v);
+      out[i] = prev;
+    }
+    pos_ = payload_end;
+    batch_num_++;
+    release_consumed();
+    return true;
+  }
+
+  void rewind() {
+    pos_ = data_ + trace_format::kHeaderBytes;
+    released_ = 0;
+    batch_num_ = 0;
+  }
+
+  long batch_num() const { return batch_num_; }  // batches read since rewind
+  long size_bytes() const { return size_; }
+
+ private:
+  int fd_ = -1;
+  const uint8_t* data_ = nullptr;
+  long size_ = 0;
+  const uint8_t* pos_ = nullptr;
+  long released_ = 0;  // bytes before this offset were handed back to the kernel
+  long batch_num_ = 0;
+
+  void release_consumed() {
+    long page = sysconf(_SC_PAGESIZE);
+    long consumed = (pos_ - data_) / page * page;
+    if (consumed - released_ >= kReleaseBytes) {
+      madvise(const_cast<uint8_t*>(data_) + released_, consumed - released_, MADV_DONTNEED);
+      released_ = consumed;
+    }
+  }
+
+  void unmap() {
+    if (data_) {
+      munmap(const_cast<uint8_t*>(data_), size_);
+      data_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+};
@@ -0,0 +1,179 @@
+// record a synthetic workload into a binary trace, inspect a trace, or replay one through
+// the managers. replay streams the trace from an mmap and keeps only one batch in memory.
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "flat_cache_mgr.h"
+#include "manager_factory.h"
+#include "trace.h"
+#include "workload.h"
+
+using namespace std;
+
+struct ReplayConfig {
+  string command;
+  string path;
+  // record
+  string workload = "zipf";
+  long batch_num = 100;
+  long batch_size = 8192;
+  long id_range = 1638400;
+  double skew = 1.0;
+  uint64_t seed = 7;
+  // replay
+  vector<string> managers = {"cim", "flat", "sort_select"};
+  long capacity = 163840;
+};
+
+void print_usage() {
+  cerr << "usage: trace_replay record TRACE [--workload uniform|zipf|shift] [--batches N]\n"
+          "                    [--batch-size N] [--id-range N] [--skew S] [--seed N]\n"
+          "                    [--capacity N]\n"
+          "       trace_replay stat TRACE\n"
+          "       trace_replay replay TRACE [--managers cim,flat,...] [--capacity N]\n"
+          "                    [--id-range N]\n";
+}
+
+ReplayConfig parse_args(int argc, char** argv) {
+  ReplayConfig config;
+  if (argc < 3) {
+    print_usage();
+    throw runtime_error("Error: missing command or trace.");
+  }
+  config.command = argv[1];
+  config.path = argv[2];
+  for (int i = 3; i < argc; i++) {
+    string key = argv[i];
+    if (i + 1 >= argc) {
+      print_usage();
+      throw runtime_error("Error: missing value for " + key);
+    }
+    string value = argv[++i];
+    if (key == "--workload") {
+      config.workload = value;
+    } else if (key == "--batches") {
+      config.batch_num = stol(value);
+    } else if (key == "--batch-size") {
+      config.batch_size = stol(value);
+    } else if (key == "--id-range") {
+      config.id_range = stol(value);
+    } else if (key == "--skew") {
+      config.skew = stod(value);
+    } else if (key == "--seed") {
+      config.seed = stoull(value);
+    } else if (key == "--capacity") {
+      config.capacity = stol(value);
+    } else if (key == "--managers") {
+      config.managers.clear();
+      stringstream ss(value);
+      string item;
+      while (getline(ss, item, ',')) {
+        config.managers.push_back(item);
+      }
+    } else {
+      print_usage();
+      throw runtime_error("Error: unknown option " + key);
+    }
+  }
+  return config;
+}
+
+/* runs the workload through a manager with a recorder attached, as production would */
+void record(const ReplayConfig& config) {
+  function<void(long*, long)> next_batch;
+  if (config.workload == "uniform") {
+    auto gen = make_shared<UniformWorkload>(config.id_range, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "zipf") {
+    auto gen = make_shared<ZipfWorkload>(config.id_range, config.skew, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else if (config.workload == "shift") {
+    auto gen = make_shared<ShiftingHotSetWorkload>(config.id_range, 8192, 0.8, 10, config.seed);
+    next_batch = [gen](long* out, long n) { gen->next_batch(out, n); };
+  } else {
+    throw runtime_error("Error: unknown workload " + config.workload);
+  }
+  TraceWriter writer(config.path);
+  FlatCacheIndicesManager mgr(max(config.capacity, config.batch_size));
+  mgr.set_trace_writer(&writer);
+  vector<long> batch(config.batch_size);
+  CacheInstructionBuffer out;
+  for (long t = 0; t < config.batch_num; t++) {
+    next_batch(batch.data(), batch.size());
+    mgr.prepare_ids(batch.data(), batch.size(), out);
+  }
+  writer.close();
+  cout << "batches " << writer.batch_num() << "  ids " << writer.id_num() << "  bytes "
+       << writer.bytes_written() << "  bytes per id "
+       << double(writer.bytes_written()) / max(writer.id_num(), 1L) << endl;
+}
+
+/* decode only, so parsing cost can be compared with replay cost */
+void stat(const ReplayConfig& config) {
+  TraceReader reader(config.path);
+  vector<long> batch;
+  long id_num = 0;
+  long id_max = -1;
+  auto start = chrono::steady_clock::now();
+  while (reader.next_batch(batch)) {
+    id_num += batch.size();
+    for (auto cpu_idx : batch) {
+      id_max = max(id_max, cpu_idx);
+    }
+  }
+  double decode_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << "batches " << reader.batch_num() << "  ids " << id_num << "  id range " << id_max + 1
+       << "  bytes " << reader.size_bytes() << "  bytes per id "
+       << double(reader.size_bytes()) / max(id_num, 1L) << "  decode ids/s "
+       << (decode_s > 0.0 ? id_num / decode_s : 0.0) << endl;
+}
+
+void replay(const ReplayConfig& config) {
+  TraceReader reader(config.path);
+  vector<long> batch;
+  CacheInstructionBuffer out;
+  cout << "manager,capacity,batch_num,id_num,replay_s,prepare_s,ids_per_s,hit_rate,admits,evicts"
+       << endl;
+  for (auto const& name : config.managers) {
+    auto prepare_ids = make_manager(name, config.capacity, config.id_range);
+    reader.rewind();
+    long id_num = 0;
+    long admit_num = 0;
+    long evict_num = 0;
+    double prepare_s = 0.0;
+    auto replay_start = chrono::steady_clock::now();
+    while (reader.next_batch(batch)) {
+      auto start = chrono::steady_clock::now();
+      auto counts = prepare_ids(batch.data(), batch.size(), out);
+      prepare_s += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      id_num += batch.size();
+      admit_num += get<0>(counts);
+      evict_num += get<1>(counts);
+    }
+    double replay_s = chrono::duration<double>(chrono::steady_clock::now() - replay_start).count();
+    cout << name << "," << config.capacity << "," << reader.batch_num() << "," << id_num << ","
+         << replay_s << "," << prepare_s << "," << (replay_s > 0.0 ? id_num / replay_s : 0.0)
+         << "," << (id_num > 0 ? 1.0 - double(admit_num) / id_num : 0.0) << "," << admit_num
+         << "," << evict_num << endl;
+  }
+}
+
+int main(int argc, char** argv) {
+  auto config = parse_args(argc, argv);
+  if (config.command == "record") {
+    record(config);
+  } else if (config.command == "stat") {
+    stat(config);
+  } else if (config.command == "replay") {
+    replay(config);
+  } else {
+    print_usage();
+    throw runtime_error("Error: unknown command " + config.command);
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "cache_instruction.h"
+
+/*
+    groups the index pairs of a batch into contiguous copies, so the data mover issues a few
+    large memcpys instead of one gather / scatter per row.
+    pairs are ordered by src, then neighbours extend a run while both src and dst advance by 1.
+    scratch is kept across calls.
+*/
+class TransferPlanner {
+ public:
+  template <typename Index>
+  void coalesce(const std::vector<Index>& src, const std::vector<Index>& dst,
+                std::vector<CopyRun>& runs) {
+    runs.clear();
+    long n = src.size();
+    if (n == 0) {
+      return;
+    }
+    pair_vector_.resize(n);
+    for (long i = 0; i < n; i++) {
+      pair_vector_[i] = std::make_pair(src[i], dst[i]);
+    }
+    if (!std::is_sorted(src.begin(), src.end())) {
+      std::sort(pair_vector_.begin(), pair_vector_.end());
+    }
+    CopyRun run = {pair_vector_[0].first, pair_vector_[0].second, 1};
+    for (long i = 1; i < n; i++) {
+      if (pair_vector_[i].first == run.src_start + run.length &&
+          pair_vector_[i].second == run.dst_start + run.length) {
+        run.length++;
+      } else {
+        runs.push_back(run);
+        run = {pair_vector_[i].first, pair_vector_[i].second, 1};
+      }
+    }
+    runs.push_back(run);
+  }
+
+  template <typename Index>
+  void plan(BasicCacheInstructionBuffer<Index>& out) {
+    coalesce(out.admit_cpu_idx_vector, out.admit_to_cache_idx_vector, out.admit_run_vector);
+    coalesce(out.evict_cache_idx_vector, out.evict_to_cpu_idx_vector, out.evict_run_vector);
+  }
+
+  /*
+      the cache rows a batch admits into (its victims and the free rows it draws) can be handed
+      out in any order. both sides are cut into maximal contiguous ranges, then the longest
+      cpu range takes the longest free row range, the remainders go back into the pool, and
+      so on. consecutive ids land in consecutive rows whenever the batch owns such rows.
+      sorted_cpu_idx must be ascending. returns the row for each sorted_cpu_idx[k].
+  */
+  template <typename Index>
+  const std::vector<long>& match_slots(const std::vector<Index>& sorted_cpu_idx,
+                                       const std::vector<Index>& cache_idx) {
+    long n = sorted_cpu_idx.size();
+    slot_vector_.resize(n);
+    cpu_range_vector_.clear();
+    row_range_heap_.clear();
+    if (n == 0) {
+      return slot_vector_;
+    }
+    sorted_row_vector_.assign(cache_idx.begin(), cache_idx.end());
+    std::sort(sorted_row_vector_.begin(), sorted_row_vector_.end());
+    // ranges as (length, begin), begin is an index into sorted_cpu_idx / sorted_row_vector_
+    for (long i = 0, begin = 0; i < n; i++) {
+      if (i + 1 == n || sorted_cpu_idx[i + 1] != sorted_cpu_idx[i] + 1) {
+        cpu_range_vector_.emplace_back(i + 1 - begin, begin);
+        begin = i + 1;
+      }
+    }
+    for (long i = 0, begin = 0; i < n; i++) {
+      if (i + 1 == n || sorted_row_vector_[i + 1] != sorted_row_vector_[i] + 1) {
+        row_range_heap_.emplace_back(i + 1 - begin, begin);
+        begin = i + 1;
+      }
+    }
+    std::sort(cpu_range_vector_.begin(), cpu_range_vector_.end(),
+              [](const std::pair<long, long>& a, const std::pair<long, long>& b) {
+                return a.first > b.first;
+              });
+    std::make_heap(row_range_heap_.begin(), row_range_heap_.end());
+    for (auto cpu_range : cpu_range_vector_) {
+      while (cpu_range.first > 0) {
+        std::pop_heap(row_range_heap_.begin(), row_range_heap_.end());
+        auto row_range = row_range_heap_.back();
+        row_range_heap_.pop_back();
+        auto length = std::min(cpu_range.first, row_range.first);
+        for (long j = 0; j < length; j++) {
+          slot_vector_[cpu_range.second + j] = sorted_row_vector_[row_range.second + j];
+        }
+        cpu_range.first -= length;
+        cpu_range.second += length;
+        if (row_range.first > length) {
+          row_range_heap_.emplace_back(row_range.first - length, row_range.second + length);
+          std::push_heap(row_range_heap_.begin(), row_range_heap_.end());
+        }
+      }
+    }
+    return slot_vector_;
+  }
+
+ private:
+  std::vector<std::pair<long, long>> pair_vector_;
+  std::vector<long> slot_vector_;
+  std::vector<long> sorted_row_vector_;
+  std::vector<std::pair<long, long>> cpu_range_vector_;  // (length, begin)
+  std::vector<std::pair<long, long>> row_range_heap_;    // (length, begin), max-heap
+};
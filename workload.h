@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+/*
+    synthetic index streams for benchmarks.
+    all generators return ids in [0, id_range).
+*/
+
+class UniformWorkload {
+ public:
+  UniformWorkload(long id_range, uint64_t seed = 0) : dist_(0, id_range - 1), rng_(seed) {}
+
+  void next_batch(long* out, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = dist_(rng_);
+    }
+  }
+
+ private:
+  std::uniform_int_distribution<long> dist_;
+  std::mt19937_64 rng_;
+};
+
+/*
+    zipf(skew) over ranks [0, id_range), sampled by binary search over the cdf.
+    ranks are scattered over the id range by a multiplicative bijection so hot ids are not
+    neighbours.
+*/
+class ZipfWorkload {
+ public:
+  ZipfWorkload(long id_range, double skew, uint64_t seed = 0)
+      : id_range_(id_range), uniform_(0.0, 1.0), rng_(seed) {
+    cdf_.resize(id_range);
+    double sum = 0.0;
+    for (long rank = 0; rank < id_range; rank++) {
+      sum += 1.0 / std::pow(double(rank + 1), skew);
+      cdf_[rank] = sum;
+    }
+    for (auto& p : cdf_) {
+      p /= sum;
+    }
+    scatter_ = 2654435761 % id_range_;
+    while (gcd(scatter_, id_range_) != 1) {
+      scatter_++;
+    }
+  }
+
+  long sample_rank() {
+    auto rank = std::lower_bound(cdf_.begin(), cdf_.end(), uniform_(rng_)) - cdf_.begin();
+    return std::min<long>(rank, id_range_ - 1);
+  }
+
+  long rank_to_id(long rank) const {
+    return static_cast<long>((static_cast<unsigned __int128>(rank) * scatter_) % id_range_);
+  }
+
+  void next_batch(long* out, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = rank_to_id(sample_rank());
+    }
+  }
+
+ private:
+  long id_range_;
+  long scatter_;
+  std::vector<double> cdf_;
+  std::uniform_real_distribution<double> uniform_;
+  std::mt19937_64 rng_;
+
+  static long gcd(long a, long b) { return b == 0 ? a : gcd(b, a % b); }
+};
+
+/*
+    hot_fraction of the ids come from a hot set of hot_size ids, the rest are uniform.
+    every shift_period batches the hot set moves to hot_size fresh ids, so rows that were hot
+    have to age out of the cache.
+*/
+class ShiftingHotSetWorkload {
+ public:
+  ShiftingHotSetWorkload(long id_range, long hot_size, double hot_fraction, long shift_period,
+                         uint64_t seed = 0)
+      : id_range_(id_range),
+        hot_size_(std::min(hot_size, id_range)),
+        hot_fraction_(hot_fraction),
+        shift_period_(shift_period),
+        uniform_(0.0, 1.0),
+        hot_dist_(0, hot_size_ - 1),
+        cold_dist_(0, id_range - 1),
+        rng_(seed) {}
+
+  void next_batch(long* out, long n) {
+    if (shift_period_ > 0 && batch_count_ > 0 && batch_count_ % shift_period_ == 0) {
+      hot_begin_ = (hot_begin_ + hot_size_) % id_range_;
+    }
+    batch_count_++;
+    for (long i = 0; i < n; i++) {
+      if (uniform_(rng_) < hot_fraction_) {
+        out[i] = (hot_begin_ + hot_dist_(rng_)) % id_range_;
+      } else {
+        out[i] = cold_dist_(rng_);
+      }
+    }
+  }
+
+ private:
+  long id_range_;
+  long hot_size_;
+  double hot_fraction_;
+  long shift_period_;
+  long hot_begin_ = 0;
+  long batch_count_ = 0;
+  std::uniform_real_distribution<double> uniform_;
+  std::uniform_int_distribution<long> hot_dist_;
+  std::uniform_int_distribution<long> cold_dist_;
+  std::mt19937_64 rng_;
+};
+
+/*
+    replays a recorded id stream: a binary trace (trace.h) or a text file of whitespace
+    separated ids. the whole stream is loaded, then cut into batches of the requested size,
+    wrapping around at its end. use TraceReader directly to replay a trace larger than memory
+    with its own batch boundaries.
+*/
+class TraceWorkload {
+ public:
+  TraceWorkload(const std::string& path) {
+    if (TraceReader::is_trace(path)) {
+      TraceReader reader(path);
+      std::vector<long> batch;
+      while (reader.next_batch(batch)) {
+        ids_.insert(ids_.end(), batch.begin(), batch.end());
+      }
+    } else {
+      std::ifstream in(path);
+      if (!in) {
+        throw std::runtime_error("Error: cannot open trace " + path);
+      }
+      long cpu_idx;
+      while (in >> cpu_idx) {
+        ids_.push_back(cpu_idx);
+      }
+    }
+    if (ids_.empty()) {
+      throw std::runtime_error("Error: empty trace " + path);
+    }
+  }
+
+  long size() const { return ids_.size(); }
+  long id_range() const { return *std::max_element(ids_.begin(), ids_.end()) + 1; }
+
+  void next_batch(long* out, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = ids_[pos_];
+      pos_ = pos_ + 1 == (long)ids_.size() ? 0 : pos_ + 1;
+    }
+  }
+
+ private:
+  std::vector<long> ids_;
+  long pos_ = 0;
+};